@@ -15,6 +15,63 @@ project "MDPAT"
 
     includedirs { "${HOME}/.local/include" }
 
+    -- Threaded kernels (private grids, cell lists, transposes) need OpenMP
+    openmp "On"
+
+    filter "action:gmake2"
+        buildoptions {"-std=c++17"}
+
+    filter "configurations:debug"
+        defines {"DEBUG"}
+        symbols "On"
+
+    filter "configurations:release"
+        defines {"NDEBUG"}
+        optimize "Speed"
+
+project "generateTrajectory"
+    architecture "x64"
+    kind "ConsoleApp"
+    language "C++"
+    location "build"
+    links { "mpi" }
+    libdirs { os.findlib("mpi", "${HOME}/.local") }
+
+    files { "tools/generateTrajectory.hpp", "tools/generateTrajectory.cpp" }
+
+    includedirs { "${HOME}/.local/include" }
+
+    -- MDBIN output is only available when the submodule is checked out
+    if os.isfile("src/mdbin/mdbin.h") then
+        includedirs { "src/mdbin" }
+        defines { "HAVE_MDBIN" }
+    end
+
+    filter "action:gmake2"
+        buildoptions {"-std=c++17"}
+
+    filter "configurations:debug"
+        defines {"DEBUG"}
+        symbols "On"
+
+    filter "configurations:release"
+        defines {"NDEBUG"}
+        optimize "Speed"
+
+project "benchTranspose"
+    architecture "x64"
+    kind "ConsoleApp"
+    language "C++"
+    location "build"
+    links { "mpi" }
+    libdirs { os.findlib("mpi", "${HOME}/.local") }
+
+    files { "tools/benchTranspose.hpp", "tools/benchTranspose.cpp" }
+
+    includedirs { "${HOME}/.local/include" }
+
+    openmp "On"
+
     filter "action:gmake2"
         buildoptions {"-std=c++17"}
 
@@ -24,4 +81,4 @@ project "MDPAT"
 
     filter "configurations:release"
         defines {"NDEBUG"}
-        optimize "Speed"
\ No newline at end of file
+        optimize "Speed"
@@ -0,0 +1,173 @@
+#include "analysisArgs.hpp"
+
+#include <algorithm>
+
+#include "error.hpp"
+#include "incremental.hpp"
+
+using std::string;
+using std::vector;
+
+namespace MDPAT
+{
+AnalysisArgs::AnalysisArgs(
+    const string& command,
+    const vector<string>& args,
+    const vector<string>& keywords) :
+    m_command(command)
+{
+    vector<string>* current = nullptr;
+    for (const auto& word : args)
+    {
+        if (keywords.end() != std::find(keywords.begin(), keywords.end(), word))
+        {
+            if (m_values.count(word))
+                errorAll(Error::SYNTAXERROR, "Keyword `%s` given twice for command %s", word.c_str(), m_command.c_str());
+            current = &m_values[word];
+        }
+        else if (current == nullptr)
+        {
+            errorAll(Error::SYNTAXERROR, "Unknown keyword for command %s: %s", m_command.c_str(), word.c_str());
+        }
+        else
+        {
+            current->push_back(word);
+        }
+    }
+}
+
+bool AnalysisArgs::has(const string& keyword) const
+{
+    return m_values.count(keyword) != 0;
+}
+
+const vector<string>& AnalysisArgs::get(const string& keyword) const
+{
+    static const vector<string> empty;
+    auto it = m_values.find(keyword);
+    if (it == m_values.end())
+        return empty;
+    return it->second;
+}
+
+const vector<string>& AnalysisArgs::getN(const string& keyword, const size_t n) const
+{
+    const auto& values = get(keyword);
+    if (values.size() != n)
+        errorAll(
+            Error::ARGUMENTERROR,
+            "Incorrect number of values for keyword `%s` of command %s: expected %d, found %d",
+            keyword.c_str(),
+            m_command.c_str(),
+            (int)n,
+            (int)values.size());
+    return values;
+}
+
+string AnalysisArgs::getString(const string& keyword, const string& defaultValue) const
+{
+    if (!has(keyword))
+        return defaultValue;
+    return getN(keyword, 1)[0];
+}
+
+double AnalysisArgs::getDouble(const string& keyword, const double defaultValue) const
+{
+    if (!has(keyword))
+        return defaultValue;
+    return std::stod(getN(keyword, 1)[0]);
+}
+
+uint64_t AnalysisArgs::getUInt(const string& keyword, const uint64_t defaultValue) const
+{
+    if (!has(keyword))
+        return defaultValue;
+    return std::stoull(getN(keyword, 1)[0]);
+}
+
+vector<int> AnalysisArgs::getInts(const string& keyword) const
+{
+    vector<int> values;
+    for (const auto& word : get(keyword))
+        values.push_back(std::stoi(word));
+    return values;
+}
+
+/*
+ Parses `<first>-<last>`, e.g., the range of time gaps in timesteps.
+*/
+std::pair<uint64_t, uint64_t> AnalysisArgs::getRange(
+    const string& keyword,
+    const uint64_t defaultFirst,
+    const uint64_t defaultLast) const
+{
+    if (!has(keyword))
+        return {defaultFirst, defaultLast};
+
+    const string& rangeString = getN(keyword, 1)[0];
+    const auto pos = rangeString.find('-');
+    if (pos == string::npos || pos == 0UL || pos == rangeString.size() - 1
+        || rangeString.find_first_not_of("0123456789-") != string::npos)
+        errorAll(Error::SYNTAXERROR, "Invalid range syntax: %s\nMust be of form <init>-<end>, e.g., 0-1000000", rangeString.c_str());
+
+    const uint64_t first = std::stoull(rangeString.substr(0, pos));
+    const uint64_t last = std::stoull(rangeString.substr(pos + 1));
+    if (last < first)
+        errorAll(Error::ARGUMENTERROR, "Invalid range: %s", rangeString.c_str());
+    return {first, last};
+}
+
+vector<int> findColumns(const Trajectory& traj, const vector<string>& labels)
+{
+    vector<int> columns;
+    for (const auto& label : labels)
+    {
+        const int col = traj.getColumnIndex(label.c_str());
+        if (col < 0)
+            errorAll(Error::ARGUMENTERROR, "Column `%s` not found in dump file", label.c_str());
+        columns.push_back(col);
+    }
+    return columns;
+}
+
+vector<int> unwrappedColumns(const Trajectory& traj, const AnalysisArgs& args)
+{
+    if (args.has("columns"))
+        return findColumns(traj, args.get("columns"));
+    return findColumns(traj, {"xu", "yu", "zu"});
+}
+
+uint64_t dumpStep(const Trajectory& traj)
+{
+    const auto& steps = traj.getStepsGlobal();
+    if (steps.size() < 2)
+        return 1UL;
+    return steps[1] - steps[0];
+}
+
+std::pair<uint64_t, uint64_t> gapRange(const Trajectory& traj, const AnalysisArgs& args)
+{
+    const uint64_t nFrames = traj.getStepsGlobal().size();
+    const uint64_t delta = dumpStep(traj);
+
+    // Incremental: gaps reach back at most over the window of old frames read again,
+    // and stay the same from run to run, so that the saved sums line up
+    if (Incremental::get().isEnabled())
+    {
+        const uint64_t windowSteps = Incremental::get().getWindowSteps();
+        const auto [firstStep, lastStep] = args.getRange("steps", 0UL, windowSteps);
+        if (lastStep > windowSteps)
+            errorAll(Error::ARGUMENTERROR, "Gaps up to %llu steps exceed the incremental window of %llu steps",
+                     (unsigned long long)lastStep, (unsigned long long)windowSteps);
+        return {firstStep / delta, lastStep / delta};
+    }
+
+    const auto [firstStep, lastStep] = args.getRange("steps", 0UL, (nFrames - 1) * delta);
+    const uint64_t minGap = firstStep / delta;
+    const uint64_t maxGap = std::min(lastStep / delta, nFrames - 1);
+    if (minGap > maxGap)
+        errorAll(Error::ARGUMENTERROR, "No time gaps in range %llu-%llu", (unsigned long long)firstStep, (unsigned long long)lastStep);
+    return {minGap, maxGap};
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "trajectory.hpp"
+
+namespace MDPAT
+{
+/*
+ * Keyword arguments of an analysis command, e.g.,
+ *     msd types 1 2 steps 0-100 timestep 0.005 outfile msd.txt
+ * Every word up to the next recognized keyword is a value of the previous keyword.
+ */
+class AnalysisArgs
+{
+public:
+    AnalysisArgs(
+        const std::string& command,
+        const std::vector<std::string>& args,
+        const std::vector<std::string>& keywords);
+
+    bool has(const std::string&) const;
+    const std::vector<std::string>& get(const std::string&) const;
+    std::string getString(const std::string&, const std::string& defaultValue) const;
+    double getDouble(const std::string&, const double defaultValue) const;
+    uint64_t getUInt(const std::string&, const uint64_t defaultValue) const;
+    std::vector<int> getInts(const std::string&) const;
+    std::pair<uint64_t, uint64_t> getRange(const std::string&, const uint64_t, const uint64_t) const;
+private:
+    const std::vector<std::string>& getN(const std::string&, const size_t) const;
+private:
+    std::string m_command;
+    std::unordered_map<std::string, std::vector<std::string>> m_values;
+};
+
+// Indices within PROPS of each label, erroring if one is missing
+std::vector<int> findColumns(const Trajectory&, const std::vector<std::string>&);
+
+// Unwrapped coordinate columns to use for dynamics: `columns` if given, else xu yu zu
+std::vector<int> unwrappedColumns(const Trajectory&, const AnalysisArgs&);
+
+// Number of timesteps between consecutive frames
+uint64_t dumpStep(const Trajectory&);
+
+// First and last time gap in frames from `steps <min>-<max>` (in timesteps); all gaps by default
+std::pair<uint64_t, uint64_t> gapRange(const Trajectory&, const AnalysisArgs&);
+
+}
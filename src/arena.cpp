@@ -0,0 +1,33 @@
+#include "arena.hpp"
+
+namespace MDPAT
+{
+
+void* Arena::allocateBytes(const size_t bytes, const size_t align)
+{
+    const size_t start = (m_used + align - 1) / align * align;
+    if (start + bytes <= m_size)
+    {
+        m_used = start + bytes;
+        return m_block.get() + start;
+    }
+
+    // new[] aligns to the largest fundamental alignment, enough for any T here
+    m_overflow.emplace_back(new std::byte[bytes]);
+    m_overflowBytes += bytes + align;
+    return m_overflow.back().get();
+}
+
+void Arena::reset()
+{
+    if (!m_overflow.empty())
+    {
+        m_size += m_overflowBytes;
+        m_block.reset(new std::byte[m_size]);
+        m_overflow.clear();
+        m_overflowBytes = 0UL;
+    }
+    m_used = 0UL;
+}
+
+}
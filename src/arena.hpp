@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace MDPAT
+{
+/*
+ * Monotonic arena for per-frame temporaries (parse buffers, sort scratch).
+ * Allocation bumps a pointer and nothing is freed until `reset`, which readers
+ * call at the start of every frame. Requests that do not fit go to overflow
+ * blocks, and the next `reset` replaces everything with one block large enough
+ * for all of them, so once the first frames have sized it the arena no longer
+ * touches the heap.
+ */
+class Arena
+{
+public:
+    // Uninitialized storage for n objects of T; valid until the next `reset`
+    template <typename T>
+    T* allocate(const size_t n)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+        return static_cast<T*>(allocateBytes(n * sizeof(T), alignof(T)));
+    }
+
+    void reset();
+
+    size_t capacity() const
+    {
+        return m_size;
+    }
+private:
+    void* allocateBytes(const size_t bytes, const size_t align);
+private:
+    std::unique_ptr<std::byte[]> m_block;
+    size_t m_size = 0UL;
+    size_t m_used = 0UL;
+    std::vector<std::unique_ptr<std::byte[]>> m_overflow;
+    size_t m_overflowBytes = 0UL;
+};
+
+}
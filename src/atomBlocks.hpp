@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <mpi.h>
+
+#include "checkpoint.hpp"
+#include "error.hpp"
+#include "instrument.hpp"
+#include "trajectory.hpp"
+
+namespace MDPAT
+{
+    /*
+     * Calls kernel(data, nAtoms) on every block of atoms this rank analyzes, with
+     * each block laid out as ATOMS x PROPS x FRAMES. In memory, the trajectory is
+     * transposed once with the atom axis split among ranks in multiples of
+     * `granularity` (e.g., NN to keep chains whole) and this rank's atoms are one
+     * block. Out of core, atom blocks are dealt round-robin and the next one is
+     * read while the current one is computed; each round of blocks is a checkpoint
+     * round, which saves the accumulators the kernel adds to (see checkpoint.hpp).
+     * Kernel time is timed as ANALYSIS.
+     */
+    template <typename Kernel>
+    void forEachAtomBlock(Trajectory& traj, const uint64_t granularity, Kernel kernel, const Accumulators& accumulators = Accumulators())
+    {
+        if (traj.isRagged())
+            errorAll(Error::ARGUMENTERROR, "Command needs the same atoms in every frame; the trajectory is ragged");
+        const uint64_t nCols = traj.getColumnLabels().size();
+        const uint64_t nFrames = traj.getStepsGlobal().size();
+
+        if (traj.isOutOfCore())
+        {
+            int me = 0, nprocs = 1;
+            MPI_Comm_rank(MPI_COMM_WORLD, &me);
+            MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+            auto& cache = traj.getBlockCache();
+            if (cache.atomBlockRange(0).second % granularity != 0)
+                errorAll(Error::ARGUMENTERROR, "Out-of-core atom blocks must hold whole molecules; give NN before traj");
+
+            const uint64_t nBlocks = cache.numAtomBlocks();
+            const uint64_t nRounds = (nBlocks + nprocs - 1) / nprocs;
+            auto& checkpoint = Checkpoint::get();
+            for (uint64_t round = checkpoint.beginPass(nRounds, accumulators); round < nRounds; ++round)
+            {
+                const uint64_t b = round * nprocs + me;
+                if (b < nBlocks)
+                {
+                    cache.prefetchAtomBlock(b + nprocs);
+                    const auto block = cache.atomBlock(b);
+                    const uint64_t nAtoms = cache.atomBlockRange(b).second;
+
+                    ScopedTimer timer(Region::ANALYSIS);
+                    kernel(block->data(), nAtoms);
+                    Instrument::get().addElements(Region::ANALYSIS, block->size());
+                }
+                checkpoint.endRound(round + 1, accumulators);
+            }
+        }
+        else
+        {
+            traj.permuteDims({Trajectory::Axis::ATOMS, Trajectory::Axis::PROPS, Trajectory::Axis::FRAMES}, granularity);
+            const uint64_t nAtoms = traj.getAxisLengths()[0];
+
+            ScopedTimer timer(Region::ANALYSIS);
+            if (nAtoms > 0)
+                kernel(&traj[0], nAtoms);
+            Instrument::get().addElements(Region::ANALYSIS, nAtoms * nCols * nFrames);
+        }
+    }
+
+    /*
+     * Calls kernel(data, firstFrame, nFrames, atomStride, colStride) on every block
+     * of frames this rank analyzes, with frame f's value of column c for atom a at
+     * data[f * nAtoms * nCols + a * atomStride + c * colStride]. In memory, this is
+     * the rank's own frames as distributed by `Trajectory::read`, in the trajectory's
+     * frame order (FRAMES x ATOMS x PROPS, or FRAMES x PROPS x ATOMS when read as
+     * SoA), transposing back if an earlier analysis permuted the axes. Out of core,
+     * frame blocks are dealt round-robin with the next one prefetched.
+     */
+    template <typename Kernel>
+    void forEachFrameBlock(Trajectory& traj, Kernel kernel)
+    {
+        if (traj.isRagged())
+            errorAll(Error::ARGUMENTERROR, "Command needs the same atoms in every frame; the trajectory is ragged");
+        const uint64_t nCols = traj.getColumnLabels().size();
+        const uint64_t nAtoms = traj.getNumAtoms();
+
+        if (traj.isOutOfCore())
+        {
+            int me = 0, nprocs = 1;
+            MPI_Comm_rank(MPI_COMM_WORLD, &me);
+            MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+            auto& cache = traj.getBlockCache();
+            const uint64_t nBlocks = cache.numFrameBlocks();
+            for (uint64_t b = me; b < nBlocks; b += nprocs)
+            {
+                cache.prefetchFrameBlock(b + nprocs);
+                const auto block = cache.frameBlock(b);
+                const auto [firstFrame, nFrames] = cache.frameBlockRange(b);
+
+                ScopedTimer timer(Region::ANALYSIS);
+                kernel(block->data(), firstFrame, nFrames, nCols, 1UL);
+                Instrument::get().addElements(Region::ANALYSIS, block->size());
+            }
+        }
+        else
+        {
+            traj.permuteDims(traj.getFrameOrder());
+            const uint64_t nFrames = traj.getAxisLengths()[0];
+            const uint64_t atomStride = traj.isSoA() ? 1UL : nCols;
+            const uint64_t colStride = traj.isSoA() ? nAtoms : 1UL;
+
+            ScopedTimer timer(Region::ANALYSIS);
+            if (nFrames > 0)
+                kernel(&traj[0], traj.getFirstIndex(), nFrames, atomStride, colStride);
+            Instrument::get().addElements(Region::ANALYSIS, nFrames * nAtoms * nCols);
+        }
+    }
+
+    /*
+     * Calls kernel(rows, ids, nRows, frame) on every frame this rank analyzes, with
+     * the frame's rows (PROPS fastest) sorted by atom ID and `frame` the global
+     * frame index. Works on ragged trajectories, whose frames hold different atoms,
+     * and otherwise goes through `forEachFrameBlock`; SoA frames are copied to rows
+     * one at a time.
+     */
+    template <typename Kernel>
+    void forEachFrame(Trajectory& traj, Kernel kernel)
+    {
+        const uint64_t nCols = traj.getColumnLabels().size();
+        if (!traj.isRagged())
+        {
+            const uint64_t nAtoms = traj.getNumAtoms();
+            const uint64_t* ids = traj.getAtomIds().data();
+            std::vector<double> rows;
+            forEachFrameBlock(traj, [&](const double* data, const uint64_t firstFrame, const uint64_t nFrames,
+                                        const uint64_t atomStride, const uint64_t colStride) {
+                for (uint64_t f = 0; f < nFrames; ++f)
+                {
+                    const double* frame = data + f * nAtoms * nCols;
+                    if (colStride != 1UL)
+                    {
+                        rows.resize(nAtoms * nCols);
+#pragma omp parallel for schedule(static)
+                        for (uint64_t a = 0; a < nAtoms; ++a)
+                            for (uint64_t c = 0; c < nCols; ++c)
+                                rows[a * nCols + c] = frame[a * atomStride + c * colStride];
+                        frame = rows.data();
+                    }
+                    kernel(frame, ids, nAtoms, firstFrame + f);
+                }
+            });
+            return;
+        }
+
+        const auto& offsets = traj.getFrameOffsets();
+        const auto& ids = traj.getRowIds();
+        const double* data = offsets.back() > 0 ? &traj[0] : nullptr;
+        ScopedTimer timer(Region::ANALYSIS);
+        for (uint64_t f = 0; f + 1 < offsets.size(); ++f)
+            kernel(data + offsets[f] * nCols, ids.data() + offsets[f], offsets[f + 1] - offsets[f], traj.getFirstIndex() + f);
+        Instrument::get().addElements(Region::ANALYSIS, offsets.back() * nCols);
+    }
+
+    /*
+     * For ragged trajectories: calls kernel(offsets, frames, rows, firstAtom, nAtoms)
+     * once with this rank's share of the atoms (slots of `getAtomIds()` from
+     * firstAtom), each with the frames it is in. Atom a's samples are [offsets[a],
+     * offsets[a + 1]) of frames (global indices, ascending) and rows (PROPS fastest).
+     */
+    template <typename Kernel>
+    void forEachAtomSeries(Trajectory& traj, Kernel kernel)
+    {
+        std::vector<uint64_t> offsets, frames;
+        std::vector<double> rows;
+        const uint64_t firstAtom = traj.gatherAtomSeries(offsets, frames, rows);
+        const uint64_t nAtoms = offsets.size() - 1;
+
+        ScopedTimer timer(Region::ANALYSIS);
+        kernel(offsets.data(), frames.data(), rows.data(), firstAtom, nAtoms);
+        Instrument::get().addElements(Region::ANALYSIS, rows.size());
+    }
+
+    // NN, erroring if it is unset, does not divide the number of atoms, or chains were left split by unwrapping
+    inline uint64_t chainLength(const Trajectory& traj, const char* command)
+    {
+        const uint64_t length = traj.getAtomsPerMolecule();
+        if (length == 0)
+            errorAll(Error::ARGUMENTERROR, "Command %s requires NN to be set", command);
+        if (traj.getNumAtoms() % length != 0)
+            errorAll(Error::ARGUMENTERROR, "Number of atoms (%llu) is not a multiple of NN (%llu)",
+                     (unsigned long long)traj.getNumAtoms(), (unsigned long long)length);
+        if (!traj.chainsWhole(length))
+            errorAll(Error::ARGUMENTERROR, "Command %s needs whole chains; to unwrap with jumps, give NN before traj", command);
+        return length;
+    }
+}
@@ -0,0 +1,63 @@
+#include "atomIndex.hpp"
+
+#include <algorithm>
+
+namespace MDPAT
+{
+
+bool AtomIndex::build(const std::vector<uint64_t>& ids)
+{
+    clear();
+    m_ids = ids;
+    std::sort(m_ids.begin(), m_ids.end());
+    if (std::adjacent_find(m_ids.begin(), m_ids.end()) != m_ids.end())
+    {
+        clear();
+        return false;
+    }
+    if (m_ids.empty())
+        return true;
+
+    // Dense table if IDs fill at least a quarter of their range
+    const uint64_t n = m_ids.size();
+    m_minId = m_ids.front();
+    const uint64_t range = m_ids.back() - m_minId + 1;
+    if (range / 4 <= n)
+    {
+        m_dense.assign(range, npos);
+        for (uint64_t slot = 0; slot < n; ++slot)
+            m_dense[m_ids[slot] - m_minId] = slot;
+        return true;
+    }
+
+    // Otherwise a hash table at most half full
+    uint64_t capacity = 2;
+    m_shift = 63;
+    while (capacity < 2 * n)
+    {
+        capacity *= 2;
+        --m_shift;
+    }
+    m_mask = capacity - 1;
+    m_table.assign(capacity, Entry());
+    for (uint64_t slot = 0; slot < n; ++slot)
+    {
+        uint64_t pos = hash(m_ids[slot]);
+        while (m_table[pos].id != npos)
+            pos = (pos + 1) & m_mask;
+        m_table[pos] = {m_ids[slot], slot};
+    }
+    return true;
+}
+
+void AtomIndex::clear()
+{
+    m_ids.clear();
+    m_minId = 0UL;
+    std::vector<uint64_t>().swap(m_dense);
+    std::vector<Entry>().swap(m_table);
+    m_mask = 0UL;
+    m_shift = 64;
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace MDPAT
+{
+/*
+ * Maps atom IDs to slots along the ATOMS axis. Slots are the IDs in ascending
+ * order, so every rank that builds the index from the same set of IDs (in
+ * whatever order its dump lists them) gets the same slots. Compact IDs are
+ * looked up in a dense table; sparse IDs (deleted atoms, selections) in an
+ * open-addressing hash table with linear probing.
+ */
+class AtomIndex
+{
+public:
+    static constexpr uint64_t npos = UINT64_MAX;
+public:
+    // Builds the index; returns false (leaving it empty) if an ID occurs twice
+    bool build(const std::vector<uint64_t>& ids);
+    void clear();
+
+    uint64_t size() const
+    {
+        return m_ids.size();
+    }
+
+    // ID in a slot
+    uint64_t id(const uint64_t slot) const
+    {
+        return m_ids[slot];
+    }
+
+    // Slot of an ID, or npos if it is not indexed
+    uint64_t slot(const uint64_t id) const
+    {
+        if (!m_dense.empty())
+            return (id >= m_minId && id - m_minId < m_dense.size()) ? m_dense[id - m_minId] : npos;
+        if (m_table.empty())
+            return npos;
+        for (uint64_t pos = hash(id);; pos = (pos + 1) & m_mask)
+        {
+            const Entry& entry = m_table[pos];
+            if (entry.id == id)
+                return entry.slot;
+            if (entry.id == npos)
+                return npos;
+        }
+    }
+
+    const std::vector<uint64_t>& ids() const
+    {
+        return m_ids;
+    }
+private:
+    struct Entry
+    {
+        uint64_t id = npos;
+        uint64_t slot = npos;
+    };
+
+    // Fibonacci hashing onto the power-of-two table
+    uint64_t hash(const uint64_t id) const
+    {
+        return (id * 0x9E3779B97F4A7C15ULL) >> m_shift;
+    }
+private:
+    std::vector<uint64_t> m_ids;  // sorted, by slot
+    uint64_t m_minId = 0UL;
+    std::vector<uint64_t> m_dense;
+    std::vector<Entry> m_table;
+    uint64_t m_mask = 0UL;
+    int m_shift = 64;
+};
+
+}
@@ -0,0 +1,276 @@
+#include "blockCache.hpp"
+
+#include <algorithm>
+
+#include "error.hpp"
+#include "instrument.hpp"
+
+namespace MDPAT
+{
+BlockCache::BlockCache(
+    const std::filesystem::path& storePath,
+    const uint64_t dataOffset,
+    const uint64_t nframes,
+    const uint64_t natoms,
+    const uint64_t ncols,
+    const uint64_t atomsPerBlock,
+    const uint64_t framesPerBlock,
+    const uint64_t capacityBytes) :
+    m_storePath(storePath),
+    m_dataOffset(dataOffset),
+    m_nframes(nframes),
+    m_natoms(natoms),
+    m_ncols(ncols),
+    m_atomsPerBlock(std::max<uint64_t>(1UL, std::min(atomsPerBlock, natoms))),
+    m_framesPerBlock(std::max<uint64_t>(1UL, std::min(framesPerBlock, nframes))),
+    m_capacityBytes(capacityBytes)
+{
+    if (!std::filesystem::is_regular_file(m_storePath))
+        errorOne(Error::IOERROR, "Could not open trajectory store %s", m_storePath.c_str());
+}
+
+BlockCache::~BlockCache()
+{
+    for (auto& [key, future] : m_pending)
+        future.wait();
+}
+
+uint64_t BlockCache::numAtomBlocks() const
+{
+    return (m_natoms + m_atomsPerBlock - 1) / m_atomsPerBlock;
+}
+
+uint64_t BlockCache::numFrameBlocks() const
+{
+    return (m_nframes + m_framesPerBlock - 1) / m_framesPerBlock;
+}
+
+std::pair<uint64_t, uint64_t> BlockCache::atomBlockRange(const uint64_t idx) const
+{
+    const uint64_t first = idx * m_atomsPerBlock;
+    return {first, std::min(m_atomsPerBlock, m_natoms - first)};
+}
+
+std::pair<uint64_t, uint64_t> BlockCache::frameBlockRange(const uint64_t idx) const
+{
+    const uint64_t first = idx * m_framesPerBlock;
+    return {first, std::min(m_framesPerBlock, m_nframes - first)};
+}
+
+BlockCache::Block BlockCache::atomBlock(const uint64_t idx)
+{
+    return get(Kind::ATOMS, idx);
+}
+
+BlockCache::Block BlockCache::frameBlock(const uint64_t idx)
+{
+    return get(Kind::FRAMES, idx);
+}
+
+void BlockCache::prefetchAtomBlock(const uint64_t idx)
+{
+    if (idx < numAtomBlocks())
+        prefetch(Kind::ATOMS, idx);
+}
+
+void BlockCache::prefetchFrameBlock(const uint64_t idx)
+{
+    if (idx < numFrameBlocks())
+        prefetch(Kind::FRAMES, idx);
+}
+
+void BlockCache::setShifts(const std::vector<uint64_t>& firstFrames, const std::array<int, 3>& cols)
+{
+    m_shiftFrames = firstFrames;
+    m_shiftCols = cols;
+}
+
+uint64_t BlockCache::hits() const
+{
+    return m_hits;
+}
+
+uint64_t BlockCache::misses() const
+{
+    return m_misses;
+}
+
+BlockCache::Key BlockCache::makeKey(const Kind kind, const uint64_t idx)
+{
+    return (idx << 1) | static_cast<uint64_t>(kind);
+}
+
+BlockCache::Block BlockCache::get(const Kind kind, const uint64_t idx)
+{
+    const Key key = makeKey(kind, idx);
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end())
+    {
+        ++m_hits;
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+        return it->second.block;
+    }
+
+    ++m_misses;
+    ScopedTimer timer(Region::TEMPFILE_READ);
+    Block block;
+    auto pending = m_pending.find(key);
+    if (pending != m_pending.end())
+    {
+        block = pending->second.get();
+        m_pending.erase(pending);
+        m_pendingBytes -= blockBytes(kind, idx);
+    }
+    else
+    {
+        block = fetch(kind, idx);
+    }
+    if (!block)
+        errorOne(Error::IOERROR, "Error reading trajectory store %s", m_storePath.c_str());
+    Instrument::get().addBytes(Region::TEMPFILE_READ, block->size() * sizeof(double));
+    insert(key, block);
+    return block;
+}
+
+void BlockCache::prefetch(const Kind kind, const uint64_t idx)
+{
+    const Key key = makeKey(kind, idx);
+    if (m_entries.count(key) || m_pending.count(key))
+        return;
+
+    const uint64_t nbytes = blockBytes(kind, idx);
+    evict(nbytes);
+    m_pendingBytes += nbytes;
+    m_pending[key] = std::async(std::launch::async, [this, kind, idx]() { return fetch(kind, idx); });
+}
+
+void BlockCache::insert(const Key key, Block block)
+{
+    const uint64_t nbytes = block->size() * sizeof(double);
+    evict(nbytes);
+
+    m_lru.push_front(key);
+    m_entries[key] = {block, m_lru.begin()};
+    m_usedBytes += nbytes;
+}
+
+/*
+ Evicts least recently used blocks until `nbytes` more fit alongside the cached
+ blocks and those still being prefetched. Always keeps at least the block just
+ requested.
+*/
+void BlockCache::evict(const uint64_t nbytes)
+{
+    while (!m_lru.empty() && m_usedBytes + m_pendingBytes + nbytes > m_capacityBytes)
+    {
+        auto victim = m_entries.find(m_lru.back());
+        m_usedBytes -= victim->second.block->size() * sizeof(double);
+        m_entries.erase(victim);
+        m_lru.pop_back();
+    }
+}
+
+uint64_t BlockCache::blockBytes(const Kind kind, const uint64_t idx) const
+{
+    const uint64_t length = (kind == Kind::ATOMS) ? atomBlockRange(idx).second * m_nframes
+                                                  : frameBlockRange(idx).second * m_natoms;
+    return length * m_ncols * sizeof(double);
+}
+
+std::shared_ptr<std::vector<double>> BlockCache::fetch(const Kind kind, const uint64_t idx) const
+{
+    if (kind == Kind::ATOMS)
+        return fetchAtoms(idx);
+    return fetchFrames(idx);
+}
+
+/*
+ Reads one contiguous run of atoms per frame and transposes it to
+ ATOMS x PROPS x FRAMES. The fetch methods run on the prefetch thread, so they
+ only read immutable members, use their own stream, and are not instrumented
+ (the wait is timed in `get`). They return nullptr on a read error rather than
+ aborting off the main thread; `get` reports it.
+*/
+std::shared_ptr<std::vector<double>> BlockCache::fetchAtoms(const uint64_t idx) const
+{
+    const auto [firstAtom, natoms] = atomBlockRange(idx);
+    const uint64_t rowLength = natoms * m_ncols;
+    std::vector<double> row(rowLength);
+    auto block = std::make_shared<std::vector<double>>(rowLength * m_nframes);
+
+    std::ifstream instream(m_storePath, std::ios::binary);
+    const uint64_t numTables = m_shiftFrames.empty() ? 0UL : m_shiftFrames.size() - 1;
+    std::vector<double> shifts(numTables * 3 * natoms);
+    for (uint64_t table = 0; table < numTables; ++table)
+    {
+        if (m_shiftFrames[table] == m_shiftFrames[table + 1])
+            continue;
+        instream.seekg(shiftOffset(table, firstAtom));
+        instream.read(reinterpret_cast<char*>(&shifts[table * 3 * natoms]), 3 * natoms * sizeof(double));
+    }
+
+    uint64_t table = 0;
+    for (uint64_t frame = 0; frame < m_nframes; ++frame)
+    {
+        const uint64_t offset = m_dataOffset + (frame * m_natoms + firstAtom) * m_ncols * sizeof(double);
+        instream.seekg(offset);
+        instream.read(reinterpret_cast<char*>(row.data()), rowLength * sizeof(double));
+        while (table < numTables && frame >= m_shiftFrames[table + 1])
+            ++table;
+        if (table < numTables)
+            addShifts(row.data(), natoms, &shifts[table * 3 * natoms]);
+
+        for (uint64_t atom = 0; atom < natoms; ++atom)
+            for (uint64_t col = 0; col < m_ncols; ++col)
+                (*block)[(atom * m_ncols + col) * m_nframes + frame] = row[atom * m_ncols + col];
+    }
+    if (!instream.good())
+        return nullptr;
+
+    return block;
+}
+
+std::shared_ptr<std::vector<double>> BlockCache::fetchFrames(const uint64_t idx) const
+{
+    const auto [firstFrame, nframes] = frameBlockRange(idx);
+    const uint64_t frameLength = m_natoms * m_ncols;
+    auto block = std::make_shared<std::vector<double>>(nframes * frameLength);
+
+    std::ifstream instream(m_storePath, std::ios::binary);
+    instream.seekg(m_dataOffset + firstFrame * frameLength * sizeof(double));
+    instream.read(reinterpret_cast<char*>(block->data()), block->size() * sizeof(double));
+
+    std::vector<double> shifts;
+    for (uint64_t table = 0; table + 1 < m_shiftFrames.size(); ++table)
+    {
+        const uint64_t begin = std::max(firstFrame, m_shiftFrames[table]);
+        const uint64_t end = std::min(firstFrame + nframes, m_shiftFrames[table + 1]);
+        if (begin >= end)
+            continue;
+        shifts.resize(3 * m_natoms);
+        instream.seekg(shiftOffset(table, 0));
+        instream.read(reinterpret_cast<char*>(shifts.data()), shifts.size() * sizeof(double));
+        for (uint64_t frame = begin; frame < end; ++frame)
+            addShifts(block->data() + (frame - firstFrame) * frameLength, m_natoms, shifts.data());
+    }
+    if (!instream.good())
+        return nullptr;
+
+    return block;
+}
+
+uint64_t BlockCache::shiftOffset(const uint64_t table, const uint64_t firstAtom) const
+{
+    return m_dataOffset + (m_nframes * m_natoms * m_ncols + (table * m_natoms + firstAtom) * 3) * sizeof(double);
+}
+
+// Adds natoms x 3 shifts to the shifted columns of natoms stored rows
+void BlockCache::addShifts(double* rows, const uint64_t natoms, const double* shifts) const
+{
+    for (uint64_t atom = 0; atom < natoms; ++atom)
+        for (int d = 0; d < 3; ++d)
+            rows[atom * m_ncols + m_shiftCols[d]] += shifts[3 * atom + d];
+}
+
+}
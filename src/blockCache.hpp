@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace MDPAT
+{
+/*
+ * Read-only LRU cache of blocks of an on-disk trajectory store. The store holds
+ * a FRAMES x ATOMS x PROPS array of doubles starting at byte `dataOffset`.
+ *
+ * An atom block is every frame of a contiguous range of atoms, returned in
+ * ATOMS x PROPS x FRAMES order so that each time series is contiguous. A frame
+ * block is a contiguous range of frames, returned as stored. Blocks are shared
+ * pointers, so a block being used stays valid if it is evicted meanwhile.
+ * `prefetch*` starts an asynchronous read so that the next block's I/O overlaps
+ * with computation on the current one. Shifts stored after the frames (see
+ * `setShifts`) are added to the blocks as they are read.
+ */
+class BlockCache
+{
+public:
+    enum class Kind {ATOMS = 0, FRAMES = 1};
+    typedef std::shared_ptr<const std::vector<double>> Block;
+public:
+    BlockCache(
+        const std::filesystem::path& storePath,
+        const uint64_t dataOffset,
+        const uint64_t nframes,
+        const uint64_t natoms,
+        const uint64_t ncols,
+        const uint64_t atomsPerBlock,
+        const uint64_t framesPerBlock,
+        const uint64_t capacityBytes);
+    ~BlockCache();
+
+    uint64_t numAtomBlocks() const;
+    uint64_t numFrameBlocks() const;
+    // First atom (frame) and number of atoms (frames) in a block
+    std::pair<uint64_t, uint64_t> atomBlockRange(const uint64_t) const;
+    std::pair<uint64_t, uint64_t> frameBlockRange(const uint64_t) const;
+
+    Block atomBlock(const uint64_t);
+    Block frameBlock(const uint64_t);
+    void prefetchAtomBlock(const uint64_t);
+    void prefetchFrameBlock(const uint64_t);
+
+    // Before any block is read. Adds to columns `cols` of the frames in
+    // [firstFrames[s], firstFrames[s + 1]) the per-atom shifts of table s, which
+    // holds natoms x 3 doubles; the tables follow the frames in the store
+    void setShifts(const std::vector<uint64_t>& firstFrames, const std::array<int, 3>& cols);
+
+    uint64_t hits() const;
+    uint64_t misses() const;
+private:
+    typedef uint64_t Key;
+    struct Entry
+    {
+        Block block;
+        std::list<Key>::iterator lru;
+    };
+private:
+    static Key makeKey(const Kind kind, const uint64_t idx);
+    Block get(const Kind, const uint64_t);
+    void prefetch(const Kind, const uint64_t);
+    void insert(const Key, Block);
+    void evict(const uint64_t);
+    uint64_t blockBytes(const Kind, const uint64_t) const;
+    std::shared_ptr<std::vector<double>> fetch(const Kind, const uint64_t) const;
+    std::shared_ptr<std::vector<double>> fetchAtoms(const uint64_t) const;
+    std::shared_ptr<std::vector<double>> fetchFrames(const uint64_t) const;
+    uint64_t shiftOffset(const uint64_t table, const uint64_t firstAtom) const;
+    void addShifts(double* rows, const uint64_t natoms, const double* shifts) const;
+private:
+    std::filesystem::path m_storePath;
+    uint64_t m_dataOffset;
+    uint64_t m_nframes;
+    uint64_t m_natoms;
+    uint64_t m_ncols;
+    uint64_t m_atomsPerBlock;
+    uint64_t m_framesPerBlock;
+    uint64_t m_capacityBytes;
+    uint64_t m_usedBytes = 0UL;
+    uint64_t m_pendingBytes = 0UL;  // blocks being prefetched
+    std::vector<uint64_t> m_shiftFrames;  // first frame of each shift table, then nframes
+    std::array<int, 3> m_shiftCols = {-1, -1, -1};
+
+    std::list<Key> m_lru;  // most recently used at front
+    std::unordered_map<Key, Entry> m_entries;
+    std::unordered_map<Key, std::future<std::shared_ptr<std::vector<double>>>> m_pending;
+
+    uint64_t m_hits = 0UL;
+    uint64_t m_misses = 0UL;
+};
+
+}
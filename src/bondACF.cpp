@@ -0,0 +1,136 @@
+#include "bondACF.hpp"
+
+#include <cmath>
+#include <filesystem>
+
+#include <mpi.h>
+
+#include "analysisArgs.hpp"
+#include "atomBlocks.hpp"
+#include "error.hpp"
+#include "fft.hpp"
+#include "instrument.hpp"
+#include "output.hpp"
+#include "reduce.hpp"
+
+namespace MDPAT
+{
+    uint64_t bondACFBlock(
+        const double* data,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t nFrames,
+        const uint64_t chainLength,
+        const std::vector<int>& coordCols,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        double* p1,
+        double* p2)
+    {
+        [[maybe_unused]] const uint64_t numGaps = maxGap - minGap + 1;  // in omp clauses only
+        const uint64_t nChains = nAtoms / chainLength;
+        const uint64_t bondsPerChain = chainLength - 1;
+        const uint64_t atomStride = nCols * nFrames;
+        const int cx = coordCols[0], cy = coordCols[1], cz = coordCols[2];
+        const double sqrt2 = std::sqrt(2.0);
+
+#pragma omp parallel
+        {
+            Autocorrelation acf(nFrames);
+            // u_x, u_y, u_z, then the products xx, yy, zz, and sqrt(2) xy, xz, yz,
+            // whose autocorrelations sum to <(u(t0 + t) . u(t0))^2>
+            std::vector<double> u(9 * nFrames);
+            double* ux = u.data();
+            double* uy = ux + nFrames;
+            double* uz = uy + nFrames;
+            double* prod = uz + nFrames;
+
+#pragma omp for collapse(2) reduction(+ : p1[:numGaps], p2[:numGaps])
+            for (uint64_t chain = 0; chain < nChains; ++chain)
+            {
+                for (uint64_t bond = 0; bond < bondsPerChain; ++bond)
+                {
+                    const double* atom0 = data + (chain * chainLength + bond) * atomStride;
+                    const double* atom1 = atom0 + atomStride;
+
+#pragma omp simd
+                    for (uint64_t frame = 0; frame < nFrames; ++frame)
+                    {
+                        const double dx = atom1[cx * nFrames + frame] - atom0[cx * nFrames + frame];
+                        const double dy = atom1[cy * nFrames + frame] - atom0[cy * nFrames + frame];
+                        const double dz = atom1[cz * nFrames + frame] - atom0[cz * nFrames + frame];
+                        const double inv = 1.0 / std::sqrt(dx * dx + dy * dy + dz * dz);
+                        ux[frame] = dx * inv;
+                        uy[frame] = dy * inv;
+                        uz[frame] = dz * inv;
+                        prod[frame] = ux[frame] * ux[frame];
+                        prod[nFrames + frame] = uy[frame] * uy[frame];
+                        prod[2 * nFrames + frame] = uz[frame] * uz[frame];
+                        prod[3 * nFrames + frame] = sqrt2 * ux[frame] * uy[frame];
+                        prod[4 * nFrames + frame] = sqrt2 * ux[frame] * uz[frame];
+                        prod[5 * nFrames + frame] = sqrt2 * uy[frame] * uz[frame];
+                    }
+
+                    acf.accumulate(ux, uy, minGap, maxGap, p1);
+                    acf.accumulate(uz, nullptr, minGap, maxGap, p1);
+                    acf.accumulate(prod, prod + nFrames, minGap, maxGap, p2);
+                    acf.accumulate(prod + 2 * nFrames, prod + 3 * nFrames, minGap, maxGap, p2);
+                    acf.accumulate(prod + 4 * nFrames, prod + 5 * nFrames, minGap, maxGap, p2);
+                }
+            }
+        }
+        return nChains * bondsPerChain;
+    }
+
+    void bondAutocorrelation(Trajectory& traj, const std::vector<std::string>& words)
+    {
+        int me = 0;
+        MPI_Comm_rank(MPI_COMM_WORLD, &me);
+
+        const AnalysisArgs args("bondacf", words, {"steps", "timestep", "columns", "outfile"});
+        const auto coordCols = unwrappedColumns(traj, args);
+        if (coordCols.size() != 3)
+            errorAll(Error::ARGUMENTERROR, "Command bondacf needs three coordinate columns");
+        const double timestep = args.getDouble("timestep", 1.0);
+        const std::filesystem::path outfile = args.getString("outfile", "bondacf.txt");
+
+        const uint64_t nn = chainLength(traj, "bondacf");
+        if (nn < 2)
+            errorAll(Error::ARGUMENTERROR, "Command bondacf needs NN > 1");
+        const uint64_t nFrames = traj.getStepsGlobal().size();
+        const uint64_t nCols = traj.getColumnLabels().size();
+        const uint64_t delta = dumpStep(traj);
+        const auto gaps = gapRange(traj, args);
+        const uint64_t minGap = gaps.first, maxGap = gaps.second;
+        const uint64_t numGaps = maxGap - minGap + 1;
+
+        // P1 and P2 sums back to back so that they are reduced together
+        std::vector<double> corr(2 * numGaps, 0.0);
+        double* p1 = corr.data();
+        double* p2 = p1 + numGaps;
+        uint64_t nBonds = 0UL;
+
+        forEachAtomBlock(traj, nn, [&](const double* data, const uint64_t nAtoms) {
+            nBonds += bondACFBlock(data, nAtoms, nCols, nFrames, nn, coordCols, minGap, maxGap, p1, p2);
+        }, Accumulators().add(corr).add(nBonds));
+
+        Reduction(MPI_COMM_WORLD).add(corr).add(nBonds).wait();
+
+        if (me == 0)
+        {
+            ScopedTimer timer(Region::OUTPUT);
+            std::vector<double> columns(3 * numGaps);
+            for (uint64_t gap = minGap; gap <= maxGap; ++gap)
+            {
+                const uint64_t i = gap - minGap;
+                const double norm = 1.0 / (static_cast<double>(nBonds) * (nFrames - gap));
+                columns[i] = gap * delta * timestep;
+                columns[numGaps + i] = p1[i] * norm;
+                columns[2 * numGaps + i] = 1.5 * p2[i] * norm - 0.5;
+            }
+            if (writeColumns(columns, 3, outfile))
+                errorOne(Error::IOERROR, "Couldn't write to file %s", outfile.c_str());
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "trajectory.hpp"
+
+namespace MDPAT
+{
+    /*
+     * bondacf [steps <min>-<max>] [timestep <dt>] [columns <x> <y> <z>] [outfile <file>]
+     * Writes time, P1(t) = <u(t0 + t) . u(t0)>, and P2(t) = <3 (u(t0 + t) . u(t0))^2 - 1> / 2
+     * for the unit bond vectors u between atoms i and i + 1 of chains of NN atoms.
+     */
+    void bondAutocorrelation(
+        Trajectory&,
+        const std::vector<std::string>&
+    );
+
+    /*
+     * Accumulates the P1 and P2 correlation sums over the bonds of a block laid out
+     * as ATOMS x PROPS x FRAMES holding whole chains. Each bond's unit vectors are
+     * derived from the coordinates into per-thread buffers of one bond's time series,
+     * and correlated over all origins by FFT. Returns the number of bonds.
+     */
+    uint64_t bondACFBlock(
+        const double* data,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t nFrames,
+        const uint64_t chainLength,
+        const std::vector<int>& coordCols,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        double* p1,
+        double* p2);
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <string_view>
+
+#include "lineReader.hpp"
+
+namespace MDPAT
+{
+/*
+ * Simulation box of one frame, orthogonal or triclinic (LAMMPS convention: edge
+ * vectors a = (lx, 0, 0), b = (xy, ly, 0), c = (xz, yz, lz) from the corner lo).
+ */
+struct Box
+{
+    std::array<double, 3> lo = {0.0, 0.0, 0.0};
+    std::array<double, 3> hi = {0.0, 0.0, 0.0};
+    double xy = 0.0;
+    double xz = 0.0;
+    double yz = 0.0;
+    bool triclinic = false;
+
+    // Number of doubles in `pack`/`unpack`, for sending boxes with MPI
+    static constexpr int packedSize = 10;
+
+    double length(const int d) const
+    {
+        return hi[d] - lo[d];
+    }
+
+    double volume() const
+    {
+        return length(0) * length(1) * length(2);
+    }
+
+    // Distance between the two faces normal to (the reciprocal of) each edge
+    double width(const int d) const
+    {
+        const double lx = length(0), ly = length(1), lz = length(2);
+        if (!triclinic)
+            return length(d);
+        if (d == 0)
+            return volume() / std::sqrt(ly * ly * lz * lz + xy * xy * lz * lz + (xy * yz - ly * xz) * (xy * yz - ly * xz));
+        if (d == 1)
+            return volume() / (lx * std::sqrt(lz * lz + yz * yz));
+        return lz;
+    }
+
+    bool operator==(const Box& other) const
+    {
+        return lo == other.lo && hi == other.hi && xy == other.xy && xz == other.xz && yz == other.yz
+            && triclinic == other.triclinic;
+    }
+
+    bool operator!=(const Box& other) const
+    {
+        return !(*this == other);
+    }
+
+    void pack(double* out) const
+    {
+        std::copy(lo.begin(), lo.end(), out);
+        std::copy(hi.begin(), hi.end(), out + 3);
+        out[6] = xy;
+        out[7] = xz;
+        out[8] = yz;
+        out[9] = triclinic ? 1.0 : 0.0;
+    }
+
+    void unpack(const double* in)
+    {
+        std::copy(in, in + 3, lo.begin());
+        std::copy(in + 3, in + 6, hi.begin());
+        xy = in[6];
+        xz = in[7];
+        yz = in[8];
+        triclinic = in[9] != 0.0;
+    }
+
+    /*
+     * Parses the rest of a dump header line `ITEM: BOX BOUNDS [xy xz yz] pp pp pp`
+     * and reads the three lines of bounds after it. Triclinic dumps give the
+     * bounding box of the tilted cell plus the tilt factors, which are converted back.
+     */
+    static Box read(const std::string_view item, LineReader& lines)
+    {
+        Box box;
+        box.triclinic = item.find("xy") != std::string_view::npos;
+
+        std::array<double, 3> tilt = {0.0, 0.0, 0.0};
+        std::string_view line;
+        for (int d = 0; d < 3 && lines.next(line); ++d)
+        {
+            parseNumber(nextToken(line), box.lo[d]);
+            parseNumber(nextToken(line), box.hi[d]);
+            if (box.triclinic)
+                parseNumber(nextToken(line), tilt[d]);
+        }
+        if (box.triclinic)
+        {
+            box.xy = tilt[0];
+            box.xz = tilt[1];
+            box.yz = tilt[2];
+            box.lo[0] -= std::min({0.0, box.xy, box.xz, box.xy + box.xz});
+            box.hi[0] -= std::max({0.0, box.xy, box.xz, box.xy + box.xz});
+            box.lo[1] -= std::min(0.0, box.yz);
+            box.hi[1] -= std::max(0.0, box.yz);
+        }
+        return box;
+    }
+};
+
+/*
+ * Coordinate kernels of an orthogonal box. Analyses are templated on the
+ * geometry (see `withGeometry`), so the orthogonal hot path has no tilt terms or
+ * branches, and the small inline methods vectorize inside `omp simd` loops.
+ */
+class OrthoGeometry
+{
+public:
+    explicit OrthoGeometry(const Box& box) :
+        m_lo(box.lo),
+        m_length({box.length(0), box.length(1), box.length(2)}),
+        m_inverse({1.0 / box.length(0), 1.0 / box.length(1), 1.0 / box.length(2)})
+    {
+    }
+
+    void toFractional(const double x, const double y, const double z, double& sx, double& sy, double& sz) const
+    {
+        sx = (x - m_lo[0]) * m_inverse[0];
+        sy = (y - m_lo[1]) * m_inverse[1];
+        sz = (z - m_lo[2]) * m_inverse[2];
+    }
+
+    void fromFractional(const double sx, const double sy, const double sz, double& x, double& y, double& z) const
+    {
+        x = m_lo[0] + sx * m_length[0];
+        y = m_lo[1] + sy * m_length[1];
+        z = m_lo[2] + sz * m_length[2];
+    }
+
+    // Replaces a displacement by its nearest periodic image
+    void minimumImage(double& dx, double& dy, double& dz) const
+    {
+        dx -= m_length[0] * std::round(dx * m_inverse[0]);
+        dy -= m_length[1] * std::round(dy * m_inverse[1]);
+        dz -= m_length[2] * std::round(dz * m_inverse[2]);
+    }
+private:
+    std::array<double, 3> m_lo;
+    std::array<double, 3> m_length;
+    std::array<double, 3> m_inverse;
+};
+
+/*
+ * Coordinate kernels of a triclinic box, through fractional coordinates
+ * s = h^-1 (r - lo) with the upper-triangular cell matrix h.
+ */
+class TriclinicGeometry
+{
+public:
+    explicit TriclinicGeometry(const Box& box) :
+        m_lo(box.lo),
+        m_length({box.length(0), box.length(1), box.length(2)}),
+        m_inverse({1.0 / box.length(0), 1.0 / box.length(1), 1.0 / box.length(2)}),
+        m_xy(box.xy),
+        m_xz(box.xz),
+        m_yz(box.yz)
+    {
+    }
+
+    void toFractional(const double x, const double y, const double z, double& sx, double& sy, double& sz) const
+    {
+        sz = (z - m_lo[2]) * m_inverse[2];
+        sy = (y - m_lo[1] - m_yz * sz) * m_inverse[1];
+        sx = (x - m_lo[0] - m_xy * sy - m_xz * sz) * m_inverse[0];
+    }
+
+    void fromFractional(const double sx, const double sy, const double sz, double& x, double& y, double& z) const
+    {
+        x = m_lo[0] + sx * m_length[0] + sy * m_xy + sz * m_xz;
+        y = m_lo[1] + sy * m_length[1] + sz * m_yz;
+        z = m_lo[2] + sz * m_length[2];
+    }
+
+    // Nearest image in fractional space, as LAMMPS does
+    void minimumImage(double& dx, double& dy, double& dz) const
+    {
+        double sz = dz * m_inverse[2];
+        double sy = (dy - m_yz * sz) * m_inverse[1];
+        double sx = (dx - m_xy * sy - m_xz * sz) * m_inverse[0];
+        sx -= std::round(sx);
+        sy -= std::round(sy);
+        sz -= std::round(sz);
+        dx = sx * m_length[0] + sy * m_xy + sz * m_xz;
+        dy = sy * m_length[1] + sz * m_yz;
+        dz = sz * m_length[2];
+    }
+private:
+    std::array<double, 3> m_lo;
+    std::array<double, 3> m_length;
+    std::array<double, 3> m_inverse;
+    double m_xy;
+    double m_xz;
+    double m_yz;
+};
+
+template <typename Geometry>
+struct GeometryTag
+{
+    typedef Geometry type;
+};
+
+/*
+ * Calls f(GeometryTag<OrthoGeometry>) or f(GeometryTag<TriclinicGeometry>), so
+ * the geometry is chosen once per trajectory and the kernel is instantiated for it:
+ *     withGeometry(traj.isTriclinic(), [&](auto tag) {
+ *         using Geometry = typename decltype(tag)::type;
+ *         ...
+ *     });
+ */
+template <typename F>
+void withGeometry(const bool triclinic, F&& f)
+{
+    if (triclinic)
+        f(GeometryTag<TriclinicGeometry>());
+    else
+        f(GeometryTag<OrthoGeometry>());
+}
+
+}
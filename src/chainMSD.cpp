@@ -0,0 +1,124 @@
+#include "chainMSD.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+#include <mpi.h>
+
+#include "analysisArgs.hpp"
+#include "atomBlocks.hpp"
+#include "error.hpp"
+#include "instrument.hpp"
+#include "msd.hpp"
+#include "output.hpp"
+#include "reduce.hpp"
+
+namespace MDPAT
+{
+    uint64_t chainMSDBlock(
+        const double* data,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t nFrames,
+        const uint64_t chainLength,
+        const std::vector<int>& coordCols,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        double* g1,
+        double* g2,
+        double* g3)
+    {
+        [[maybe_unused]] const uint64_t numGaps = maxGap - minGap + 1;  // in omp clauses only
+        const uint64_t nChains = nAtoms / chainLength;
+        const uint64_t atomStride = nCols * nFrames;
+
+#pragma omp parallel
+        {
+            std::vector<double> com(nFrames);
+            std::vector<double> rel(nFrames);
+
+#pragma omp for reduction(+ : g1[:numGaps], g2[:numGaps], g3[:numGaps])
+            for (uint64_t chain = 0; chain < nChains; ++chain)
+            {
+                const double* chainData = data + chain * chainLength * atomStride;
+                for (const int col : coordCols)
+                {
+                    std::fill(com.begin(), com.end(), 0.0);
+                    for (uint64_t atom = 0; atom < chainLength; ++atom)
+                    {
+                        const double* series = chainData + atom * atomStride + col * nFrames;
+#pragma omp simd
+                        for (uint64_t frame = 0; frame < nFrames; ++frame)
+                            com[frame] += series[frame];
+                    }
+#pragma omp simd
+                    for (uint64_t frame = 0; frame < nFrames; ++frame)
+                        com[frame] /= chainLength;
+                    accumulateMSD(com.data(), nFrames, minGap, maxGap, g3);
+
+                    for (uint64_t atom = 0; atom < chainLength; ++atom)
+                    {
+                        const double* series = chainData + atom * atomStride + col * nFrames;
+                        accumulateMSD(series, nFrames, minGap, maxGap, g1);
+#pragma omp simd
+                        for (uint64_t frame = 0; frame < nFrames; ++frame)
+                            rel[frame] = series[frame] - com[frame];
+                        accumulateMSD(rel.data(), nFrames, minGap, maxGap, g2);
+                    }
+                }
+            }
+        }
+        return nChains;
+    }
+
+    void chainMSD(Trajectory& traj, const std::vector<std::string>& words)
+    {
+        int me = 0;
+        MPI_Comm_rank(MPI_COMM_WORLD, &me);
+
+        const AnalysisArgs args("chainmsd", words, {"steps", "timestep", "columns", "outfile"});
+        const auto coordCols = unwrappedColumns(traj, args);
+        const double timestep = args.getDouble("timestep", 1.0);
+        const std::filesystem::path outfile = args.getString("outfile", "chainmsd.txt");
+
+        const uint64_t nn = chainLength(traj, "chainmsd");
+        const uint64_t nFrames = traj.getStepsGlobal().size();
+        const uint64_t nCols = traj.getColumnLabels().size();
+        const uint64_t delta = dumpStep(traj);
+        const auto gaps = gapRange(traj, args);
+        const uint64_t minGap = gaps.first, maxGap = gaps.second;
+        const uint64_t numGaps = maxGap - minGap + 1;
+
+        // g1, g2, g3 back to back so that they are reduced together
+        std::vector<double> g(3 * numGaps, 0.0);
+        double* g1 = g.data();
+        double* g2 = g1 + numGaps;
+        double* g3 = g2 + numGaps;
+        uint64_t nChains = 0UL;
+
+        forEachAtomBlock(traj, nn, [&](const double* data, const uint64_t nAtoms) {
+            nChains += chainMSDBlock(data, nAtoms, nCols, nFrames, nn, coordCols, minGap, maxGap, g1, g2, g3);
+        }, Accumulators().add(g).add(nChains));
+
+        Reduction(MPI_COMM_WORLD).add(g).add(nChains).wait();
+
+        if (me == 0)
+        {
+            ScopedTimer timer(Region::OUTPUT);
+            const uint64_t nAtoms = nChains * nn;
+            std::vector<double> columns(4 * numGaps);
+            for (uint64_t gap = minGap; gap <= maxGap; ++gap)
+            {
+                const uint64_t i = gap - minGap;
+                const uint64_t nOrigins = nFrames - gap;
+                columns[i] = gap * delta * timestep;
+                columns[numGaps + i] = g1[i] / nAtoms / nOrigins;
+                columns[2 * numGaps + i] = g2[i] / nAtoms / nOrigins;
+                columns[3 * numGaps + i] = g3[i] / nChains / nOrigins;
+            }
+            if (writeColumns(columns, 4, outfile))
+                errorOne(Error::IOERROR, "Couldn't write to file %s", outfile.c_str());
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
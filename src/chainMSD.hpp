@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "trajectory.hpp"
+
+namespace MDPAT
+{
+    /*
+     * chainmsd [steps <min>-<max>] [timestep <dt>] [columns <x> <y> <z>] [outfile <file>]
+     * Writes time, g1 (monomer MSD), g2 (monomer MSD relative to its chain's
+     * center of mass), and g3 (center-of-mass MSD) for chains of NN atoms.
+     */
+    void chainMSD(
+        Trajectory&,
+        const std::vector<std::string>&
+    );
+
+    /*
+     * Accumulates g1, g2, and g3 over the chains of a block laid out as
+     * ATOMS x PROPS x FRAMES that starts at a chain boundary and holds whole
+     * chains. Centers of mass assume equal masses. Returns the number of chains.
+     */
+    uint64_t chainMSDBlock(
+        const double* data,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t nFrames,
+        const uint64_t chainLength,
+        const std::vector<int>& coordCols,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        double* g1,
+        double* g2,
+        double* g3);
+}
@@ -0,0 +1,236 @@
+#include "checkpoint.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include "error.hpp"
+#include "instrument.hpp"
+
+namespace MDPAT
+{
+
+uint64_t Accumulators::bytes() const
+{
+    uint64_t total = 0UL;
+    for (const auto& part : m_parts)
+        total += part.bytes;
+    return total;
+}
+
+void Accumulators::pack(std::vector<char>& buffer) const
+{
+    buffer.resize(bytes());
+    char* position = buffer.data();
+    for (const auto& part : m_parts)
+    {
+        std::memcpy(position, part.data, part.bytes);
+        position += part.bytes;
+    }
+}
+
+// False, changing nothing, if buffer does not hold exactly these accumulators
+bool Accumulators::unpack(const std::vector<char>& buffer) const
+{
+    if (buffer.size() != bytes())
+        return false;
+    const char* position = buffer.data();
+    for (const auto& part : m_parts)
+    {
+        std::memcpy(part.data, position, part.bytes);
+        position += part.bytes;
+    }
+    return true;
+}
+
+Checkpoint& Checkpoint::get()
+{
+    static Checkpoint instance;
+    return instance;
+}
+
+void Checkpoint::enable(const std::filesystem::path& path, const double interval)
+{
+    m_enabled = true;
+    m_path = path;
+    m_interval = interval;
+    m_lastSave = MPI_Wtime();
+}
+
+void Checkpoint::restart(const std::filesystem::path& path, const double interval)
+{
+    enable(path, interval);
+    load();
+    m_restarting = true;
+}
+
+bool Checkpoint::isEnabled() const
+{
+    return m_enabled;
+}
+
+bool Checkpoint::isRestarting() const
+{
+    return m_restarting;
+}
+
+void Checkpoint::setDeck(const uint64_t hash)
+{
+    m_deck = hash;
+}
+
+bool Checkpoint::beginStep(const uint64_t step)
+{
+    m_step = step;
+    m_pass = 0UL;
+    return m_restarting && step < m_loaded.completed;
+}
+
+/*
+ Collective. Records the step as finished, so that a restart skips it.
+*/
+void Checkpoint::endStep()
+{
+    if (!m_enabled)
+        return;
+    Header header;
+    header.completed = header.step = m_step + 1;
+    save(header, std::vector<char>());
+}
+
+uint64_t Checkpoint::beginPass(const uint64_t nRounds, const Accumulators& accumulators)
+{
+    ++m_pass;
+    if (!m_restarting)
+        return 0UL;
+    if (m_step < m_loaded.completed)
+        return nRounds;
+    if (m_loaded.step != m_step || m_loaded.pass != m_pass || m_loaded.rounds == 0)
+        return 0UL;
+    if (!accumulators.unpack(m_loadedSection))
+        errorOne(Error::IOERROR, "Checkpoint %s does not match the accumulators of this pass", m_path.c_str());
+    return std::min(m_loaded.rounds, nRounds);
+}
+
+/*
+ Rank 0's clock decides when a checkpoint is due, so that all ranks save together.
+*/
+void Checkpoint::endRound(const uint64_t roundsDone, const Accumulators& accumulators)
+{
+    if (!m_enabled)
+        return;
+    int me = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &me);
+    int due = (me == 0 && MPI_Wtime() - m_lastSave >= m_interval);
+    MPI_Bcast(&due, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!due)
+        return;
+
+    Header header;
+    header.completed = m_step;
+    header.step = m_step;
+    header.pass = m_pass;
+    header.rounds = roundsDone;
+    std::vector<char> section;
+    accumulators.pack(section);
+    save(header, section);
+}
+
+// FNV-1a
+uint64_t Checkpoint::hash(const std::string& text, uint64_t seed)
+{
+    for (const char c : text)
+    {
+        seed ^= static_cast<unsigned char>(c);
+        seed *= 1099511628211UL;
+    }
+    return seed;
+}
+
+std::string Checkpoint::mismatch(const Header& header, const int nprocs) const
+{
+    if (std::memcmp(header.magic, Header().magic, sizeof(header.magic)) != 0)
+        return "not a checkpoint file";
+    if (header.nprocs != nprocs)
+        return "written by " + std::to_string(header.nprocs) + " ranks; restart it with as many";
+    if (header.deck != m_deck)
+        return "written by a different input deck";
+    return std::string();
+}
+
+/*
+ Collective. Every rank writes its section at the offset given by the sizes of
+ those before it; rank 0 adds the header and the table of sizes.
+*/
+void Checkpoint::save(const Header& header, const std::vector<char>& section)
+{
+    ScopedTimer timer(Region::CHECKPOINT);
+    int me = 0, nprocs = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &me);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    if (section.size() > INT_MAX)
+        errorOne(Error::IOERROR, "Checkpoint section of %llu bytes is too large", (unsigned long long)section.size());
+
+    const uint64_t bytes = section.size();
+    std::vector<uint64_t> sizes(nprocs);
+    MPI_Allgather(&bytes, 1, MPI_UINT64_T, sizes.data(), 1, MPI_UINT64_T, MPI_COMM_WORLD);
+    uint64_t offset = sizeof(Header) + nprocs * sizeof(uint64_t);
+    for (int rank = 0; rank < me; ++rank)
+        offset += sizes[rank];
+
+    const std::filesystem::path tempPath = m_path.string() + ".tmp";
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, tempPath.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+        errorAll(Error::IOERROR, "Could not open checkpoint file %s", tempPath.c_str());
+    MPI_File_set_size(file, 0);
+    if (me == 0)
+    {
+        Header full = header;
+        full.nprocs = nprocs;
+        full.deck = m_deck;
+        MPI_File_write_at(file, 0, &full, sizeof(Header), MPI_BYTE, MPI_STATUS_IGNORE);
+        MPI_File_write_at(file, sizeof(Header), sizes.data(), nprocs, MPI_UINT64_T, MPI_STATUS_IGNORE);
+    }
+    MPI_File_write_at_all(file, offset, section.data(), bytes, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+
+    // Replace the previous checkpoint only once this one is complete
+    if (me == 0)
+    {
+        std::error_code error;
+        std::filesystem::rename(tempPath, m_path, error);
+        if (error)
+            errorOne(Error::IOERROR, "Could not write checkpoint file %s", m_path.c_str());
+        m_lastSave = MPI_Wtime();
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    Instrument::get().addBytes(Region::CHECKPOINT, bytes);
+}
+
+void Checkpoint::load()
+{
+    ScopedTimer timer(Region::CHECKPOINT);
+    int me = 0, nprocs = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &me);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, m_path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+        errorAll(Error::IOERROR, "Could not open checkpoint file %s", m_path.c_str());
+    MPI_File_read_at_all(file, 0, &m_loaded, sizeof(Header), MPI_BYTE, MPI_STATUS_IGNORE);
+    const std::string reason = mismatch(m_loaded, nprocs);
+    if (!reason.empty())
+        errorAll(Error::ARGUMENTERROR, "Cannot restart from %s: %s", m_path.c_str(), reason.c_str());
+
+    std::vector<uint64_t> sizes(nprocs);
+    MPI_File_read_at_all(file, sizeof(Header), sizes.data(), nprocs, MPI_UINT64_T, MPI_STATUS_IGNORE);
+    uint64_t offset = sizeof(Header) + nprocs * sizeof(uint64_t);
+    for (int rank = 0; rank < me; ++rank)
+        offset += sizes[rank];
+    m_loadedSection.resize(sizes[me]);
+    MPI_File_read_at_all(file, offset, m_loadedSection.data(), sizes[me], MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+    Instrument::get().addBytes(Region::CHECKPOINT, sizes[me]);
+}
+
+}
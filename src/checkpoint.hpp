@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <mpi.h>
+
+namespace MDPAT
+{
+/*
+ * Bytes of the accumulators a pass adds to round after round (sums, histograms,
+ * counts), registered in place so that a checkpoint can save them and a restart
+ * can put them back:
+ *     Accumulators().add(msd).add(nSelected)
+ */
+class Accumulators
+{
+public:
+    template <typename T>
+    Accumulators& add(std::vector<T>& values)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Accumulators are saved as raw bytes");
+        m_parts.push_back({reinterpret_cast<char*>(values.data()), values.size() * sizeof(T)});
+        return *this;
+    }
+
+    template <typename T>
+    Accumulators& add(T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Accumulators are saved as raw bytes");
+        m_parts.push_back({reinterpret_cast<char*>(&value), sizeof(T)});
+        return *this;
+    }
+
+    uint64_t bytes() const;
+    void pack(std::vector<char>&) const;
+    bool unpack(const std::vector<char>&) const;
+private:
+    struct Part
+    {
+        char* data;
+        uint64_t bytes;
+    };
+    std::vector<Part> m_parts;
+};
+
+/*
+ * Checkpoints of a run, so that a run stopped by a failure can be restarted
+ * where it left off (see `checkpoint` and `restart` in readInput.hpp). The run
+ * is a sequence of steps (`traj` and each analysis); a step that has finished is
+ * skipped on restart. Within a step, passes that go in rounds (reading frames
+ * out of core, analyzing out-of-core atom blocks) save the number of rounds done
+ * and every rank's accumulators once per interval, and resume from there.
+ *
+ * The file is a header, the byte count of every rank's section, then the
+ * sections, written collectively with MPI-IO to a temporary file that replaces
+ * the previous checkpoint only once complete.
+ */
+class Checkpoint
+{
+public:
+    struct Header
+    {
+        char magic[4] = {'M', 'D', 'C', 'K'};
+        int32_t nprocs = 0;
+        uint64_t deck = 0UL;
+        uint64_t completed = 0UL;  // steps finished
+        uint64_t step = 0UL;       // step and pass of the rounds below
+        uint64_t pass = 0UL;
+        uint64_t rounds = 0UL;     // rounds done
+    };
+public:
+    static Checkpoint& get();
+
+    // Collective. Save to path at most every `interval` seconds (0: every round)
+    void enable(const std::filesystem::path& path, const double interval);
+    // Collective. Load the checkpoint at path, then keep saving to it
+    void restart(const std::filesystem::path& path, const double interval);
+    bool isEnabled() const;
+    bool isRestarting() const;
+
+    // Hash of the steps of the input deck; a restart must run the same deck
+    void setDeck(const uint64_t hash);
+
+    // Steps, in order; true if the step finished before the checkpoint
+    bool beginStep(const uint64_t step);
+    void endStep();
+
+    // Collective. First round of a pass of nRounds: 0, all of them if its step
+    // finished, or those done at the checkpoint (restoring the accumulators)
+    uint64_t beginPass(const uint64_t nRounds, const Accumulators& = Accumulators());
+    // Collective. After each round, saves `roundsDone` and the accumulators when due
+    void endRound(const uint64_t roundsDone, const Accumulators& = Accumulators());
+
+    static uint64_t hash(const std::string&, uint64_t seed = 14695981039346656037UL);
+    // Why nprocs ranks running this deck cannot restart from a header; empty if they can
+    std::string mismatch(const Header&, const int nprocs) const;
+private:
+    Checkpoint() = default;
+    Checkpoint(const Checkpoint&) = delete;
+    Checkpoint& operator=(const Checkpoint&) = delete;
+
+    void save(const Header&, const std::vector<char>& section);
+    void load();
+private:
+    bool m_enabled = false;
+    bool m_restarting = false;
+    std::filesystem::path m_path;
+    double m_interval = 0.0;
+    double m_lastSave = 0.0;
+
+    uint64_t m_deck = 0UL;
+    uint64_t m_step = 0UL;
+    uint64_t m_pass = 0UL;
+
+    Header m_loaded;                 // checkpoint being restarted from
+    std::vector<char> m_loadedSection;  // my accumulators in it
+};
+
+}
@@ -0,0 +1,181 @@
+#include "chi4.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+
+#include <mpi.h>
+
+#include "analysisArgs.hpp"
+#include "atomBlocks.hpp"
+#include "error.hpp"
+#include "instrument.hpp"
+#include "msd.hpp"
+#include "output.hpp"
+#include "reduce.hpp"
+
+namespace MDPAT
+{
+    // Origins per tile; a tile's partial sums and displacements are 16 KiB
+    static constexpr uint64_t originTile = 1024UL;
+
+    // Gaps per reduction, bounding the per-origin partials of the two chunks in flight to 128 MiB
+    static constexpr uint64_t maxOverlapValues = 8UL * 1024UL * 1024UL;
+
+    uint64_t overlapBlock(
+        const double* data,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t nFrames,
+        const std::vector<int>& coordCols,
+        const int typeCol,
+        const std::vector<int>& types,
+        const double cutoff,
+        const uint64_t firstGap,
+        const uint64_t lastGap,
+        double* overlap)
+    {
+        const double cutoffSq = cutoff * cutoff;
+        const uint64_t numGaps = lastGap - firstGap + 1;
+        const uint64_t numTiles = (nFrames + originTile - 1) / originTile;
+
+        std::vector<char> selected(nAtoms);
+        uint64_t nSelected = 0UL;
+        for (uint64_t atom = 0; atom < nAtoms; ++atom)
+        {
+            selected[atom] = atomSelected(data + atom * nCols * nFrames, nFrames, typeCol, types);
+            nSelected += selected[atom];
+        }
+
+#pragma omp parallel
+        {
+            std::vector<double> rsq(originTile);
+
+            // Each (gap, tile) is owned by one thread, so no reduction is needed
+#pragma omp for collapse(2) schedule(dynamic)
+            for (uint64_t g = 0; g < numGaps; ++g)
+            {
+                for (uint64_t tile = 0; tile < numTiles; ++tile)
+                {
+                    const uint64_t gap = firstGap + g;
+                    const uint64_t first = tile * originTile;
+                    if (gap >= nFrames || first >= nFrames - gap)
+                        continue;
+                    const uint64_t n = std::min(originTile, nFrames - gap - first);
+                    double* q = overlap + g * nFrames + first;
+
+                    for (uint64_t atom = 0; atom < nAtoms; ++atom)
+                    {
+                        if (!selected[atom])
+                            continue;
+                        const double* atomData = data + atom * nCols * nFrames;
+                        std::fill(rsq.begin(), rsq.begin() + n, 0.0);
+                        for (const int col : coordCols)
+                        {
+                            const double* x0 = atomData + col * nFrames + first;
+                            const double* x1 = x0 + gap;
+#pragma omp simd
+                            for (uint64_t o = 0; o < n; ++o)
+                            {
+                                const double dx = x1[o] - x0[o];
+                                rsq[o] += dx * dx;
+                            }
+                        }
+#pragma omp simd
+                        for (uint64_t o = 0; o < n; ++o)
+                            q[o] += rsq[o] < cutoffSq ? 1.0 : 0.0;
+                    }
+                }
+            }
+        }
+        return nSelected;
+    }
+
+    void fourPointSusceptibility(Trajectory& traj, const std::vector<std::string>& words)
+    {
+        int me = 0;
+        MPI_Comm_rank(MPI_COMM_WORLD, &me);
+
+        const AnalysisArgs args("chi4", words, {"a", "types", "steps", "timestep", "columns", "outfile"});
+        const auto coordCols = unwrappedColumns(traj, args);
+        const auto types = args.getInts("types");
+        const int typeCol = types.empty() ? -1 : findColumns(traj, {"type"})[0];
+        const double cutoff = args.getDouble("a", 0.3);
+        const double timestep = args.getDouble("timestep", 1.0);
+        const std::filesystem::path outfile = args.getString("outfile", "chi4.txt");
+
+        const uint64_t nFrames = traj.getStepsGlobal().size();
+        const uint64_t nCols = traj.getColumnLabels().size();
+        const uint64_t delta = dumpStep(traj);
+        const auto gaps = gapRange(traj, args);
+        const uint64_t minGap = gaps.first, maxGap = gaps.second;
+        const uint64_t numGaps = maxGap - minGap + 1;
+
+        // time, <Q> / N, chi4
+        std::vector<double> columns(3 * numGaps, 0.0);
+        const uint64_t gapsPerChunk = std::max<uint64_t>(1UL, maxOverlapValues / nFrames);
+
+        // On rank 0, the columns of the chunk of gaps from firstGap once its sums are reduced
+        auto finishChunk = [&](const uint64_t firstGap, const std::vector<double>& overlap, const uint64_t nSelected) {
+            if (me != 0)
+                return;
+            if (nSelected == 0)
+                errorOne(Error::ARGUMENTERROR, "No atoms selected for command chi4");
+            const uint64_t lastGap = std::min(maxGap, firstGap + gapsPerChunk - 1);
+            for (uint64_t gap = firstGap; gap <= lastGap; ++gap)
+            {
+                const double* q = overlap.data() + (gap - firstGap) * nFrames;
+                const uint64_t nOrigins = nFrames - gap;
+                double sum = 0.0, sumSq = 0.0;
+                for (uint64_t origin = 0; origin < nOrigins; ++origin)
+                {
+                    sum += q[origin];
+                    sumSq += q[origin] * q[origin];
+                }
+                const double mean = sum / nOrigins;
+                const uint64_t i = gap - minGap;
+                columns[i] = gap * delta * timestep;
+                columns[numGaps + i] = mean / nSelected;
+                columns[2 * numGaps + i] = (sumSq / nOrigins - mean * mean) / nSelected;
+            }
+        };
+
+        // Q(t0, t) summed over all atoms is needed per origin, so gaps are done in
+        // chunks whose per-origin sums are reduced to rank 0. Chunks alternate
+        // between two buffers, so that one chunk is reduced while the next is computed
+        std::vector<double> overlap[2];
+        uint64_t nSelected[2] = {0UL, 0UL};
+        std::unique_ptr<Reduction> pending;
+        uint64_t pendingGap = 0UL, pendingBuffer = 0UL;
+        for (uint64_t firstGap = minGap, b = 0; firstGap <= maxGap; firstGap += gapsPerChunk, b = 1 - b)
+        {
+            const uint64_t lastGap = std::min(maxGap, firstGap + gapsPerChunk - 1);
+            overlap[b].assign((lastGap - firstGap + 1) * nFrames, 0.0);
+            nSelected[b] = 0UL;
+
+            forEachAtomBlock(traj, 1UL, [&](const double* data, const uint64_t nAtoms) {
+                nSelected[b] += overlapBlock(data, nAtoms, nCols, nFrames, coordCols, typeCol, types, cutoff, firstGap, lastGap, overlap[b].data());
+            }, Accumulators().add(overlap[b]).add(nSelected[b]));
+
+            if (pending)
+            {
+                pending->wait();
+                finishChunk(pendingGap, overlap[pendingBuffer], nSelected[pendingBuffer]);
+            }
+            pending = std::make_unique<Reduction>(MPI_COMM_WORLD);
+            pending->add(overlap[b]).add(nSelected[b]);
+            pendingGap = firstGap;
+            pendingBuffer = b;
+        }
+        pending->wait();
+        finishChunk(pendingGap, overlap[pendingBuffer], nSelected[pendingBuffer]);
+
+        if (me == 0)
+        {
+            ScopedTimer timer(Region::OUTPUT);
+            if (writeColumns(columns, 3, outfile))
+                errorOne(Error::IOERROR, "Couldn't write to file %s", outfile.c_str());
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "trajectory.hpp"
+
+namespace MDPAT
+{
+    /*
+     * chi4 [a <cutoff>] [types <t>...] [steps <min>-<max>] [timestep <dt>] [columns <x> <y> <z>] [outfile <file>]
+     * Writes time, the mean overlap <Q(t)> / N with Q(t0, t) = sum_i theta(a - |r_i(t0 + t) - r_i(t0)|),
+     * and the four-point susceptibility chi4(t) = (<Q^2> - <Q>^2) / N over time origins t0.
+     */
+    void fourPointSusceptibility(
+        Trajectory&,
+        const std::vector<std::string>&
+    );
+
+    /*
+     * Adds each selected atom's overlap to overlap[(gap - firstGap) * nFrames + origin]
+     * for gaps in [firstGap, lastGap], for a block laid out as ATOMS x PROPS x FRAMES.
+     * Origins are processed in tiles so that the partial sums of a tile stay in cache
+     * while the atoms stream through. Returns the number of selected atoms.
+     */
+    uint64_t overlapBlock(
+        const double* data,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t nFrames,
+        const std::vector<int>& coordCols,
+        const int typeCol,
+        const std::vector<int>& types,
+        const double cutoff,
+        const uint64_t firstGap,
+        const uint64_t lastGap,
+        double* overlap);
+}
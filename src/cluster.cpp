@@ -0,0 +1,134 @@
+#include "cluster.hpp"
+
+#include <filesystem>
+#include <memory>
+
+#include <mpi.h>
+
+#include "analysisArgs.hpp"
+#include "atomBlocks.hpp"
+#include "error.hpp"
+#include "instrument.hpp"
+#include "output.hpp"
+#include "reduce.hpp"
+
+namespace MDPAT
+{
+    void cluster(Trajectory& traj, const std::vector<std::string>& words)
+    {
+        int me = 0;
+        MPI_Comm_rank(MPI_COMM_WORLD, &me);
+
+        const AnalysisArgs args("cluster", words, {"cutoff", "types", "columns", "timestep", "outfile"});
+        if (!args.has("cutoff"))
+            errorAll(Error::ARGUMENTERROR, "Command cluster needs a cutoff");
+        const double cutoff = args.getDouble("cutoff", 0.0);
+
+        std::vector<int> coordCols;
+        if (args.has("columns"))
+            coordCols = findColumns(traj, args.get("columns"));
+        else if (traj.hasColumn("x") && traj.hasColumn("y") && traj.hasColumn("z"))
+            coordCols = findColumns(traj, {"x", "y", "z"});
+        else
+            coordCols = findColumns(traj, {"xu", "yu", "zu"});
+        if (coordCols.size() != 3)
+            errorAll(Error::ARGUMENTERROR, "Command cluster needs three coordinate columns");
+
+        const auto types = args.getInts("types");
+        const int typeCol = types.empty() ? -1 : findColumns(traj, {"type"})[0];
+        const double timestep = args.getDouble("timestep", 1.0);
+        const std::string outfile = args.getString("outfile", "cluster");
+
+        const auto& steps = traj.getStepsGlobal();
+        const uint64_t nFrames = steps.size();
+        const uint64_t nCols = traj.getColumnLabels().size();
+
+        std::unique_ptr<UnionFind> sets;
+        std::vector<double> positions;
+
+        // Number of clusters, largest, and weight-average size per frame, laid out as output columns
+        std::vector<double> perFrame(3 * nFrames, 0.0);
+        std::vector<double> hist;  // clusters of each size, summed over frames
+
+        withGeometry(traj.isTriclinic(), [&](auto tag) {
+            using Geometry = typename decltype(tag)::type;
+            // Rebuilt only when the box changes from one frame to the next (NPT)
+            std::unique_ptr<CellList<Geometry>> cells;
+            Box cellsBox;
+            forEachFrame(traj, [&](const double* frame, const uint64_t*, const uint64_t nRows, const uint64_t frameIdx) {
+                // Selected atoms' positions, compactly
+                positions.clear();
+                for (uint64_t atom = 0; atom < nRows; ++atom)
+                {
+                    const double* row = frame + atom * nCols;
+                    if (typeCol >= 0)
+                    {
+                        const int type = static_cast<int>(row[typeCol] + 0.5);
+                        if (types.end() == std::find(types.begin(), types.end(), type))
+                            continue;
+                    }
+                    for (const int col : coordCols)
+                        positions.push_back(row[col]);
+                }
+                const uint64_t nSelected = positions.size() / 3;
+                if (!sets || sets->size() != nSelected)
+                    sets = std::make_unique<UnionFind>(nSelected);
+
+                if (!cells || traj.getBox(frameIdx) != cellsBox)
+                {
+                    cellsBox = traj.getBox(frameIdx);
+                    cells = std::make_unique<CellList<Geometry>>(cellsBox, cutoff);
+                }
+                cells->build(positions.data(), nSelected);
+                const auto sizes = clusterSizes(*cells, *sets);
+
+                uint64_t largest = 0UL;
+                double sumSq = 0.0;
+                if (hist.size() < nSelected + 1)
+                    hist.resize(nSelected + 1, 0.0);
+                for (const uint64_t s : sizes)
+                {
+                    largest = std::max(largest, s);
+                    sumSq += static_cast<double>(s) * s;
+                    hist[s] += 1.0;
+                }
+                perFrame[frameIdx] = sizes.size();
+                perFrame[nFrames + frameIdx] = largest;
+                perFrame[2 * nFrames + frameIdx] = nSelected > 0 ? sumSq / nSelected : 0.0;
+            });
+        });
+
+        // Ranks may have seen different selections; size the histogram to the largest
+        Reduction reduction(MPI_COMM_WORLD);
+        reduction.add(perFrame);
+        uint64_t histSize = hist.size();
+        MPI_Allreduce(MPI_IN_PLACE, &histSize, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+        hist.resize(histSize, 0.0);
+        reduction.add(hist).wait();
+
+        if (me == 0)
+        {
+            ScopedTimer timer(Region::OUTPUT);
+            std::vector<double> frameColumns(nFrames);
+            for (uint64_t frame = 0; frame < nFrames; ++frame)
+                frameColumns[frame] = steps[frame] * timestep;
+            frameColumns.insert(frameColumns.end(), perFrame.begin(), perFrame.end());
+            if (writeColumns(frameColumns, 4, outfile + ".txt"))
+                errorOne(Error::IOERROR, "Couldn't write to file %s.txt", outfile.c_str());
+
+            // Sizes that occur, with the mean number of such clusters per frame
+            std::vector<double> sizeColumn, countColumn;
+            for (uint64_t s = 1; s < hist.size(); ++s)
+            {
+                if (hist[s] == 0.0)
+                    continue;
+                sizeColumn.push_back(s);
+                countColumn.push_back(hist[s] / nFrames);
+            }
+            sizeColumn.insert(sizeColumn.end(), countColumn.begin(), countColumn.end());
+            if (writeColumns(sizeColumn, 2, outfile + ".hist.txt"))
+                errorOne(Error::IOERROR, "Couldn't write to file %s.hist.txt", outfile.c_str());
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "box.hpp"
+#include "error.hpp"
+#include "trajectory.hpp"
+#include "unionFind.hpp"
+
+namespace MDPAT
+{
+    /*
+     * cluster cutoff <rc> [types <t>...] [columns <x> <y> <z>] [timestep <dt>] [outfile <base>]
+     * Atoms closer than rc (minimum image in the frame's periodic, possibly
+     * triclinic box) are in the same cluster. Writes
+     *     <base>.txt:      time, number of clusters, largest cluster, weight-average size per frame
+     *     <base>.hist.txt: size s, mean number of clusters of size s per frame
+     */
+    void cluster(
+        Trajectory&,
+        const std::vector<std::string>&
+    );
+
+    /*
+     * Cell list over a periodic box with cells at least `cutoff` wide, binned in
+     * fractional coordinates so that tilted boxes work the same way. Atoms are
+     * stored sorted by cell with their wrapped positions, so that the pair search
+     * streams through contiguous memory.
+     */
+    template <typename Geometry>
+    class CellList
+    {
+    public:
+        CellList(const Box& box, const double cutoff);
+        // Bins positions[3 * i + d] of n atoms
+        void build(const double* positions, const uint64_t n);
+        // Calls f(a, b) for every pair closer than the cutoff, threaded over cells
+        template <typename F>
+        void forEachPair(F f) const;
+        uint64_t size() const;
+    private:
+        // Distinct neighbor cells (including itself) of cell c along one axis; returns how many
+        int neighbors(const int axis, const uint64_t c, std::array<uint64_t, 3>& out) const;
+    private:
+        Geometry m_geometry;
+        std::array<uint64_t, 3> m_cells;
+        double m_cutoffSq;
+        std::vector<uint64_t> m_cellStart;  // CSR offsets, nCells + 1
+        std::vector<uint64_t> m_atoms;      // atom of each sorted slot
+        std::vector<double> m_sorted;       // wrapped positions by sorted slot
+    };
+
+    template <typename Geometry>
+    CellList<Geometry>::CellList(const Box& box, const double cutoff) :
+        m_geometry(box),
+        m_cutoffSq(cutoff * cutoff)
+    {
+        for (int d = 0; d < 3; ++d)
+        {
+            if (box.length(d) <= 0.0)
+                errorAll(Error::ARGUMENTERROR, "Box has no extent along axis %d", d);
+            m_cells[d] = std::max<uint64_t>(1UL, box.width(d) / cutoff);
+        }
+        m_cellStart.resize(m_cells[0] * m_cells[1] * m_cells[2] + 1);
+    }
+
+    template <typename Geometry>
+    int CellList<Geometry>::neighbors(const int axis, const uint64_t c, std::array<uint64_t, 3>& out) const
+    {
+        const uint64_t n = m_cells[axis];
+        if (n < 3)
+        {
+            for (uint64_t i = 0; i < n; ++i)
+                out[i] = i;
+            return n;
+        }
+        out = {(c + n - 1) % n, c, (c + 1) % n};
+        return 3;
+    }
+
+    template <typename Geometry>
+    uint64_t CellList<Geometry>::size() const
+    {
+        return m_atoms.size();
+    }
+
+    template <typename Geometry>
+    void CellList<Geometry>::build(const double* positions, const uint64_t n)
+    {
+        const uint64_t nCells = m_cellStart.size() - 1;
+        std::vector<uint64_t> cellOf(n);
+        std::vector<double> wrapped(3 * n);
+
+#pragma omp parallel for schedule(static)
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            const double* r = positions + 3 * i;
+            std::array<double, 3> s;
+            m_geometry.toFractional(r[0], r[1], r[2], s[0], s[1], s[2]);
+            uint64_t cell = 0;
+            for (int d = 0; d < 3; ++d)
+            {
+                s[d] -= std::floor(s[d]);
+                cell = cell * m_cells[d] + std::min<uint64_t>(s[d] * m_cells[d], m_cells[d] - 1);
+            }
+            m_geometry.fromFractional(s[0], s[1], s[2], wrapped[3 * i], wrapped[3 * i + 1], wrapped[3 * i + 2]);
+            cellOf[i] = cell;
+        }
+
+        // Counting sort by cell
+        std::fill(m_cellStart.begin(), m_cellStart.end(), 0UL);
+        for (uint64_t i = 0; i < n; ++i)
+            ++m_cellStart[cellOf[i] + 1];
+        for (uint64_t cell = 0; cell < nCells; ++cell)
+            m_cellStart[cell + 1] += m_cellStart[cell];
+
+        std::vector<uint64_t> next(m_cellStart.begin(), m_cellStart.end() - 1);
+        m_atoms.resize(n);
+        m_sorted.resize(3 * n);
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            const uint64_t slot = next[cellOf[i]]++;
+            m_atoms[slot] = i;
+            for (int d = 0; d < 3; ++d)
+                m_sorted[3 * slot + d] = wrapped[3 * i + d];
+        }
+    }
+
+    template <typename Geometry>
+    template <typename F>
+    void CellList<Geometry>::forEachPair(F f) const
+    {
+        const uint64_t nCells = m_cells[0] * m_cells[1] * m_cells[2];
+
+#pragma omp parallel for schedule(dynamic, 16)
+        for (uint64_t cell = 0; cell < nCells; ++cell)
+        {
+            const uint64_t cz = cell % m_cells[2];
+            const uint64_t cy = (cell / m_cells[2]) % m_cells[1];
+            const uint64_t cx = cell / (m_cells[2] * m_cells[1]);
+
+            std::array<uint64_t, 3> nx, ny, nz;
+            const int nnx = neighbors(0, cx, nx), nny = neighbors(1, cy, ny), nnz = neighbors(2, cz, nz);
+            for (int ix = 0; ix < nnx; ++ix)
+            for (int iy = 0; iy < nny; ++iy)
+            for (int iz = 0; iz < nnz; ++iz)
+            {
+                const uint64_t other = (nx[ix] * m_cells[1] + ny[iy]) * m_cells[2] + nz[iz];
+                for (uint64_t a = m_cellStart[cell]; a < m_cellStart[cell + 1]; ++a)
+                {
+                    const double* pa = &m_sorted[3 * a];
+                    // Each pair once: only partners in later slots
+                    for (uint64_t b = std::max(a + 1, m_cellStart[other]); b < m_cellStart[other + 1]; ++b)
+                    {
+                        const double* pb = &m_sorted[3 * b];
+                        double dx = pb[0] - pa[0], dy = pb[1] - pa[1], dz = pb[2] - pa[2];
+                        m_geometry.minimumImage(dx, dy, dz);
+                        if (dx * dx + dy * dy + dz * dz < m_cutoffSq)
+                            f(m_atoms[a], m_atoms[b]);
+                    }
+                }
+            }
+        }
+    }
+
+    // Cluster size of every cluster in one frame, after unions over all close pairs
+    template <typename Geometry>
+    std::vector<uint64_t> clusterSizes(const CellList<Geometry>& cells, UnionFind& sets)
+    {
+        const uint64_t n = cells.size();
+        sets.reset();
+        cells.forEachPair([&sets](const uint64_t a, const uint64_t b) { sets.unite(a, b); });
+
+        std::vector<uint64_t> count(n, 0UL);
+        for (uint64_t i = 0; i < n; ++i)
+            ++count[sets.find(i)];
+
+        std::vector<uint64_t> sizes;
+        for (const uint64_t c : count)
+            if (c > 0)
+                sizes.push_back(c);
+        return sizes;
+    }
+}
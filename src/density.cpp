@@ -0,0 +1,307 @@
+#include "density.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+
+#include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "analysisArgs.hpp"
+#include "atomBlocks.hpp"
+#include "error.hpp"
+#include "incremental.hpp"
+#include "instrument.hpp"
+#include "output.hpp"
+#include "reduce.hpp"
+#include "resultCache.hpp"
+#include "stridedView.hpp"
+
+namespace MDPAT
+{
+    template <typename Geometry>
+    void densityBlock(
+        const double* data,
+        const uint64_t nFrames,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t atomStride,
+        const uint64_t colStride,
+        const std::vector<int>& coordCols,
+        const int typeCol,
+        const std::vector<int>& types,
+        const Geometry& geometry,
+        const std::array<uint64_t, 3>& dims,
+        const double weight,
+        double* grid)
+    {
+        const uint64_t nCells = dims[0] * dims[1] * dims[2];
+        const uint64_t frameSize = nAtoms * nCols;
+        const int cx = coordCols[0], cy = coordCols[1], cz = coordCols[2];
+
+        // Integer counts stay exact; 64 bits cannot wrap, since a block has fewer than 2^64 atom-frames
+#ifdef _OPENMP
+        std::vector<std::vector<uint64_t>> privateGrids(omp_get_max_threads());
+#else
+        std::vector<std::vector<uint64_t>> privateGrids(1);
+#endif
+
+#pragma omp parallel
+        {
+#ifdef _OPENMP
+            const int tid = omp_get_thread_num();
+            const int nthreads = omp_get_num_threads();
+#else
+            const int tid = 0, nthreads = 1;
+#endif
+            auto& mine = privateGrids[tid];
+            mine.assign(nCells, 0UL);  // first touch by the owning thread
+
+#pragma omp for collapse(2) schedule(static)
+            for (uint64_t frame = 0; frame < nFrames; ++frame)
+            {
+                for (uint64_t a = 0; a < nAtoms; ++a)
+                {
+                    const StridedView2<const double> atoms(data + frame * frameSize, nAtoms, nCols, atomStride, colStride);
+                    if (typeCol >= 0)
+                    {
+                        const int type = static_cast<int>(atoms(a, typeCol) + 0.5);
+                        if (types.end() == std::find(types.begin(), types.end(), type))
+                            continue;
+                    }
+
+                    std::array<double, 3> s;
+                    geometry.toFractional(atoms(a, cx), atoms(a, cy), atoms(a, cz), s[0], s[1], s[2]);
+                    uint64_t cell = 0;
+                    for (int d = 0; d < 3; ++d)
+                    {
+                        uint64_t idx = 0;
+                        if (dims[d] > 1)
+                        {
+                            s[d] -= std::floor(s[d]);
+                            idx = std::min<uint64_t>(s[d] * dims[d], dims[d] - 1);
+                        }
+                        cell = cell * dims[d] + idx;
+                    }
+                    ++mine[cell];
+                }
+            }
+
+            // Pairwise tree merge: log2(nthreads) rounds, each pair merged by its lower thread
+            for (int stride = 1; stride < nthreads; stride *= 2)
+            {
+#pragma omp barrier
+                if (tid % (2 * stride) == 0 && tid + stride < nthreads)
+                {
+                    const uint64_t* other = privateGrids[tid + stride].data();
+                    uint64_t* target = mine.data();
+#pragma omp simd
+                    for (uint64_t cell = 0; cell < nCells; ++cell)
+                        target[cell] += other[cell];
+                    std::vector<uint64_t>().swap(privateGrids[tid + stride]);
+                }
+            }
+#pragma omp barrier
+
+            const uint64_t* merged = privateGrids[0].data();
+#pragma omp for simd schedule(static)
+            for (uint64_t cell = 0; cell < nCells; ++cell)
+                grid[cell] += weight * merged[cell];
+        }
+    }
+
+    template void densityBlock<OrthoGeometry>(
+        const double*, const uint64_t, const uint64_t, const uint64_t, const uint64_t, const uint64_t,
+        const std::vector<int>&, const int, const std::vector<int>&, const OrthoGeometry&, const std::array<uint64_t, 3>&, const double, double*);
+    template void densityBlock<TriclinicGeometry>(
+        const double*, const uint64_t, const uint64_t, const uint64_t, const uint64_t, const uint64_t,
+        const std::vector<int>&, const int, const std::vector<int>&, const TriclinicGeometry&, const std::array<uint64_t, 3>&, const double, double*);
+
+    // Box with the bounds and tilts averaged over all frames, to place the bins in the output
+    static Box meanBox(const Trajectory& traj)
+    {
+        const uint64_t nFrames = traj.getStepsGlobal().size();
+        Box mean = traj.getBox();
+        mean.lo = mean.hi = {0.0, 0.0, 0.0};
+        mean.xy = mean.xz = mean.yz = 0.0;
+        for (uint64_t frame = 0; frame < nFrames; ++frame)
+        {
+            const Box& box = traj.getBox(frame);
+            for (int d = 0; d < 3; ++d)
+            {
+                mean.lo[d] += box.lo[d] / nFrames;
+                mean.hi[d] += box.hi[d] / nFrames;
+            }
+            mean.xy += box.xy / nFrames;
+            mean.xz += box.xz / nFrames;
+            mean.yz += box.yz / nFrames;
+        }
+        return mean;
+    }
+
+    // Adds the bounds and tilts of the frames from firstFrame on to sums (lo, hi, xy, xz, yz)
+    static void addBoxes(const Trajectory& traj, const uint64_t firstFrame, std::vector<double>& sums)
+    {
+        for (uint64_t frame = firstFrame; frame < traj.getStepsGlobal().size(); ++frame)
+        {
+            const Box& box = traj.getBox(frame);
+            for (int d = 0; d < 3; ++d)
+            {
+                sums[d] += box.lo[d];
+                sums[3 + d] += box.hi[d];
+            }
+            sums[6] += box.xy;
+            sums[7] += box.xz;
+            sums[8] += box.yz;
+        }
+    }
+
+    void density(Trajectory& traj, const std::vector<std::string>& words)
+    {
+        int me = 0;
+        MPI_Comm_rank(MPI_COMM_WORLD, &me);
+
+        const AnalysisArgs args("density", words, {"slab", "grid", "types", "columns", "outfile"});
+        if (args.has("slab") == args.has("grid"))
+            errorAll(Error::ARGUMENTERROR, "Command density needs exactly one of slab or grid");
+
+        std::vector<int> coordCols;
+        if (args.has("columns"))
+            coordCols = findColumns(traj, args.get("columns"));
+        else if (traj.hasColumn("x") && traj.hasColumn("y") && traj.hasColumn("z"))
+            coordCols = findColumns(traj, {"x", "y", "z"});
+        else
+            coordCols = findColumns(traj, {"xu", "yu", "zu"});
+        if (coordCols.size() != 3)
+            errorAll(Error::ARGUMENTERROR, "Command density needs three coordinate columns");
+
+        const auto types = args.getInts("types");
+        const int typeCol = types.empty() ? -1 : findColumns(traj, {"type"})[0];
+
+        int slabAxis = -1;
+        std::array<uint64_t, 3> dims = {1, 1, 1};
+        if (args.has("slab"))
+        {
+            const auto& slab = args.get("slab");
+            if (slab.size() != 2 || slab[0].size() != 1 || slab[0][0] < 'x' || slab[0][0] > 'z')
+                errorAll(Error::SYNTAXERROR, "Syntax: density slab <x|y|z> <nbins>");
+            slabAxis = slab[0][0] - 'x';
+            dims[slabAxis] = std::stoull(slab[1]);
+        }
+        else
+        {
+            const auto& grid = args.get("grid");
+            if (grid.size() != 3)
+                errorAll(Error::SYNTAXERROR, "Syntax: density grid <nx> <ny> <nz>");
+            for (int d = 0; d < 3; ++d)
+                dims[d] = std::stoull(grid[d]);
+        }
+        if (dims[0] * dims[1] * dims[2] == 0)
+            errorAll(Error::ARGUMENTERROR, "Number of density bins must be positive");
+
+        const std::filesystem::path outfile = args.getString("outfile", slabAxis >= 0 ? "density.txt" : "density.bin");
+        const uint64_t nAtoms = traj.getNumAtoms();
+        const uint64_t nCols = traj.getColumnLabels().size();
+
+        // Incremental: only new frames are binned, into the previous run's sums. The box
+        // may change between runs, so every frame is weighted by its cell volume and the
+        // box is averaged from its summed bounds.
+        Incremental& incremental = Incremental::get();
+        const bool fixedBox = traj.hasFixedBox() && !incremental.isEnabled();
+        const uint64_t firstNew = incremental.getFirstNewFrame();
+        const uint64_t nFrames = incremental.getNumFrames(traj);
+
+        std::vector<double> grid(dims[0] * dims[1] * dims[2], 0.0);
+        std::vector<double> boxSums(incremental.isEnabled() ? 9 : 0, 0.0);
+        const Accumulators sums = Accumulators().add(grid).add(boxSums);
+        incremental.resume(sums);
+        if (incremental.isEnabled())
+            addBoxes(traj, firstNew, boxSums);
+        withGeometry(traj.isTriclinic(), [&](auto tag) {
+            using Geometry = typename decltype(tag)::type;
+            if (traj.isRagged())
+            {
+                // Frames hold different atoms; bin them one at a time
+                forEachFrame(traj, [&](const double* rows, const uint64_t*, const uint64_t nRows, const uint64_t frame) {
+                    if (frame < firstNew)
+                        return;
+                    const Box& frameBox = traj.getBox(frame);
+                    densityBlock(
+                        rows, 1, nRows, nCols, nCols, 1UL, coordCols, typeCol, types,
+                        Geometry(frameBox), dims, fixedBox ? 1.0 : grid.size() / frameBox.volume(), grid.data());
+                });
+                return;
+            }
+            forEachFrameBlock(traj, [&](const double* data, const uint64_t firstFrame, const uint64_t nBlockFrames,
+                                        const uint64_t atomStride, const uint64_t colStride) {
+                // Each run of frames with the same box is binned in that box and, if boxes
+                // differ, weighted by its cell volume (else counts stay exact until the end)
+                uint64_t run = firstFrame < firstNew ? std::min(firstNew - firstFrame, nBlockFrames) : 0UL;
+                while (run < nBlockFrames)
+                {
+                    const Box& runBox = traj.getBox(firstFrame + run);
+                    uint64_t end = run + 1;
+                    while (end < nBlockFrames && traj.getBox(firstFrame + end) == runBox)
+                        ++end;
+                    densityBlock(
+                        data + run * nAtoms * nCols, end - run, nAtoms, nCols, atomStride, colStride, coordCols, typeCol, types,
+                        Geometry(runBox), dims, fixedBox ? 1.0 : grid.size() / runBox.volume(), grid.data());
+                    run = end;
+                }
+            });
+        });
+        reduceToRoot(grid, MPI_COMM_WORLD);
+        incremental.keep(sums);
+
+        if (me == 0)
+        {
+            ScopedTimer timer(Region::OUTPUT);
+            Box box = fixedBox ? traj.getBox() : meanBox(traj);
+            if (incremental.isEnabled())
+            {
+                for (int d = 0; d < 3; ++d)
+                {
+                    box.lo[d] = boxSums[d] / nFrames;
+                    box.hi[d] = boxSums[3 + d] / nFrames;
+                }
+                box.xy = boxSums[6] / nFrames;
+                box.xz = boxSums[7] / nFrames;
+                box.yz = boxSums[8] / nFrames;
+            }
+            const double cellVolume = fixedBox ? box.volume() / grid.size() : 1.0;
+            for (auto& value : grid)
+                value /= nFrames * cellVolume;
+
+            if (slabAxis >= 0)
+            {
+                const uint64_t nBins = grid.size();
+                const double lo = box.lo[slabAxis];
+                const double width = box.length(slabAxis) / nBins;
+                std::vector<double> columns(2 * nBins);
+                for (uint64_t bin = 0; bin < nBins; ++bin)
+                {
+                    columns[bin] = lo + (bin + 0.5) * width;
+                    columns[nBins + bin] = grid[bin];
+                }
+                if (writeColumns(columns, 2, outfile))
+                    errorOne(Error::IOERROR, "Couldn't write to file %s", outfile.c_str());
+            }
+            else
+            {
+                const std::array<double, 6> bounds = {box.lo[0], box.hi[0], box.lo[1], box.hi[1], box.lo[2], box.hi[2]};
+                std::ofstream outstream(outfile, std::ios::binary);
+                outstream.write(reinterpret_cast<const char*>(dims.data()), dims.size() * sizeof(uint64_t));
+                outstream.write(reinterpret_cast<const char*>(bounds.data()), bounds.size() * sizeof(double));
+                outstream.write(reinterpret_cast<const char*>(grid.data()), grid.size() * sizeof(double));
+                if (!outstream.good())
+                    errorOne(Error::IOERROR, "Couldn't write to file %s", outfile.c_str());
+                ResultCache::get().addOutput(outfile);
+                Instrument::get().addBytes(Region::OUTPUT, grid.size() * sizeof(double));
+            }
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
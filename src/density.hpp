@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "box.hpp"
+#include "trajectory.hpp"
+
+namespace MDPAT
+{
+    /*
+     * density (slab <x|y|z> <nbins> | grid <nx> <ny> <nz>) [types <t>...] [columns <x> <y> <z>] [outfile <file>]
+     * Number density averaged over frames, binned in each frame's own box with
+     * positions wrapped periodically, so bins follow the box under NPT; bins of a
+     * triclinic box run along its edges (fractional coordinates). A slab profile is written as text
+     * (position, density); a grid is written as raw binary (see readInput.hpp).
+     */
+    void density(
+        Trajectory&,
+        const std::vector<std::string>&
+    );
+
+    /*
+     * Adds the number of selected atoms in each cell over the frames of a block,
+     * times weight, to grid (nx x ny x nz, z fastest); column c of atom a in frame
+     * f is data[f * nAtoms * nCols + a * atomStride + c * colStride]. All frames of the block share the box of geometry. Every
+     * thread bins into a private grid, and the private grids are merged pairwise
+     * in a tree before being added to grid. Geometry is OrthoGeometry or
+     * TriclinicGeometry (see box.hpp).
+     */
+    template <typename Geometry>
+    void densityBlock(
+        const double* data,
+        const uint64_t nFrames,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t atomStride,
+        const uint64_t colStride,
+        const std::vector<int>& coordCols,
+        const int typeCol,
+        const std::vector<int>& types,
+        const Geometry& geometry,
+        const std::array<uint64_t, 3>& dims,
+        const double weight,
+        double* grid);
+}
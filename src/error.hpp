@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdio>
 #include <iostream>
 
 #include <mpi.h>
@@ -8,20 +9,22 @@ namespace MDPAT
 {
     enum class Error {NONE, IOERROR, SYNTAXERROR, ARGUMENTERROR};
 
-    template<typename... Args>
-    void errorAll(const Error error, const char message[], Args... args)
-    {
-        if (me == 0)
-            errorOne(error, message, args...);
-        MPI_Barrier(MPI_COMM_WORLD);
-    }
-    
     template<typename... Args>
     void errorOne(const Error error, const char message[], Args... args)
     {
         char output[1024];
         snprintf(output, 1023, message, args...);
         std::cerr << output << '\n';
-        MPI_Abort(MPI_COMM_WORLD, code);
+        MPI_Abort(MPI_COMM_WORLD, static_cast<int>(error));
+    }
+
+    template<typename... Args>
+    void errorAll(const Error error, const char message[], Args... args)
+    {
+        int me = 0;
+        MPI_Comm_rank(MPI_COMM_WORLD, &me);
+        if (me == 0)
+            errorOne(error, message, args...);
+        MPI_Barrier(MPI_COMM_WORLD);
     }
 }
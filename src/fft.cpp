@@ -0,0 +1,166 @@
+#include "fft.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace MDPAT
+{
+uint64_t nextPowerOfTwo(const uint64_t n)
+{
+    uint64_t m = 1UL;
+    while (m < n)
+        m <<= 1;
+    return m;
+}
+
+void fft(std::complex<double>* data, const uint64_t n, const bool inverse)
+{
+    // Bit-reversal permutation
+    for (uint64_t i = 1, j = 0; i < n; ++i)
+    {
+        uint64_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(data[i], data[j]);
+    }
+
+    const double sign = inverse ? 1.0 : -1.0;
+    for (uint64_t len = 2; len <= n; len <<= 1)
+    {
+        const double angle = sign * 2.0 * M_PI / len;
+        const std::complex<double> wlen(std::cos(angle), std::sin(angle));
+        for (uint64_t i = 0; i < n; i += len)
+        {
+            std::complex<double> w(1.0, 0.0);
+            for (uint64_t j = 0; j < len / 2; ++j)
+            {
+                const std::complex<double> u = data[i + j];
+                const std::complex<double> v = data[i + j + len / 2] * w;
+                data[i + j] = u + v;
+                data[i + j + len / 2] = u - v;
+                w *= wlen;
+            }
+        }
+    }
+}
+
+DFT::DFT(const uint64_t n) :
+    m_n(n),
+    m_m(nextPowerOfTwo(n) == n ? 0UL : nextPowerOfTwo(2 * n - 1))
+{
+    if (m_m == 0)
+    {
+        m_work.resize(n);
+        return;
+    }
+
+    // j^2 mod 2n keeps the chirp phase accurate for large j
+    m_chirp.resize(n);
+    for (uint64_t j = 0; j < n; ++j)
+    {
+        const double angle = -M_PI * static_cast<double>((j * j) % (2 * n)) / n;
+        m_chirp[j] = std::complex<double>(std::cos(angle), std::sin(angle));
+    }
+
+    m_kernelFT.assign(m_m, 0.0);
+    m_kernelFT[0] = std::conj(m_chirp[0]);
+    for (uint64_t j = 1; j < n; ++j)
+        m_kernelFT[j] = m_kernelFT[m_m - j] = std::conj(m_chirp[j]);
+    fft(m_kernelFT.data(), m_m, false);
+
+    m_work.resize(m_m);
+}
+
+void DFT::forward(const std::complex<double>* in, std::complex<double>* out)
+{
+    if (m_m == 0)
+    {
+        std::copy(in, in + m_n, out);
+        fft(out, m_n, false);
+        return;
+    }
+
+    std::fill(m_work.begin(), m_work.end(), 0.0);
+    for (uint64_t j = 0; j < m_n; ++j)
+        m_work[j] = in[j] * m_chirp[j];
+    fft(m_work.data(), m_m, false);
+    for (uint64_t j = 0; j < m_m; ++j)
+        m_work[j] *= m_kernelFT[j];
+    fft(m_work.data(), m_m, true);
+    for (uint64_t k = 0; k < m_n; ++k)
+        out[k] = m_work[k] * m_chirp[k] / static_cast<double>(m_m);
+}
+
+uint64_t DFT::size() const
+{
+    return m_n;
+}
+
+Autocorrelation::Autocorrelation(const uint64_t n) :
+    m_n(n),
+    m_m(nextPowerOfTwo(2 * n - 1)),
+    m_work(m_m)
+{
+}
+
+void Autocorrelation::accumulate(
+    const double* a,
+    const double* b,
+    const uint64_t minGap,
+    const uint64_t maxGap,
+    double* corr)
+{
+    for (uint64_t j = 0; j < m_n; ++j)
+        m_work[j] = std::complex<double>(a[j], b ? b[j] : 0.0);
+    std::fill(m_work.begin() + m_n, m_work.end(), 0.0);
+
+    // The real part of the inverse of |F|^2 is the sum of both autocorrelations
+    fft(m_work.data(), m_m, false);
+    for (auto& value : m_work)
+        value = std::norm(value);
+    fft(m_work.data(), m_m, true);
+
+    for (uint64_t gap = minGap; gap <= maxGap && gap < m_n; ++gap)
+        corr[gap - minGap] += m_work[gap].real() / m_m;
+}
+
+uint64_t Autocorrelation::size() const
+{
+    return m_n;
+}
+
+DCT::DCT(const uint64_t n) :
+    m_n(n),
+    m_dft(n),
+    m_shift(n),
+    m_in(n),
+    m_out(n)
+{
+    for (uint64_t p = 0; p < n; ++p)
+    {
+        const double angle = -M_PI * p / (2.0 * n);
+        m_shift[p] = std::complex<double>(std::cos(angle), std::sin(angle));
+    }
+}
+
+void DCT::forward(const double* in, double* out)
+{
+    // Even elements in order, then odd elements reversed
+    for (uint64_t j = 0; 2 * j < m_n; ++j)
+        m_in[j] = in[2 * j];
+    for (uint64_t j = 0; 2 * j + 1 < m_n; ++j)
+        m_in[m_n - 1 - j] = in[2 * j + 1];
+
+    m_dft.forward(m_in.data(), m_out.data());
+    for (uint64_t p = 0; p < m_n; ++p)
+        out[p] = (m_out[p] * m_shift[p]).real();
+}
+
+uint64_t DCT::size() const
+{
+    return m_n;
+}
+
+}
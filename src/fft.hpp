@@ -0,0 +1,72 @@
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+namespace MDPAT
+{
+// In-place radix-2 FFT; n must be a power of two. The inverse is unnormalized.
+void fft(std::complex<double>* data, const uint64_t n, const bool inverse);
+
+// Smallest power of two >= n
+uint64_t nextPowerOfTwo(const uint64_t n);
+
+/*
+ * Discrete Fourier transform of a fixed length n, any n: radix-2 directly when n
+ * is a power of two, else Bluestein's chirp-z algorithm on a power-of-two
+ * length >= 2n - 1. Twiddles and workspace are set up once, so reuse one plan
+ * per thread over many transforms.
+ */
+class DFT
+{
+public:
+    explicit DFT(const uint64_t n);
+    // out[k] = sum_j in[j] exp(-2 pi i j k / n)
+    void forward(const std::complex<double>* in, std::complex<double>* out);
+    uint64_t size() const;
+private:
+    uint64_t m_n;
+    uint64_t m_m;  // Bluestein convolution length; 0 if n is a power of two
+    std::vector<std::complex<double>> m_chirp;     // exp(-i pi j^2 / n)
+    std::vector<std::complex<double>> m_kernelFT;  // FFT of the conjugate chirp, wrapped
+    std::vector<std::complex<double>> m_work;
+};
+
+/*
+ * Time autocorrelation of series of a fixed length n over all origins in
+ * O(n log n): zero-padded to a power of two >= 2n - 1, transformed, squared, and
+ * transformed back. Two real series are packed into one complex transform.
+ */
+class Autocorrelation
+{
+public:
+    explicit Autocorrelation(const uint64_t n);
+    // corr[gap - minGap] += sum_t0 a[t0 + gap] a[t0] + b[t0 + gap] b[t0]; b may be nullptr
+    void accumulate(const double* a, const double* b, const uint64_t minGap, const uint64_t maxGap, double* corr);
+    uint64_t size() const;
+private:
+    uint64_t m_n;
+    uint64_t m_m;
+    std::vector<std::complex<double>> m_work;
+};
+
+/*
+ * DCT-II of a fixed length n, out[p] = sum_j in[j] cos(pi p (j + 1/2) / n), in
+ * O(n log n) as one length-n DFT of the even/odd reordered input (Makhoul).
+ */
+class DCT
+{
+public:
+    explicit DCT(const uint64_t n);
+    void forward(const double* in, double* out);
+    uint64_t size() const;
+private:
+    uint64_t m_n;
+    DFT m_dft;
+    std::vector<std::complex<double>> m_shift;  // exp(-i pi p / 2n)
+    std::vector<std::complex<double>> m_in;
+    std::vector<std::complex<double>> m_out;
+};
+
+}
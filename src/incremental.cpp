@@ -0,0 +1,202 @@
+#include "incremental.hpp"
+
+#include <cstring>
+#include <fstream>
+
+#include "bcastContainers.hpp"
+#include "error.hpp"
+#include "instrument.hpp"
+
+namespace MDPAT
+{
+
+Incremental& Incremental::get()
+{
+    static Incremental instance;
+    return instance;
+}
+
+void Incremental::enable(const std::filesystem::path& path, const uint64_t windowSteps)
+{
+    MPI_Comm_rank(MPI_COMM_WORLD, &m_me);
+    m_enabled = true;
+    m_path = path;
+    m_windowSteps = windowSteps;
+    m_trajectory = m_framesDone = 0UL;
+    m_frameIndex.clear();
+    m_occurrences.clear();
+    m_loaded.clear();
+    m_kept.clear();
+    m_keptOrder.clear();
+    load();
+}
+
+bool Incremental::isEnabled() const
+{
+    return m_enabled;
+}
+
+uint64_t Incremental::getWindowSteps() const
+{
+    return m_windowSteps;
+}
+
+void Incremental::setTrajectory(const uint64_t key)
+{
+    if (m_framesDone > 0 && key != m_trajectory)
+        errorAll(Error::ARGUMENTERROR, "State %s was written for a different trajectory; remove it to start over", m_path.c_str());
+    m_trajectory = key;
+}
+
+uint64_t Incremental::getFramesDone() const
+{
+    return m_framesDone;
+}
+
+std::vector<uint64_t>& Incremental::getFrameIndex()
+{
+    return m_frameIndex;
+}
+
+void Incremental::setFrames(const uint64_t firstFrame, const uint64_t numFrames)
+{
+    m_firstFrame = firstFrame;
+    m_numFrames = numFrames;
+}
+
+uint64_t Incremental::getFirstNewFrame() const
+{
+    return m_enabled ? m_framesDone - m_firstFrame : 0UL;
+}
+
+uint64_t Incremental::getNumFrames(const Trajectory& traj) const
+{
+    return m_enabled ? m_numFrames : traj.getStepsGlobal().size();
+}
+
+/*
+ A command that was not in the previous run would need every frame, not only the
+ new ones, so it cannot join an incremental analysis halfway.
+*/
+void Incremental::beginCommand(const std::vector<std::string>& words)
+{
+    uint64_t key = Checkpoint::hash("");
+    for (const auto& word : words)
+        key = Checkpoint::hash(word + '\n', key);
+    key = Checkpoint::hash(std::to_string(m_occurrences[key]++), key);
+    m_command = key;
+
+    int found = (m_me == 0 && m_loaded.count(key) > 0);
+    MPI_Bcast(&found, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (m_framesDone > 0 && !found)
+        errorAll(Error::ARGUMENTERROR, "Command `%s` is not in state %s; remove it to start over", words[0].c_str(), m_path.c_str());
+}
+
+void Incremental::resume(const Accumulators& accumulators) const
+{
+    if (!m_enabled || m_me != 0 || m_framesDone == 0)
+        return;
+    if (!accumulators.unpack(m_loaded.at(m_command)))
+        errorOne(Error::IOERROR, "State %s does not match the sums of this command", m_path.c_str());
+}
+
+void Incremental::keep(const Accumulators& accumulators)
+{
+    if (!m_enabled || m_me != 0)
+        return;
+    if (m_kept.count(m_command) == 0)
+        m_keptOrder.push_back(m_command);
+    accumulators.pack(m_kept[m_command]);
+}
+
+void Incremental::save()
+{
+    if (!m_enabled)
+        return;
+    ScopedTimer timer(Region::CHECKPOINT);
+    if (m_me == 0)
+    {
+        Header header;
+        header.trajectory = m_trajectory;
+        header.windowSteps = m_windowSteps;
+        header.framesDone = m_numFrames;
+        header.numOffsets = m_frameIndex.size();
+        header.numSections = m_keptOrder.size();
+
+        const std::filesystem::path tempPath = m_path.string() + ".tmp";
+        std::ofstream outstream(tempPath, std::ios::binary);
+        outstream.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        outstream.write(reinterpret_cast<const char*>(m_frameIndex.data()), m_frameIndex.size() * sizeof(uint64_t));
+        uint64_t bytes = sizeof(Header) + m_frameIndex.size() * sizeof(uint64_t);
+        for (const uint64_t key : m_keptOrder)
+        {
+            const auto& section = m_kept.at(key);
+            const uint64_t size = section.size();
+            outstream.write(reinterpret_cast<const char*>(&key), sizeof(uint64_t));
+            outstream.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
+            outstream.write(section.data(), size);
+            bytes += 2 * sizeof(uint64_t) + size;
+        }
+        outstream.close();
+        if (!outstream.good())
+            errorOne(Error::IOERROR, "Could not write state file %s", tempPath.c_str());
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, m_path, error);
+        if (error)
+            errorOne(Error::IOERROR, "Could not write state file %s", m_path.c_str());
+        Instrument::get().addBytes(Region::CHECKPOINT, bytes);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/*
+ Collective. Without a state file, every frame is new.
+*/
+void Incremental::load()
+{
+    ScopedTimer timer(Region::CHECKPOINT);
+    Header header;
+    int status = 0;  // 0: no state, 1: loaded, 2: not a state file, 3: other window
+    if (m_me == 0 && std::filesystem::is_regular_file(m_path))
+    {
+        std::ifstream instream(m_path, std::ios::binary);
+        instream.read(reinterpret_cast<char*>(&header), sizeof(Header));
+        status = 1;
+        if (!instream.good() || std::memcmp(header.magic, Header().magic, sizeof(header.magic)) != 0 || header.version != Header().version)
+            status = 2;
+        else if (header.windowSteps != m_windowSteps)
+            status = 3;
+        else
+        {
+            m_frameIndex.resize(header.numOffsets);
+            instream.read(reinterpret_cast<char*>(m_frameIndex.data()), header.numOffsets * sizeof(uint64_t));
+            for (uint64_t i = 0; i < header.numSections && instream.good(); ++i)
+            {
+                uint64_t key = 0UL, size = 0UL;
+                instream.read(reinterpret_cast<char*>(&key), sizeof(uint64_t));
+                instream.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
+                auto& section = m_loaded[key];
+                section.resize(size);
+                instream.read(section.data(), size);
+            }
+            if (!instream.good())
+                status = 2;
+        }
+        Instrument::get().addBytes(Region::CHECKPOINT, instream.tellg());
+    }
+    MPI_Bcast(&status, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (status == 2)
+        errorAll(Error::IOERROR, "%s is not a state file", m_path.c_str());
+    if (status == 3)
+        errorAll(Error::ARGUMENTERROR, "State %s was written with a window of %llu steps", m_path.c_str(), (unsigned long long)header.windowSteps);
+    if (status == 0)
+        return;
+
+    MPI_Bcast(&header, sizeof(Header), MPI_BYTE, 0, MPI_COMM_WORLD);
+    m_trajectory = header.trajectory;
+    m_framesDone = header.framesDone;
+    bcast(m_frameIndex, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+}
+
+}
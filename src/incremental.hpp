@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <mpi.h>
+
+#include "checkpoint.hpp"
+#include "trajectory.hpp"
+
+namespace MDPAT
+{
+/*
+ * Incremental analysis of a trajectory that is still growing (see `incremental`
+ * in readInput.hpp). A state file keeps, from one run to the next, the number of
+ * frames analyzed so far, the byte offset of each frame in a single dump file,
+ * and the reduced sums of every command that supports it. A run reads the new
+ * frames plus a window of old ones before them; an analysis starts rank 0's sums
+ * from the saved ones (`resume`), adds only the contributions that involve a new
+ * frame (those at or after `getFirstNewFrame`), and hands the reduced sums back
+ * (`keep`) to be saved at the end of the run.
+ *
+ * The file is a header, the frame offsets, then each command's key, byte count
+ * and sums. Only rank 0 reads and writes it; it replaces the previous state only
+ * once complete.
+ */
+class Incremental
+{
+public:
+    static Incremental& get();
+
+    // Collective. Keep state in path, loading it if it exists; forgets any state held before
+    void enable(const std::filesystem::path& path, const uint64_t windowSteps);
+    bool isEnabled() const;
+    uint64_t getWindowSteps() const;
+
+    // Collective. Hash of the dump file (or pattern), its first step and increment
+    void setTrajectory(const uint64_t key);
+    // Frames analyzed by previous runs, and the offset of each in a single dump file
+    uint64_t getFramesDone() const;
+    std::vector<uint64_t>& getFrameIndex();
+    // Frames read by this run: global index of the first, and the number of frames in all
+    void setFrames(const uint64_t firstFrame, const uint64_t numFrames);
+    // Index, among the frames of the trajectory, of the first one not analyzed before
+    uint64_t getFirstNewFrame() const;
+    // Frames of the whole trajectory, counting those analyzed by previous runs
+    uint64_t getNumFrames(const Trajectory&) const;
+
+    // Collective. Each command, in order; its sums in the state are keyed on its words
+    void beginCommand(const std::vector<std::string>& words);
+    // Rank 0 starts from the sums of the previous run; others and the first run from zero
+    void resume(const Accumulators&) const;
+    // Rank 0. The reduced sums, to save for the next run
+    void keep(const Accumulators&);
+
+    // Collective. After the last command
+    void save();
+private:
+    Incremental() = default;
+    Incremental(const Incremental&) = delete;
+    Incremental& operator=(const Incremental&) = delete;
+
+    struct Header
+    {
+        char magic[4] = {'M', 'D', 'I', 'N'};
+        int32_t version = 1;
+        uint64_t trajectory = 0UL;
+        uint64_t windowSteps = 0UL;
+        uint64_t framesDone = 0UL;
+        uint64_t numOffsets = 0UL;
+        uint64_t numSections = 0UL;
+    };
+
+    void load();
+private:
+    bool m_enabled = false;
+    int m_me = 0;
+    std::filesystem::path m_path;
+    uint64_t m_windowSteps = 0UL;
+
+    uint64_t m_trajectory = 0UL;
+    uint64_t m_framesDone = 0UL;
+    std::vector<uint64_t> m_frameIndex;
+    uint64_t m_firstFrame = 0UL;
+    uint64_t m_numFrames = 0UL;
+
+    uint64_t m_command = 0UL;  // key of the current command
+    std::unordered_map<uint64_t, uint64_t> m_occurrences;  // of each command's words so far
+    std::unordered_map<uint64_t, std::vector<char>> m_loaded;  // rank 0: sums of the previous run
+    std::unordered_map<uint64_t, std::vector<char>> m_kept;    // rank 0: sums of this run
+    std::vector<uint64_t> m_keptOrder;
+};
+
+}
@@ -13,12 +13,10 @@ namespace MDPAT
         MPI_Comm_rank(MPI_COMM_WORLD, &me);
         MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
 
-        int local_rank = 0, local_size = 1;
-        MPI_Comm MPI_COMM_SHARE;
-        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &MPI_COMM_SHARE);
-        MPI_Comm_rank(MPI_COMM_SHARE, &local_rank);
-        MPI_Comm_size(MPI_COMM_SHARE, &local_size);
-        int nnodes = nprocs / local_size;
+#ifdef _OPENACC
+        const auto& topology = nodeTopology();
+        const int local_rank = topology.localRank;
+        const int nnodes = topology.numNodes;
 
         // Set rank-gpu affinity
         int ngpus = acc_get_num_devices(acc_device_nvidia);
@@ -32,8 +30,9 @@ namespace MDPAT
         MPI_Barrier(MPI_COMM_WORLD);
         MPI_Bcast(&ngpus, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
-        int gpunum = (me / local_size) * ngpus + local_rank % ngpus;
+        int gpunum = topology.node * ngpus + local_rank % ngpus;
         acc_set_device_num(gpunum, acc_device_nvidia);
         std::cout << "# me: " << me << ", gpunum: " << gpunum << "\n";
+#endif
     }
 }
\ No newline at end of file
@@ -3,7 +3,11 @@
 #include <iostream>
 
 #include <mpi.h>
+#ifdef _OPENACC
 #include <openacc.h>
+#endif
+
+#include "topology.hpp"
 
 namespace MDPAT
 {
@@ -0,0 +1,206 @@
+#include "instrument.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "error.hpp"
+
+#ifdef DEBUG
+static std::atomic<uint64_t> s_heapAllocations(0UL);
+
+// Counts every allocation; new[], nothrow new and the default deletes go through these
+void* operator new(std::size_t size)
+{
+    s_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+namespace MDPAT
+{
+uint64_t heapAllocations()
+{
+#ifdef DEBUG
+    return s_heapAllocations.load(std::memory_order_relaxed);
+#else
+    return 0UL;
+#endif
+}
+
+Instrument::Instrument() : m_origin(Clock::now()) {}
+
+Instrument& Instrument::get()
+{
+    static Instrument instance;
+    return instance;
+}
+
+const char* Instrument::regionName(const Region region)
+{
+    switch (region)
+    {
+    case Region::TOTAL:          return "total";
+    case Region::READ:           return "read";
+    case Region::SKIP_HEADER:    return "skip_header";
+    case Region::TRANSPOSE:      return "transpose";
+    case Region::TEMPFILE_WRITE: return "tempfile_write";
+    case Region::TEMPFILE_READ:  return "tempfile_read";
+    case Region::ANALYSIS:       return "analysis";
+    case Region::REDUCTION:      return "reduction";
+    case Region::OUTPUT:         return "output";
+    case Region::CHECKPOINT:     return "checkpoint";
+    default:                     return "unknown";
+    }
+}
+
+void Instrument::addTime(
+    const Region region,
+    const Clock::time_point& start,
+    const Clock::time_point& end)
+{
+    const auto idx = static_cast<size_t>(region);
+    m_seconds[idx] += std::chrono::duration<double>(end - start).count();
+    ++m_calls[idx];
+
+    if (m_traceEnabled)
+    {
+        TraceEvent event;
+        event.region = region;
+        event.start = std::chrono::duration_cast<std::chrono::microseconds>(start - m_origin).count();
+        event.duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        m_trace.push_back(event);
+    }
+}
+
+void Instrument::addBytes(const Region region, const uint64_t nbytes)
+{
+    m_bytes[static_cast<size_t>(region)] += nbytes;
+}
+
+void Instrument::addElements(const Region region, const uint64_t nelements)
+{
+    m_elements[static_cast<size_t>(region)] += nelements;
+}
+
+void Instrument::addAllocations(const Region region, const uint64_t nallocations)
+{
+    m_allocations[static_cast<size_t>(region)] += nallocations;
+}
+
+void Instrument::enableTrace(const std::filesystem::path& prefix)
+{
+    m_traceEnabled = true;
+    m_tracePrefix = prefix;
+}
+
+/*
+ Writes one Chrome trace file (chrome://tracing, Perfetto) per rank, named
+ <prefix>.<rank>.json, with one complete ("X") event per timed scope.
+*/
+void Instrument::writeTrace() const
+{
+    if (!m_traceEnabled)
+        return;
+
+    int me = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &me);
+
+    std::filesystem::path tracefile = m_tracePrefix;
+    tracefile += "." + std::to_string(me) + ".json";
+    std::ofstream out(tracefile);
+    if (!out.good())
+        errorOne(Error::IOERROR, "Couldn't open trace file %s for writing", tracefile.c_str());
+
+    out << "{\"traceEvents\":[\n";
+    for (size_t i = 0; i < m_trace.size(); ++i)
+    {
+        const auto& event = m_trace[i];
+        out << "{\"name\":\"" << regionName(event.region)
+            << "\",\"ph\":\"X\",\"ts\":" << event.start
+            << ",\"dur\":" << event.duration
+            << ",\"pid\":" << me << ",\"tid\":0}";
+        out << (i + 1 < m_trace.size() ? ",\n" : "\n");
+    }
+    out << "],\"displayTimeUnit\":\"ms\"}\n";
+    out.close();
+}
+
+/*
+ Collective over comm. Reduces every region's time to min/avg/max across ranks
+ and sums the counters, then prints the table from rank 0.
+*/
+void Instrument::printSummary(MPI_Comm comm) const
+{
+    int me = 0, nprocs = 1;
+    MPI_Comm_rank(comm, &me);
+    MPI_Comm_size(comm, &nprocs);
+
+    std::array<double, nRegions> tmin, tmax, tsum;
+    std::array<uint64_t, nRegions> calls, bytes, elements, allocations;
+    MPI_Reduce(m_seconds.data(), tmin.data(), nRegions, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(m_seconds.data(), tmax.data(), nRegions, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(m_seconds.data(), tsum.data(), nRegions, MPI_DOUBLE, MPI_SUM, 0, comm);
+    MPI_Reduce(m_calls.data(), calls.data(), nRegions, MPI_UINT64_T, MPI_SUM, 0, comm);
+    MPI_Reduce(m_bytes.data(), bytes.data(), nRegions, MPI_UINT64_T, MPI_SUM, 0, comm);
+    MPI_Reduce(m_elements.data(), elements.data(), nRegions, MPI_UINT64_T, MPI_SUM, 0, comm);
+    MPI_Reduce(m_allocations.data(), allocations.data(), nRegions, MPI_UINT64_T, MPI_SUM, 0, comm);
+
+    if (me != 0)
+        return;
+
+    char line[256];
+    std::cout << "# Timing summary over " << nprocs << " ranks (seconds)\n";
+    snprintf(line, sizeof(line), "# %-16s %12s %12s %12s %10s %14s %14s",
+             "region", "min", "avg", "max", "calls", "MiB", "elements");
+    std::cout << line;
+#ifdef DEBUG
+    std::cout << "         allocs";
+#endif
+    std::cout << "\n";
+    for (size_t i = 0; i < nRegions; ++i)
+    {
+        if (calls[i] == 0 && bytes[i] == 0 && elements[i] == 0)
+            continue;
+        snprintf(line, sizeof(line), "# %-16s %12.4f %12.4f %12.4f %10llu %14.2f %14llu",
+                 regionName(static_cast<Region>(i)),
+                 tmin[i],
+                 tsum[i] / nprocs,
+                 tmax[i],
+                 static_cast<unsigned long long>(calls[i]),
+                 bytes[i] / (1024.0 * 1024.0),
+                 static_cast<unsigned long long>(elements[i]));
+        std::cout << line;
+#ifdef DEBUG
+        snprintf(line, sizeof(line), " %14llu", static_cast<unsigned long long>(allocations[i]));
+        std::cout << line;
+#endif
+        std::cout << "\n";
+    }
+    std::cout.flush();
+}
+
+void Instrument::reset()
+{
+    m_seconds.fill(0.0);
+    m_calls.fill(0UL);
+    m_bytes.fill(0UL);
+    m_elements.fill(0UL);
+    m_allocations.fill(0UL);
+    m_trace.clear();
+    m_origin = Clock::now();
+}
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <mpi.h>
+
+namespace MDPAT
+{
+/*
+ * Lightweight timing and counters for the hot paths. Regions are a fixed enum so
+ * that every rank holds the same table and the end-of-run aggregation is a single
+ * MPI_Reduce per statistic. Always compiled; the cost of a ScopedTimer is two
+ * steady_clock reads, and the Chrome trace is only recorded when enabled.
+ */
+enum class Region
+{
+    TOTAL = 0,
+    READ,
+    SKIP_HEADER,
+    TRANSPOSE,
+    TEMPFILE_WRITE,
+    TEMPFILE_READ,
+    ANALYSIS,
+    REDUCTION,
+    OUTPUT,
+    CHECKPOINT,
+    NREGIONS
+};
+
+class Instrument
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    static constexpr size_t nRegions = static_cast<size_t>(Region::NREGIONS);
+public:
+    static Instrument& get();
+
+    void addTime(const Region, const Clock::time_point&, const Clock::time_point&);
+    void addBytes(const Region, const uint64_t);
+    void addElements(const Region, const uint64_t);
+    void addAllocations(const Region, const uint64_t);
+
+    void enableTrace(const std::filesystem::path& prefix);
+    void writeTrace() const;
+    void printSummary(MPI_Comm comm) const;
+    void reset();
+
+    static const char* regionName(const Region);
+private:
+    Instrument();
+    Instrument(const Instrument&) = delete;
+    Instrument& operator=(const Instrument&) = delete;
+
+    struct TraceEvent
+    {
+        Region region;
+        int64_t start;  // microseconds since m_origin
+        int64_t duration;
+    };
+private:
+    std::array<double, nRegions> m_seconds = {};
+    std::array<uint64_t, nRegions> m_calls = {};
+    std::array<uint64_t, nRegions> m_bytes = {};
+    std::array<uint64_t, nRegions> m_elements = {};
+    std::array<uint64_t, nRegions> m_allocations = {};
+
+    bool m_traceEnabled = false;
+    std::filesystem::path m_tracePrefix;
+    std::vector<TraceEvent> m_trace;
+    Clock::time_point m_origin;
+};
+
+/*
+ * Number of heap allocations (operator new) so far on this rank. Counted only in
+ * debug builds, where the summary gets an `allocs` column (e.g., for `read`, the
+ * allocations made while parsing frames after the first, which should be none);
+ * always 0 otherwise.
+ */
+uint64_t heapAllocations();
+
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(const Region region)
+        : m_region(region), m_start(Instrument::Clock::now()) {}
+    ~ScopedTimer() { Instrument::get().addTime(m_region, m_start, Instrument::Clock::now()); }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+private:
+    Region m_region;
+    Instrument::Clock::time_point m_start;
+};
+
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "trajectory.hpp"
+
+namespace MDPAT
+{
+/*
+ * Compile-time counterpart of Trajectory::AxisOrder: Layout<A0, A1, A2> stores
+ * A0 outermost and A2 contiguous. Positions of the axes are constexpr, so a
+ * kernel instantiated for a layout indexes with fixed loop nests and strides the
+ * compiler can hoist, instead of mapping every index through the runtime order.
+ * `withLayout` picks one of the six instantiations.
+ */
+template <Trajectory::Axis A0, Trajectory::Axis A1, Trajectory::Axis A2>
+struct Layout
+{
+    static constexpr Trajectory::Axis axis[3] = {A0, A1, A2};
+
+    // Position of an axis, 0 (outermost) to 2 (contiguous)
+    static constexpr int position(const Trajectory::Axis a)
+    {
+        return a == A0 ? 0 : (a == A1 ? 1 : 2);
+    }
+
+    static Trajectory::AxisOrder order()
+    {
+        return {A0, A1, A2};
+    }
+};
+
+template <typename Layout>
+struct LayoutTag
+{
+    typedef Layout type;
+};
+
+/*
+ * Calls f(LayoutTag<Layout<...>>()) for the layout of a runtime axis order:
+ *     withLayout(traj.getAxisOrder(), [&](auto tag) {
+ *         using L = typename decltype(tag)::type;
+ *         ...
+ *     });
+ */
+template <typename F>
+void withLayout(const Trajectory::AxisOrder& order, F&& f)
+{
+    using A = Trajectory::Axis;
+    if (order[0] == A::FRAMES)
+    {
+        if (order[1] == A::ATOMS)
+            f(LayoutTag<Layout<A::FRAMES, A::ATOMS, A::PROPS>>());
+        else
+            f(LayoutTag<Layout<A::FRAMES, A::PROPS, A::ATOMS>>());
+    }
+    else if (order[0] == A::ATOMS)
+    {
+        if (order[1] == A::PROPS)
+            f(LayoutTag<Layout<A::ATOMS, A::PROPS, A::FRAMES>>());
+        else
+            f(LayoutTag<Layout<A::ATOMS, A::FRAMES, A::PROPS>>());
+    }
+    else
+    {
+        if (order[1] == A::FRAMES)
+            f(LayoutTag<Layout<A::PROPS, A::FRAMES, A::ATOMS>>());
+        else
+            f(LayoutTag<Layout<A::PROPS, A::ATOMS, A::FRAMES>>());
+    }
+}
+
+/*
+ * Copies data laid out as From, with lengths `inLengths` (in From's order), into
+ * `out` laid out as To. The loops run in From's order, so reads are contiguous,
+ * and the write stride of each loop is fixed by the two layouts at compile time.
+ */
+template <typename From, typename To>
+void transposeBlock(const double* data, const Trajectory::Dimensions& inLengths, double* out)
+{
+    // Lengths in To's order, and the stride in `out` of each position of From
+    constexpr int p0 = To::position(From::axis[0]);
+    constexpr int p1 = To::position(From::axis[1]);
+    constexpr int p2 = To::position(From::axis[2]);
+    Trajectory::Dimensions outLengths;
+    outLengths[p0] = inLengths[0];
+    outLengths[p1] = inLengths[1];
+    outLengths[p2] = inLengths[2];
+    const uint64_t outStride[3] = {outLengths[1] * outLengths[2], outLengths[2], 1UL};
+    const uint64_t s0 = outStride[p0], s1 = outStride[p1], s2 = outStride[p2];
+
+#pragma omp parallel for collapse(2) schedule(static)
+    for (uint64_t i0 = 0; i0 < inLengths[0]; ++i0)
+    {
+        for (uint64_t i1 = 0; i1 < inLengths[1]; ++i1)
+        {
+            const double* row = data + (i0 * inLengths[1] + i1) * inLengths[2];
+            double* dst = out + i0 * s0 + i1 * s1;
+            if constexpr (p2 == 2)
+            {
+#pragma omp simd
+                for (uint64_t i2 = 0; i2 < inLengths[2]; ++i2)
+                    dst[i2] = row[i2];
+            }
+            else
+            {
+                for (uint64_t i2 = 0; i2 < inLengths[2]; ++i2)
+                    dst[i2 * s2] = row[i2];
+            }
+        }
+    }
+}
+
+/*
+ * In-place counterpart of transposeBlock for two layouts with the same first
+ * axis: each slice of that axis is copied to a per-thread scratch slice and
+ * transposed back into place, so the extra memory is one slice per thread
+ * instead of a second copy of the data.
+ */
+template <typename From, typename To>
+void transposeSlices(double* data, const Trajectory::Dimensions& lengths)
+{
+    static_assert(From::axis[0] == To::axis[0], "transposeSlices keeps the first axis");
+    const uint64_t sliceSize = lengths[1] * lengths[2];
+    const Trajectory::Dimensions sliceLengths = {1UL, lengths[1], lengths[2]};
+
+#pragma omp parallel
+    {
+        std::vector<double> scratch(sliceSize);
+#pragma omp for schedule(static)
+        for (uint64_t i0 = 0; i0 < lengths[0]; ++i0)
+        {
+            double* slice = data + i0 * sliceSize;
+            std::copy_n(slice, sliceSize, scratch.data());
+            transposeBlock<From, To>(scratch.data(), sliceLengths, slice);
+        }
+    }
+}
+
+}
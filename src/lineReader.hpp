@@ -0,0 +1,92 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <string_view>
+
+#include "arena.hpp"
+
+namespace MDPAT
+{
+/*
+ * Reads a text stream line by line into a buffer taken from an arena, so that
+ * dump files are tokenized as string_views without building std::strings (or
+ * going through `operator>>`, whose number parsing allocates). A line returned
+ * by `next` is valid until the following call.
+ */
+class LineReader
+{
+public:
+    LineReader(std::istream& is, Arena& arena, const size_t capacity = 256UL) :
+        m_is(is),
+        m_arena(arena),
+        m_buffer(arena.allocate<char>(capacity)),
+        m_capacity(capacity)
+    {
+    }
+
+    // Next line without its newline; false at the end of the stream
+    bool next(std::string_view& line)
+    {
+        size_t length = 0UL;
+        while (true)
+        {
+            m_is.getline(m_buffer + length, m_capacity - length);
+            const size_t count = m_is.gcount();
+            if (!m_is.fail())
+            {
+                // gcount includes the newline, which was extracted but not stored
+                length += (count > 0 && !m_is.eof()) ? count - 1 : count;
+                break;
+            }
+            length += count;
+            if (m_is.eof() || count == 0)
+            {
+                if (length == 0)
+                    return false;
+                break;
+            }
+            // The line is longer than the buffer: grow it and read the rest
+            m_is.clear();
+            char* larger = m_arena.allocate<char>(2 * m_capacity);
+            std::memcpy(larger, m_buffer, length);
+            m_buffer = larger;
+            m_capacity *= 2;
+        }
+        line = std::string_view(m_buffer, length);
+        return true;
+    }
+private:
+    std::istream& m_is;
+    Arena& m_arena;
+    char* m_buffer;
+    size_t m_capacity;
+};
+
+// Removes and returns the first whitespace-separated token of line; empty if none
+inline std::string_view nextToken(std::string_view& line)
+{
+    size_t start = 0;
+    while (start < line.size() && (line[start] == ' ' || line[start] == '\t' || line[start] == '\r'))
+        ++start;
+    size_t end = start;
+    while (end < line.size() && line[end] != ' ' && line[end] != '\t' && line[end] != '\r')
+        ++end;
+    const std::string_view token = line.substr(start, end - start);
+    line.remove_prefix(end);
+    return token;
+}
+
+// Parses the whole token as a number (integer or floating point); false if it is not one
+template <typename T>
+bool parseNumber(std::string_view token, T& value)
+{
+    if (!token.empty() && token[0] == '+')
+        token.remove_prefix(1);
+    const auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+    return result.ec == std::errc() && result.ptr == token.data() + token.size();
+}
+
+}
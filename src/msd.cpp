@@ -1,225 +1,290 @@
 #include "msd.hpp"
 
+#include <algorithm>
+
+#include "analysisArgs.hpp"
+#include "atomBlocks.hpp"
+#include "error.hpp"
+#include "incremental.hpp"
+#include "instrument.hpp"
+#include "output.hpp"
+#include "reduce.hpp"
+
 namespace MDPAT
 {
-    template <typename T>
-    msd_results<T> meanSquaredDisplacement1(
-        std::vector<int32_t> &typelist,
-        std::vector<T> unwrapped_trajectories,
-        const uint64_t first_frame,
-        const uint64_t num_frames,
-        const uint64_t num_atoms,
-        const uint64_t num_spatial_dims,
-        const uint64_t gap_start,
-        const uint64_t gap_end,
-        const int me,
-        const int nprocs,
-        MPI_Comm comm)
+    bool atomSelected(
+        const double* atom,
+        const uint64_t nFrames,
+        const int typeCol,
+        const std::vector<int>& types)
     {
-        // * As a whole, this library should read the trajectories once and send
-        // * them whole-cloth to each method (such as msd). However, since a method
-        // * such as msd will alter the trajectories, and copying may take up too
-        // ? much memory, should I instead just read the trajectories a few times?
-
-        // Expects unwrapped_trajectories to come in as a 1D vector representing 3D
-        // data of the shape (num_frames, num_atoms, num_spatial_dims)
-
-        // Using permuteDims, it switches the order to (num_atoms, num_spatial_dims, num_frames),
-        // because the MSD calculation can take place over each atom and spatial dimension
-        // independently. Thus, the GPU can compute the MSD value for one atom and spatial
-        // dimension per thread and accumulate the results.
-
-        // The issue is that this function is called by each process with its own set of
-        // frames. So after permuting the dimensions, we then have to reorganize the data
-        // among the processes to give each proc all the frames corresponding to its atoms
-        // and spatial dimensions.
-
-        // Changing my mind: I'll do what I did before and send the data to proc 0 to
-        // reorganize and redistribute. It's the easiest, and if I want to make it better
-        // later on, I can change it.
-
-        std::vector<uint64_t> dimLengths = {num_frames, num_atoms, num_spatial_dims};
-        const std::vector<uint64_t> newDims = {2, 0, 1};
-
-        // TODO: select atoms from typelist
-
-        auto ret = permuteDimsParallel<T>(unwrapped_trajectories, dimLengths, newDims, me, nprocs, comm);
-        if (ret)
-            throw -1;
-
-        auto my_natoms = dimLengths[0];
-        auto total_num_frames = dimLengths[2];
-
-        msd_results<T> results;
-        uint64_t results_size = gap_end - gap_start + 1;
-        results.timegaps.resize(results_size);
-        results.msd.resize(results_size);
-        T tmp;
+        if (typeCol < 0)
+            return true;
+        const int type = static_cast<int>(atom[typeCol * nFrames] + 0.5);
+        return types.end() != std::find(types.begin(), types.end(), type);
+    }
 
-        for (uint64_t gap = gap_start; gap <= gap_end; ++gap)
-            results.timegaps[gap - gap_start] = gap;
+    uint64_t msdBlock(
+        const double* data,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t nFrames,
+        const std::vector<int>& coordCols,
+        const int typeCol,
+        const std::vector<int>& types,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        double* msd,
+        DisplacementMoments* moments,
+        const uint64_t firstEnd)
+    {
+        [[maybe_unused]] const uint64_t numGaps = maxGap - minGap + 1;  // in omp clauses only
+        uint64_t nSelected = 0UL;
 
-        for (uint64_t atom = 0; atom < my_natoms; ++atom)
+        if (moments != nullptr)
         {
-            for (uint64_t col = 0; col < num_spatial_dims; ++col)
+            // Reduction sections must not be empty (ngp without vanhove); reduce a dummy instead
+            double none = 0.0;
+            double* msd4 = moments->msd4.data();
+            double* vanHove = moments->vanHove.empty() ? &none : moments->vanHove.data();
+            [[maybe_unused]] const uint64_t histSize = std::max<uint64_t>(moments->vanHove.size(), 1UL);
+
+#pragma omp parallel for reduction(+ : nSelected) reduction(+ : msd[:numGaps], msd4[:numGaps], vanHove[:histSize])
+            for (uint64_t atom = 0; atom < nAtoms; ++atom)
             {
-                for (uint64_t gap = gap_start; gap <= gap_end; ++gap)
-                {
-                    for (uint64_t frame = 0; frame + gap < total_num_frames; ++frame)
-                    {
-                        tmp = unwrapped_trajectories[atom * num_spatial_dims * total_num_frames + col * total_num_frames + frame + gap] -
-                              unwrapped_trajectories[atom * num_spatial_dims * total_num_frames + col * total_num_frames + frame];
-                        results.msd[gap - gap_start] += tmp * tmp;
-                    }
-                }
+                const double* atomData = data + atom * nCols * nFrames;
+                if (!atomSelected(atomData, nFrames, typeCol, types))
+                    continue;
+                ++nSelected;
+                accumulateDisplacementMoments(atomData, nFrames, coordCols, minGap, maxGap, *moments, msd, msd4, vanHove, firstEnd);
             }
+            return nSelected;
         }
 
-        return results;
-    }
-
-    void meanSquaredDisplacement(const MDPAT::Trajectory& traj, const std::vector<std::string>& args)
-    {
+#pragma omp parallel for reduction(+ : nSelected) reduction(+ : msd[:numGaps])
+        for (uint64_t atom = 0; atom < nAtoms; ++atom)
+        {
+            const double* atomData = data + atom * nCols * nFrames;
+            if (!atomSelected(atomData, nFrames, typeCol, types))
+                continue;
+            ++nSelected;
+            for (const int col : coordCols)
+                accumulateMSD(atomData + col * nFrames, nFrames, minGap, maxGap, msd, firstEnd);
+        }
+        return nSelected;
     }
 
-    void meanSquaredDisplacement2(
-        fs::path outfile,
-        fs::path directory,
-        StepRange stepRange,
-        double timestep,
-        uint32_t atomType,
-        uint64_t minGap, // in number of steps
-        uint64_t maxGap, // in number of steps
-        uint32_t dim,    // number of spatial dimensions
-        int me,
-        int nprocs,
-        MPI_Comm comm)
+    uint64_t msdRaggedBlock(
+        const uint64_t* offsets,
+        const uint64_t* frames,
+        const double* rows,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const std::vector<int>& coordCols,
+        const int typeCol,
+        const std::vector<int>& types,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        double* msd,
+        double* pairs,
+        DisplacementMoments* moments,
+        const uint64_t firstEnd)
     {
-        uint64_t nSteps = (stepRange.endStep - stepRange.initStep) / stepRange.dumpStep + 1;
-        auto [myFirstStep, myNumSteps] = splitValues(nSteps, me, nprocs);
-
-        StepRange myStepRange(myFirstStep,
-                              myFirstStep + stepRange.dumpStep * (myNumSteps - 1),
-                              stepRange.dumpStep);
-
-        auto atoms = getTrajectories(directory, myStepRange, false, atomType, dim);
-        auto nAtoms = atoms.size() / dim / myNumSteps;
-
-        std::vector<uint64_t> dimLengths = {myNumSteps, nAtoms, dim};
-        std::vector<uint64_t> newDims = {1, 2, 0};
-        permuteDimsParallel(atoms, dimLengths, newDims, me, nprocs, comm);
-        auto myNumAtoms = atoms.size() / dim / nSteps;
-
-        minGap /= myStepRange.dumpStep;
-        maxGap /= myStepRange.dumpStep;
-        uint64_t numGaps = maxGap - minGap + 1;
-
-        double rsq, dx;
-        std::vector<double> msd(numGaps, 0.0);
-
-        for (uint64_t atom = 0; atom < myNumAtoms; ++atom)
+        const uint64_t numGaps = maxGap - minGap + 1;
+        const bool fourthMoment = moments != nullptr && moments->fourthMoment;
+        const bool vanHove = moments != nullptr && moments->numVanHove > 0;
+        // Reduction sections must not be empty; absent extras reduce dummies instead
+        double none[2] = {0.0, 0.0};
+        double* msd4 = fourthMoment ? moments->msd4.data() : &none[0];
+        double* hist = vanHove ? moments->vanHove.data() : &none[1];
+        [[maybe_unused]] const uint64_t msd4Size = fourthMoment ? numGaps : 1UL;  // in omp clauses only
+        [[maybe_unused]] const uint64_t histSize = vanHove ? moments->vanHove.size() : 1UL;
+        uint64_t nSelected = 0UL;
+
+#pragma omp parallel for schedule(dynamic) reduction(+ : nSelected) \
+    reduction(+ : msd[:numGaps], pairs[:numGaps], msd4[:msd4Size], hist[:histSize])
+        for (uint64_t atom = 0; atom < nAtoms; ++atom)
         {
-            for (uint64_t col = 0; col < dim; ++col)
+            const uint64_t first = offsets[atom], last = offsets[atom + 1];
+            if (first == last)
+                continue;
+            if (typeCol >= 0)
+            {
+                const int type = static_cast<int>(rows[first * nCols + typeCol] + 0.5);
+                if (types.end() == std::find(types.begin(), types.end(), type))
+                    continue;
+            }
+            ++nSelected;
+
+            for (uint64_t i = first; i < last; ++i)
             {
-                for (uint64_t gap = minGap; gap <= maxGap; ++gap)
+                for (uint64_t j = i + 1; j < last; ++j)
                 {
-                    rsq = 0;
-                    for (uint64_t frame = 0; frame + gap < nSteps; ++frame)
+                    const uint64_t gap = frames[j] - frames[i];
+                    if (gap > maxGap)
+                        break;
+                    if (gap < minGap || frames[j] < firstEnd)
+                        continue;
+                    double rsq = 0.0;
+                    for (const int col : coordCols)
                     {
-                        dx = atoms[atom * dim * nSteps + col * nSteps + frame + gap] -
-                             atoms[atom * dim * nSteps + col * nSteps + frame];
+                        const double dx = rows[j * nCols + col] - rows[i * nCols + col];
                         rsq += dx * dx;
                     }
                     msd[gap - minGap] += rsq;
+                    pairs[gap - minGap] += 1.0;
+                    if (fourthMoment)
+                        msd4[gap - minGap] += rsq * rsq;
+                    if (vanHove && moments->vanHoveIndex[gap - minGap] >= 0)
+                    {
+                        const uint64_t bin = std::sqrt(rsq) / moments->binWidth;
+                        if (bin < moments->numBins)
+                            hist[moments->vanHoveIndex[gap - minGap] * moments->numBins + bin] += 1.0;
+                    }
                 }
             }
         }
-
-        if (me)
-            MPI_Reduce(msd.data(), msd.data(), msd.size(), MPI_DOUBLE, MPI_SUM, 0, comm);
-        else
-            MPI_Reduce(MPI_IN_PLACE, msd.data(), msd.size(), MPI_DOUBLE, MPI_SUM, 0, comm);
-
-        if (me == 0)
-        {
-            std::ofstream outstream(outfile);
-            for (uint64_t gap = minGap; gap <= maxGap; ++gap)
-                outstream << gap * myStepRange.dumpStep * timestep << ' '
-                          << msd[gap - minGap] / nAtoms / (nSteps - gap) << '\n';
-            outstream.close();
-        }
+        return nSelected;
     }
 
-    void meanSquaredDisplacementOMP(
-        fs::path outfile,
-        fs::path directory,
-        StepRange stepRange,
-        double timestep,
-        uint32_t atomType,
-        uint64_t minGap, // in number of steps
-        uint64_t maxGap, // in number of steps
-        uint32_t dim,    // number of spatial dimensions
-        int me,
-        int nprocs,
-        MPI_Comm comm)
+    /*
+     * msd [types <t>...] [steps <min>-<max>] [timestep <dt>] [columns <x> <y> <z>] [outfile <file>]
+     *     [ngp] [vanhove <step>... [bins <n>] [rmax <r>] [vanhovefile <file>]]
+     * The gap range is given in timesteps. Columns default to xu yu zu. `ngp` adds
+     * <r^4> and alpha_2 columns; `vanhove` writes histograms of |dr| at the given gaps.
+     */
+    void meanSquaredDisplacement(MDPAT::Trajectory& traj, const std::vector<std::string>& words)
     {
-        // uint64_t nSteps = (stepRange.endStep - stepRange.initStep) / stepRange.dumpStep + 1;
-        auto [myFirstStep, myNumSteps] = splitValues(stepRange.nSteps, me, nprocs);
-
-        StepRange myStepRange(
-            myFirstStep,
-            myFirstStep + stepRange.dumpStep * (myNumSteps - 1),
-            stepRange.dumpStep);
-
-        auto atoms = getTrajectories(directory, myStepRange, false, atomType, dim);
-        auto nAtoms = atoms.size() / dim / myNumSteps;
-
-        std::vector<uint64_t> dimLengths = {myNumSteps, nAtoms, dim};
-        std::vector<uint64_t> newDims = {1, 2, 0};
-        permuteDimsParallel(atoms, dimLengths, newDims, me, nprocs, comm);
-        auto myNumAtoms = atoms.size() / dim / stepRange.nSteps;
-
-        minGap /= myStepRange.dumpStep;
-        maxGap /= myStepRange.dumpStep;
-        uint64_t numGaps = maxGap - minGap + 1;
-
-        double rsq, dx;
-        std::vector<double> msd(numGaps, 0.0);
-
-#pragma omp distribute collapse(3)
-        for (uint64_t atom = 0; atom < myNumAtoms; ++atom)
+        int me = 0;
+        MPI_Comm_rank(MPI_COMM_WORLD, &me);
+
+        const AnalysisArgs args("msd", words, {
+            "types", "steps", "timestep", "columns", "outfile", "ngp", "vanhove", "bins", "rmax", "vanhovefile"});
+        const auto coordCols = unwrappedColumns(traj, args);
+        const auto types = args.getInts("types");
+        const int typeCol = types.empty() ? -1 : findColumns(traj, {"type"})[0];
+        const double timestep = args.getDouble("timestep", 1.0);
+        const fs::path outfile = args.getString("outfile", "msd.txt");
+
+        const uint64_t nFrames = traj.getStepsGlobal().size();
+        const uint64_t nCols = traj.getColumnLabels().size();
+        const uint64_t delta = dumpStep(traj);
+        const auto gaps = gapRange(traj, args);
+        const uint64_t minGap = gaps.first, maxGap = gaps.second;
+        const uint64_t numGaps = maxGap - minGap + 1;
+
+        // Incremental: only pairs ending in a new frame are added, to the previous run's sums
+        Incremental& incremental = Incremental::get();
+        const uint64_t firstNew = incremental.getFirstNewFrame();
+        const uint64_t nFramesAll = incremental.getNumFrames(traj);
+
+        // Extras are only computed (by the slower fused kernel) when asked for
+        const bool extras = args.has("ngp") || args.has("vanhove");
+        DisplacementMoments moments;
+        if (extras)
         {
-            for (uint64_t col = 0; col < dim; ++col)
+            moments.fourthMoment = args.has("ngp");
+            moments.msd4.assign(numGaps, 0.0);
+            const auto vanHoveSteps = args.get("vanhove");
+            if (!vanHoveSteps.empty())
             {
-                for (uint64_t gap = minGap; gap <= maxGap; ++gap)
+                moments.numVanHove = vanHoveSteps.size();
+                moments.numBins = args.getUInt("bins", 100UL);
+                moments.binWidth = args.getDouble("rmax", 5.0) / moments.numBins;
+                moments.vanHoveIndex.assign(numGaps, -1);
+                moments.vanHove.assign(moments.numVanHove * moments.numBins, 0.0);
+                for (uint64_t i = 0; i < vanHoveSteps.size(); ++i)
                 {
-                    rsq = 0;
-#pragma omp simd reduction(+ : rsq)
-                    for (uint64_t frame = 0; frame < stepRange.nSteps - gap; ++frame)
-                    {
-                        dx = atoms[atom * dim * stepRange.nSteps + col * stepRange.nSteps + frame + gap] -
-                             atoms[atom * dim * stepRange.nSteps + col * stepRange.nSteps + frame];
-                        rsq += dx * dx;
-                    }
-#pragma omp atomic
-                    msd[gap - minGap] += rsq;
+                    const uint64_t gap = std::stoull(vanHoveSteps[i]) / delta;
+                    if (gap < minGap || gap > maxGap)
+                        errorAll(Error::ARGUMENTERROR, "van Hove step %s is outside the msd steps range", vanHoveSteps[i].c_str());
+                    moments.vanHoveIndex[gap - minGap] = i;
                 }
             }
         }
 
-        if (me)
-            MPI_Reduce(msd.data(), msd.data(), msd.size(), MPI_DOUBLE, MPI_SUM, 0, comm);
+        std::vector<double> msd(numGaps, 0.0);
+        uint64_t nSelected = 0UL;
+
+        // Ragged trajectories count the pairs of frames each gap has, as atoms come and go
+        const bool ragged = traj.isRagged();
+        std::vector<double> pairs;
+        if (ragged)
+            pairs.assign(numGaps, 0.0);
+        const Accumulators sums = Accumulators().add(msd).add(pairs).add(moments.msd4).add(moments.vanHove);
+        incremental.resume(sums);
+
+        if (ragged)
+        {
+            forEachAtomSeries(traj, [&](const uint64_t* offsets, const uint64_t* frames, const double* rows,
+                                        const uint64_t, const uint64_t nAtoms) {
+                nSelected = msdRaggedBlock(offsets, frames, rows, nAtoms, nCols, coordCols, typeCol, types,
+                                           minGap, maxGap, msd.data(), pairs.data(), extras ? &moments : nullptr, firstNew);
+            });
+        }
         else
-            MPI_Reduce(MPI_IN_PLACE, msd.data(), msd.size(), MPI_DOUBLE, MPI_SUM, 0, comm);
+        {
+            forEachAtomBlock(traj, 1UL, [&](const double* data, const uint64_t nAtoms) {
+                nSelected += msdBlock(data, nAtoms, nCols, nFrames, coordCols, typeCol, types, minGap, maxGap, msd.data(),
+                                      extras ? &moments : nullptr, firstNew);
+            }, Accumulators().add(msd).add(nSelected).add(moments.msd4).add(moments.vanHove));
+        }
+
+        Reduction(MPI_COMM_WORLD).add(msd).add(nSelected).add(pairs).add(moments.msd4).add(moments.vanHove).wait();
+        incremental.keep(sums);
 
         if (me == 0)
         {
-            std::ofstream outstream(outfile);
-            for (uint64_t gap = minGap; gap <= maxGap; ++gap)
-                outstream << gap * myStepRange.dumpStep * timestep << ' '
-                          << msd[gap - minGap] / nAtoms / (stepRange.nSteps - gap) << '\n';
-            outstream.close();
+            ScopedTimer timer(Region::OUTPUT);
+            if (nSelected == 0)
+                errorOne(Error::ARGUMENTERROR, "No atoms selected for command msd");
+
+            // time, msd[, <r^4>, alpha_2]; an incremental run may not have frames for the longest gaps yet
+            const int numColumns = moments.fourthMoment ? 4 : 2;
+            const double dim = coordCols.size();
+            const uint64_t numRows = std::min(maxGap + 1, std::max(nFramesAll, minGap)) - minGap;
+            std::vector<double> columns(numColumns * numRows);
+            for (uint64_t gap = minGap; gap < minGap + numRows; ++gap)
+            {
+                const uint64_t i = gap - minGap;
+                // Ragged: averaged over the (atom, origin) pairs each gap has
+                const double norm = ragged ? (pairs[i] > 0.0 ? 1.0 / pairs[i] : 0.0) : 1.0;
+                const double r2 = ragged ? msd[i] * norm : msd[i] / nSelected / (nFramesAll - gap);
+                columns[i] = gap * delta * timestep;
+                columns[numRows + i] = r2;
+                if (moments.fourthMoment)
+                {
+                    const double r4 = ragged ? moments.msd4[i] * norm : moments.msd4[i] / nSelected / (nFramesAll - gap);
+                    columns[2 * numRows + i] = r4;
+                    columns[3 * numRows + i] = r2 > 0.0 ? dim * r4 / ((dim + 2.0) * r2 * r2) - 1.0 : 0.0;
+                }
+            }
+            if (writeColumns(columns, numColumns, outfile))
+                errorOne(Error::IOERROR, "Couldn't write to file %s", outfile.c_str());
+
+            // r, then P(|dr| = r) at each requested gap, normalized so that it integrates to 1
+            if (moments.numVanHove > 0)
+            {
+                const fs::path vanHoveFile = args.getString("vanhovefile", "vanhove.txt");
+                const uint64_t numBins = moments.numBins;
+                std::vector<double> vanHoveColumns((moments.numVanHove + 1) * numBins);
+                for (uint64_t bin = 0; bin < numBins; ++bin)
+                    vanHoveColumns[bin] = (bin + 0.5) * moments.binWidth;
+                for (uint64_t i = 0; i < numGaps; ++i)
+                {
+                    const int hist = moments.vanHoveIndex[i];
+                    if (hist < 0)
+                        continue;
+                    const double count = ragged ? pairs[i] : (i < numRows ? static_cast<double>(nSelected) * (nFramesAll - minGap - i) : 0.0);
+                    const double norm = count > 0.0 ? 1.0 / (count * moments.binWidth) : 0.0;
+                    for (uint64_t bin = 0; bin < numBins; ++bin)
+                        vanHoveColumns[(hist + 1) * numBins + bin] = moments.vanHove[hist * numBins + bin] * norm;
+                }
+                if (writeColumns(vanHoveColumns, moments.numVanHove + 1, vanHoveFile))
+                    errorOne(Error::IOERROR, "Couldn't write to file %s", vanHoveFile.c_str());
+            }
         }
+        MPI_Barrier(MPI_COMM_WORLD);
     }
 
 }
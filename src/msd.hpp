@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cmath>
 #include <cstdint>
 #include <filesystem>
 #include <vector>
@@ -8,61 +9,187 @@
 #include <omp.h>
 
 #include "splitValues.hpp"
+#include "stepRange.hpp"
+#include "trajectory.hpp"
 
 namespace fs = std::filesystem;
 
 namespace MDPAT
 {
-    template <typename T>
-    struct msd_results
-    {
-        std::vector<uint64_t> timegaps;
-        std::vector<T> msd;
-    };
-
     void meanSquaredDisplacement(
         MDPAT::Trajectory&,
         const std::vector<std::string>&
     );
 
-    template <typename T>
-    msd_results<T> meanSquaredDisplacement1(
-        std::vector<int32_t> &typelist,
-        std::vector<T> unwrapped_trajectories,
-        const uint64_t first_frame,
-        const uint64_t num_frames,
-        const uint64_t num_atoms,
-        const uint64_t num_spatial_dims,
-        const uint64_t gap_start,
-        const uint64_t gap_end,
-        const int me,
-        const int nprocs,
-        MPI_Comm comm);
+    /*
+     * Adds the sum over time origins of (x[t0 + gap] - x[t0])^2 to msd[gap - minGap]
+     * for each gap in [minGap, maxGap], for one contiguous time series x. Only pairs
+     * that end at or after frame `firstEnd` count (the new frames of an incremental run).
+     */
+    inline void accumulateMSD(
+        const double* series,
+        const uint64_t nFrames,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        double* msd,
+        const uint64_t firstEnd = 0UL)
+    {
+        for (uint64_t gap = minGap; gap <= maxGap && gap < nFrames; ++gap)
+        {
+            const uint64_t firstOrigin = firstEnd > gap ? firstEnd - gap : 0UL;
+            double rsq = 0.0;
+#pragma omp simd reduction(+ : rsq)
+            for (uint64_t frame = firstOrigin; frame < nFrames - gap; ++frame)
+            {
+                const double dx = series[frame + gap] - series[frame];
+                rsq += dx * dx;
+            }
+            msd[gap - minGap] += rsq;
+        }
+    }
+
+    /*
+     * Adds the sum over time origins of x[t0 + gap] * x[t0] to corr[gap - minGap]
+     * for each gap in [minGap, maxGap]; the autocorrelation counterpart of accumulateMSD.
+     */
+    inline void accumulateCorrelation(
+        const double* series,
+        const uint64_t nFrames,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        double* corr)
+    {
+        for (uint64_t gap = minGap; gap <= maxGap && gap < nFrames; ++gap)
+        {
+            double sum = 0.0;
+#pragma omp simd reduction(+ : sum)
+            for (uint64_t frame = 0; frame < nFrames - gap; ++frame)
+                sum += series[frame + gap] * series[frame];
+            corr[gap - minGap] += sum;
+        }
+    }
+
+    /*
+     * Optional extras computed in the same sweep as the MSD: the fourth moment of
+     * the displacement (for the non-Gaussian parameter alpha_2) and histograms of
+     * |dr| (the self van Hove function) at selected gaps.
+     */
+    struct DisplacementMoments
+    {
+        bool fourthMoment = false;
+        std::vector<int> vanHoveIndex;  // per gap in [minGap, maxGap]: histogram number, or -1
+        uint64_t numVanHove = 0UL;
+        uint64_t numBins = 0UL;
+        double binWidth = 1.0;
+        std::vector<double> msd4;       // numGaps
+        std::vector<double> vanHove;    // numVanHove x numBins
+    };
+
+    /*
+     * Adds sum over origins of |dr|^2 and |dr|^4 to msd and msd4, and bins |dr| into
+     * vanHove for the gaps that have a histogram, for one atom laid out as PROPS x FRAMES.
+     * Only pairs that end at or after frame `firstEnd` count.
+     */
+    inline void accumulateDisplacementMoments(
+        const double* atom,
+        const uint64_t nFrames,
+        const std::vector<int>& coordCols,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        const DisplacementMoments& moments,
+        double* msd,
+        double* msd4,
+        double* vanHove,
+        const uint64_t firstEnd = 0UL)
+    {
+        for (uint64_t gap = minGap; gap <= maxGap && gap < nFrames; ++gap)
+        {
+            const uint64_t firstOrigin = firstEnd > gap ? firstEnd - gap : 0UL;
+            double sum2 = 0.0, sum4 = 0.0;
+#pragma omp simd reduction(+ : sum2, sum4)
+            for (uint64_t frame = firstOrigin; frame < nFrames - gap; ++frame)
+            {
+                double rsq = 0.0;
+                for (const int col : coordCols)
+                {
+                    const double dx = atom[col * nFrames + frame + gap] - atom[col * nFrames + frame];
+                    rsq += dx * dx;
+                }
+                sum2 += rsq;
+                sum4 += rsq * rsq;
+            }
+            msd[gap - minGap] += sum2;
+            msd4[gap - minGap] += sum4;
+
+            const int hist = moments.vanHoveIndex.empty() ? -1 : moments.vanHoveIndex[gap - minGap];
+            if (hist < 0)
+                continue;
+            for (uint64_t frame = firstOrigin; frame < nFrames - gap; ++frame)
+            {
+                double rsq = 0.0;
+                for (const int col : coordCols)
+                {
+                    const double dx = atom[col * nFrames + frame + gap] - atom[col * nFrames + frame];
+                    rsq += dx * dx;
+                }
+                const uint64_t bin = std::sqrt(rsq) / moments.binWidth;
+                if (bin < moments.numBins)
+                    vanHove[hist * moments.numBins + bin] += 1.0;
+            }
+        }
+    }
+
+    /*
+     * Accumulates the MSD of every selected atom of a block laid out as
+     * ATOMS x PROPS x FRAMES (as after permuteDims, or an out-of-core atom block).
+     * An atom is selected if typeCol < 0 or its type in the first frame is in types.
+     * If moments is given, its fourth moment and van Hove histograms are
+     * accumulated in the same sweep. Only pairs of frames that end at or after
+     * `firstEnd` count. Returns the number of selected atoms.
+     */
+    uint64_t msdBlock(
+        const double* data,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t nFrames,
+        const std::vector<int>& coordCols,
+        const int typeCol,
+        const std::vector<int>& types,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        double* msd,
+        DisplacementMoments* moments = nullptr,
+        const uint64_t firstEnd = 0UL);
 
-    void meanSquaredDisplacement2(
-        fs::path outfile,
-        fs::path directory,
-        StepRange stepRange,
-        double timestep,
-        uint32_t atomType,
-        uint64_t minGap, // in number of steps
-        uint64_t maxGap, // in number of steps
-        uint32_t dim,    // number of spatial dimensions
-        int me,
-        int nprocs,
-        MPI_Comm comm);
+    /*
+     * Ragged counterpart of msdBlock, for atoms that are missing from some frames
+     * (see `forEachAtomSeries`): atom a has the samples [offsets[a], offsets[a + 1])
+     * of frames (ascending global indices) and rows (PROPS fastest). Every pair of
+     * samples gap = frames[j] - frames[i] apart adds to msd[gap - minGap], and to
+     * pairs[gap - minGap] to count the pairs; only pairs with frames[j] >= firstEnd
+     * count. An atom is selected by its type in its first sample. Returns the number
+     * of selected atoms.
+     */
+    uint64_t msdRaggedBlock(
+        const uint64_t* offsets,
+        const uint64_t* frames,
+        const double* rows,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const std::vector<int>& coordCols,
+        const int typeCol,
+        const std::vector<int>& types,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        double* msd,
+        double* pairs,
+        DisplacementMoments* moments = nullptr,
+        const uint64_t firstEnd = 0UL);
 
-    void meanSquaredDisplacementOMP(
-        fs::path outfile,
-        fs::path directory,
-        StepRange stepRange,
-        double timestep,
-        uint32_t atomType,
-        uint64_t minGap, // in number of steps
-        uint64_t maxGap, // in number of steps
-        uint32_t dim,    // number of spatial dimensions
-        int me,
-        int nprocs,
-        MPI_Comm comm);
+    bool atomSelected(
+        const double* atom,
+        const uint64_t nFrames,
+        const int typeCol,
+        const std::vector<int>& types);
 
 }
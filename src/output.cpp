@@ -1,5 +1,7 @@
 #include "output.hpp"
 
+#include "resultCache.hpp"
+
 namespace fs = std::filesystem;
 using std::vector;
 
@@ -25,7 +27,7 @@ namespace MDPAT
         }
 
         int numRows = values.size() / numColumns;
-        if (numRows == 0 || numColumns * numRows != values.size())
+        if (numRows == 0 || static_cast<size_t>(numColumns * numRows) != values.size())
         {
             std::cerr << "Number of columns (" << numColumns
                       << ") not compatible with size of data ("
@@ -41,6 +43,7 @@ namespace MDPAT
             out << values[(numColumns - 1) * numRows + i] << '\n';
         }
 
+        ResultCache::get().addOutput(outfile);
         return 0;
     }
 
@@ -54,4 +57,7 @@ namespace MDPAT
         return 0;
     }
 
+    template int writeColumns<double>(const std::vector<double>&, const int, const std::filesystem::path, const char);
+    template int writeColumns<uint64_t>(const std::vector<uint64_t>&, const int, const std::filesystem::path, const char);
+
 } // namespace MDPAT
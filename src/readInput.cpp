@@ -1,5 +1,6 @@
 #include "readInput.hpp"
 
+#include <cctype>
 #include <sstream>
 
 namespace fs = std::filesystem;
@@ -13,12 +14,22 @@ InputReader::InputReader(const string& inputFile) :
 {
     MPI_Comm_rank(MPI_COMM_WORLD, &m_me);
     m_commandMap["msd"] = meanSquaredDisplacement;
+    m_commandMap["bondacf"] = bondAutocorrelation;
+    m_commandMap["chainmsd"] = chainMSD;
+    m_commandMap["chi4"] = fourPointSusceptibility;
+    m_commandMap["cluster"] = cluster;
+    m_commandMap["density"] = density;
+    m_commandMap["rouse"] = rouseModes;
+    m_commandMap["shape"] = chainShape;
 }
 
 InputReader::~InputReader() {}
 
 void InputReader::runFile()
 {
+    Instrument::get().reset();
+    const auto runStart = Instrument::Clock::now();
+
     if (!fs::is_regular_file(m_inputFile))
         errorAll(Error::IOERROR, "Input file %s does not exist.", m_inputFile.c_str());
 
@@ -39,12 +50,29 @@ void InputReader::runFile()
     }
     bcast(lines, 0, MPI_COMM_WORLD);
 
+    // A restart must run the same steps (`traj`, `NN`, and analyses) as the checkpointed run
+    vector<vector<string>> commands;
+    uint64_t deck = Checkpoint::hash("");
     for (const auto& line : lines)
     {
         const auto words = parseLine(line);
-        if (words.size() > 1)
-            executeCommand(words);
+        if (words.size() <= 1)
+            continue;
+        commands.push_back(words);
+        if (words[0] == "checkpoint" || words[0] == "restart" || words[0] == "profile")
+            continue;
+        for (const auto& word : words)
+            deck = Checkpoint::hash(word + '\n', deck);
     }
+    Checkpoint::get().setDeck(deck);
+
+    for (const auto& words : commands)
+        executeCommand(words);
+    Incremental::get().save();
+
+    Instrument::get().addTime(Region::TOTAL, runStart, Instrument::Clock::now());
+    Instrument::get().printSummary(MPI_COMM_WORLD);
+    Instrument::get().writeTrace();
 }
 
 vector<string> InputReader::parseLine(const string& line)
@@ -57,9 +85,9 @@ vector<string> InputReader::parseLine(const string& line)
     std::istringstream iss(line);
     iss >> word;
 
-    if (m_commandMap.find(word.data()) == m_commandMap.end())
+    if (m_commandMap.find(word) == m_commandMap.end())
     {
-        if (word == "traj") ;  // written this way because we may add more non-analysis commands
+        if (word == "traj" || word == "profile" || word == "NN" || word == "checkpoint" || word == "restart" || word == "incremental" || word == "cache" || word == "reduction") ;  // written this way because we may add more non-analysis commands
         else
             errorAll(Error::SYNTAXERROR, "Command not recognized: %s", word.c_str());
     }
@@ -134,16 +162,72 @@ vector<string> InputReader::parseLine(const string& line)
 void InputReader::executeCommand(const vector<string>& words)
 {
     const string command = words[0];
-    if (command == "trajectory")
+    if (command == "traj")
     {
+        // Always read: a finished read resumes from the out-of-core store, if any
+        Checkpoint::get().beginStep(m_step++);
         trajCmd(words);
+        Checkpoint::get().endStep();
+    }
+    else if (command == "profile")
+    {
+        profileCmd(words);
+    }
+    else if (command == "checkpoint" || command == "restart")
+    {
+        checkpointCmd(words);
+    }
+    else if (command == "incremental")
+    {
+        incrementalCmd(words);
+    }
+    else if (command == "cache")
+    {
+        cacheCmd(words);
+    }
+    else if (command == "reduction")
+    {
+        reductionCmd(words);
     }
-    else if (m_commandMap.find(command.c_str()) != m_commandMap.end()) 
+    else if (command == "NN")
     {
-        if (!m_trajectory.isLoaded)
+        if (words.size() != 2)
+            incorrectArgs(words[0], 1, words.size() - 1);
+        m_trajectory.setAtomsPerMolecule(std::stoull(words[1]));
+        ResultCache::get().addContext(words);
+    }
+    else if (m_commandMap.find(command) != m_commandMap.end()) 
+    {
+        if (!m_trajectory.isLoaded() && !m_readPending)
             errorAll(Error::ARGUMENTERROR, "Command `%s` called without a loaded trajectory", command.c_str());
-        const auto args = {words.begin()+1, words.end()};
-        m_commandMap[command.c_str()](m_trajectory, args);
+        const vector<string> args(words.begin()+1, words.end());
+        if (Incremental::get().isEnabled())
+        {
+            if (command != "msd" && command != "density")
+                errorAll(Error::ARGUMENTERROR, "Command `%s` cannot run incrementally", command.c_str());
+            Incremental::get().beginCommand(words);
+        }
+        if (Checkpoint::get().beginStep(m_step++))
+        {
+            if (m_me == 0)
+                std::cout << "Skipping `" << command << "`, finished before the checkpoint\n";
+        }
+        else if (ResultCache::get().restore(words))
+        {
+            if (m_me == 0)
+                std::cout << "Skipping `" << command << "`, results restored from the cache\n";
+        }
+        else
+        {
+            if (m_readPending)
+            {
+                m_readPending = false;
+                readTrajectory();
+            }
+            m_commandMap[command](m_trajectory, args);
+            ResultCache::get().store();
+        }
+        Checkpoint::get().endStep();
         // m_trajectory->reset();  // undo any permutation of the data?
     }
     else 
@@ -167,8 +251,6 @@ void InputReader::locateTrajFiles()
     if (subEndIdx == string::npos)
         errorAll(Error::SYNTAXERROR, "Invalid dumpfile string: %s", m_dumpfileString.c_str());
     
-    const char typeChar = m_dumpfileString[subEndIdx];
-
     string prefix = m_dumpfileString.substr(0, subStartIdx);
     string fmt = m_dumpfileString.substr(subStartIdx + 1, subEndIdx - subStartIdx - 1);
     string suffix = m_dumpfileString.substr(subEndIdx + 1);
@@ -196,24 +278,133 @@ void InputReader::locateTrajFiles()
         oss << step << suffix;
 
         fs::path filepath = m_parentDir / oss.str();
+        // Incremental: the files written so far
+        if (!fs::is_regular_file(filepath) && Incremental::get().isEnabled())
+            break;
         if (!fs::is_regular_file(filepath))
-            errorAll(Error::IOERROR, "Could not locate dumpfile %s", m_dumpfilePath.c_str());
+            errorAll(Error::IOERROR, "Could not locate dumpfile %s", filepath.c_str());
         
         m_dumpfilePathsVec.push_back(filepath);
     }
 }
 
+/*
+ Reads the frames not analyzed by the previous run, plus the window of old frames
+ before them. The end of the step range is only a limit: frames are read up to the
+ last one completely written.
+*/
+void InputReader::readNewFrames(const vector<string>& words)
+{
+    Incremental& incremental = Incremental::get();
+    incremental.setTrajectory(Checkpoint::hash(
+        words[1] + '\n' + std::to_string(m_stepRange.initStep) + ':' + std::to_string(m_stepRange.dumpStep)));
+
+    locateTrajFiles();
+    uint64_t available = 0UL;
+    if (m_dumpfilePathsVec.size() != 0)
+    {
+        // The newest file may still be being written
+        available = m_dumpfilePathsVec.size();
+        const uint64_t lastStep = m_stepRange.initStep + (available - 1) * m_stepRange.dumpStep;
+        vector<uint64_t> offsets;
+        if (m_trajectory.indexFrames(m_dumpfilePathsVec.back(), StepRange(lastStep, lastStep + m_stepRange.dumpStep, m_stepRange.dumpStep), offsets) == 0)
+            --available;
+    }
+    else if (m_dumpfilePath.empty())
+    {
+        errorAll(Error::IOERROR, "No dump files found for %s", m_dumpfileString.c_str());
+    }
+    else
+    {
+        available = m_trajectory.indexFrames(m_dumpfilePath, m_stepRange, incremental.getFrameIndex());
+    }
+
+    const uint64_t done = incremental.getFramesDone();
+    if (available < done)
+        errorAll(Error::IOERROR, "Found %llu frames, but %llu were analyzed before", available, done);
+    const uint64_t first = done - std::min(done, incremental.getWindowSteps() / m_stepRange.dumpStep);
+    if (available - first < 2)
+        errorAll(Error::IOERROR, "Found %llu frames to read; need at least two", available - first);
+    incremental.setFrames(first, available);
+    if (m_me == 0)
+        std::cout << "Incremental: " << available - done << " new frames, reading " << available - first
+                  << " from step " << m_stepRange.initStep + first * m_stepRange.dumpStep << '\n';
+
+    const StepRange range(
+        m_stepRange.initStep + first * m_stepRange.dumpStep,
+        m_stepRange.initStep + (available - 1) * m_stepRange.dumpStep,
+        m_stepRange.dumpStep);
+    if (m_dumpfilePathsVec.size() != 0)
+    {
+        const vector<fs::path> paths(m_dumpfilePathsVec.begin() + first, m_dumpfilePathsVec.begin() + available);
+        m_trajectory.read(paths, range);
+    }
+    else
+    {
+        const auto& index = incremental.getFrameIndex();
+        m_trajectory.setFrameIndex(vector<uint64_t>(index.begin() + first, index.begin() + available));
+        m_trajectory.read(m_dumpfilePath, range);
+    }
+}
+
+/*
+ traj <dumpfile> <init>-<end>:<dump> [ooc <store> <cacheMiB> [<atomsPerBlock>]] [unwrap [images|jumps]] [ragged] [soa]
+*/
 void InputReader::trajCmd(const vector<string> &words)
 {
-    if (words.size() != 3)
+    if (words.size() < 3)
         incorrectArgs(words[0], 2, words.size() - 1);
 
+    Trajectory::Unwrap unwrap = Trajectory::Unwrap::NONE;
+    for (size_t i = 3; i < words.size(); )
+    {
+        if (words[i] == "ooc")
+        {
+            if (i + 2 >= words.size())
+                errorAll(Error::SYNTAXERROR, "Syntax: traj ... ooc <store> <cacheMiB> [<atomsPerBlock>]");
+            const string store = words[i + 1];
+            const uint64_t cacheBytes = std::stoull(words[i + 2]) * 1024UL * 1024UL;
+            i += 3;
+            uint64_t atomsPerBlock = 0UL;
+            if (i < words.size() && std::isdigit(static_cast<unsigned char>(words[i][0])))
+                atomsPerBlock = std::stoull(words[i++]);
+            m_trajectory.setOutOfCore(store, cacheBytes, atomsPerBlock, 0UL);
+        }
+        else if (words[i] == "unwrap")
+        {
+            unwrap = Trajectory::Unwrap::AUTO;
+            ++i;
+            if (i < words.size() && (words[i] == "images" || words[i] == "jumps"))
+            {
+                unwrap = (words[i] == "images") ? Trajectory::Unwrap::IMAGES : Trajectory::Unwrap::JUMPS;
+                ++i;
+            }
+        }
+        else if (words[i] == "ragged")
+        {
+            m_trajectory.setRagged(true);
+            ++i;
+        }
+        else if (words[i] == "soa")
+        {
+            m_trajectory.setSoA(true);
+            ++i;
+        }
+        else
+        {
+            errorAll(Error::SYNTAXERROR, "Unknown traj option: %s", words[i].c_str());
+        }
+    }
+    m_trajectory.setUnwrap(unwrap);
+
     fs::path tmp(words[1]);
     m_parentDir = tmp.parent_path();
+    if (m_parentDir.empty())
+        m_parentDir = ".";
     if (!fs::is_directory(m_parentDir))
         errorAll(Error::IOERROR, "Could not find directory for dumpfiles: %s", m_parentDir.c_str());
 
-    m_dumpfileString = tmp.string();
+    m_dumpfileString = tmp.filename().string();
 
     // TODO: make general for single-file dumpfiles and per-timestep dumpfiles
     // For single-file dumpfiles, `m_dumpfileString` will be a single file with no % signs.
@@ -223,14 +414,110 @@ void InputReader::trajCmd(const vector<string> &words)
     // This is probably easiest to do in `readTrajectories.cpp` completely, 
     // so that `m_dumpfileString` and `m_stepRange` will be smaller and easier to pass around.
 
-    m_stepRange = parseRange(words[2]);
+    m_stepRange = StepRange(words[2]);
+    if (Incremental::get().isEnabled())
+    {
+        readNewFrames(words);
+        return;
+    }
 
     locateTrajFiles();
-    
+
+    // With a cache, the trajectory is only read once a command needs it, if one does
+    if (ResultCache::get().isEnabled())
+    {
+        ResultCache::get().addContext(words);
+        if (m_dumpfilePathsVec.size() != 0)
+            ResultCache::get().addDumpfiles(m_dumpfilePathsVec);
+        else
+            ResultCache::get().addDumpfiles({m_dumpfilePath});
+        if (!Checkpoint::get().isEnabled())
+        {
+            m_readPending = true;
+            return;
+        }
+    }
+    readTrajectory();
+}
+
+void InputReader::readTrajectory()
+{
     if (m_dumpfilePathsVec.size() != 0)
-        m_trajectory.read(m_dumpfilePathsVec);
+        m_trajectory.read(m_dumpfilePathsVec, m_stepRange);
     else
-        m_trajectory.read(m_dumpfilePath);
+        m_trajectory.read(m_dumpfilePath, m_stepRange);
+}
+
+/*
+ checkpoint <file> [every <minutes>]
+ restart <file> [every <minutes>]
+*/
+void InputReader::checkpointCmd(const vector<string> &words)
+{
+    if (words.size() != 2 && (words.size() != 4 || words[2] != "every"))
+        errorAll(Error::SYNTAXERROR, "Syntax: %s <file> [every <minutes>]", words[0].c_str());
+    if (m_step > 0)
+        errorAll(Error::SYNTAXERROR, "Command %s must come before `traj`", words[0].c_str());
+    if (Incremental::get().isEnabled())
+        errorAll(Error::ARGUMENTERROR, "Command %s cannot be combined with incremental analysis", words[0].c_str());
+
+    const double interval = words.size() == 4 ? 60.0 * std::stod(words[3]) : 1800.0;
+    if (words[0] == "restart")
+        Checkpoint::get().restart(words[1], interval);
+    else
+        Checkpoint::get().enable(words[1], interval);
+}
+
+/*
+ incremental <file> <windowSteps>
+*/
+void InputReader::incrementalCmd(const vector<string> &words)
+{
+    if (words.size() != 3)
+        errorAll(Error::SYNTAXERROR, "Syntax: incremental <file> <windowSteps>");
+    if (m_step > 0)
+        errorAll(Error::SYNTAXERROR, "Command incremental must come before `traj`");
+    if (Checkpoint::get().isEnabled())
+        errorAll(Error::ARGUMENTERROR, "Command incremental cannot be combined with checkpoints");
+    if (ResultCache::get().isEnabled())
+        errorAll(Error::ARGUMENTERROR, "Command incremental cannot be combined with a cache");
+    Incremental::get().enable(words[1], std::stoull(words[2]));
+}
+
+/*
+ cache <dir> [invalidate]
+*/
+void InputReader::cacheCmd(const vector<string> &words)
+{
+    if (words.size() != 2 && (words.size() != 3 || words[2] != "invalidate"))
+        errorAll(Error::SYNTAXERROR, "Syntax: cache <dir> [invalidate]");
+    if (m_step > 0)
+        errorAll(Error::SYNTAXERROR, "Command cache must come before `traj`");
+    if (Incremental::get().isEnabled())
+        errorAll(Error::ARGUMENTERROR, "Command cache cannot be combined with incremental analysis");
+    ResultCache::get().enable(words[1], words.size() == 3);
+}
+
+void InputReader::profileCmd(const vector<string> &words)
+{
+    if (words.size() != 3)
+        incorrectArgs(words[0], 2, words.size() - 1);
+
+    if (words[1] == "trace")
+        Instrument::get().enableTrace(words[2]);
+    else
+        errorAll(Error::ARGUMENTERROR, "Unknown profile option: %s", words[1].c_str());
+}
+
+void InputReader::reductionCmd(const vector<string> &words)
+{
+    if (words.size() != 2)
+        incorrectArgs(words[0], 1, words.size() - 1);
+
+    if (words[1] == "compensated" || words[1] == "plain")
+        Reduction::setCompensated(words[1] == "compensated");
+    else
+        errorAll(Error::ARGUMENTERROR, "Unknown reduction option: %s", words[1].c_str());
 }
 
 void InputReader::incorrectArgs(
@@ -245,82 +532,4 @@ void InputReader::incorrectArgs(
         expected_nargs,
         found_nargs);
 }
-//TODO: Make these into other constructors for StepRange!
-StepRange& InputReader::parseRange(const std::string& rangeString)
-{
-    const char message[] = "Invalid range syntax: %s\nMust be of form <init>-<end>:<dump>, e.g., 0-1000000:1000";
-
-    auto pos = rangeString.find_first_not_of("0123456789-:");
-    if (pos != string::npos)
-        errorAll(Error::SYNTAXERROR, message, rangeString);
-    
-    auto count = std::count(rangeString.begin(), rangeString.end(), '-');
-    if (count != 1)
-        errorAll(Error::SYNTAXERROR, message, rangeString);
-    
-    auto count = std::count(rangeString.begin(), rangeString.end(), ':');
-    if (count != 1)
-        errorAll(Error::SYNTAXERROR, message, rangeString);
-
-    pos = rangeString.find_first_of(":-");
-    if (pos == 0UL)
-        errorAll(Error::SYNTAXERROR, message, rangeString);
-    if (rangeString[pos] == ':')
-        errorAll(Error::SYNTAXERROR, message, rangeString);
-    auto hyphenPos = pos;
-    pos = rangeString.find(':');
-
-    StepRange stepRange;
-
-    stepRange.initStep = std::stoul(rangeString.substr(0, hyphenPos - 1));
-    stepRange.endStep = std::stoul(rangeString.substr(hyphenPos, pos - hyphenPos - 1));
-    stepRange.dumpStep = std::stoul(rangeString.substr(pos));
-
-    if (stepRange.endStep <= stepRange.initStep || stepRange.dumpStep == 0)
-        errorAll(
-            Error::ARGUMENTERROR,
-            "Invalid range: %d-%d:%d\n"
-            "End of range must be at least as large as beginning,"
-            " and the step size must be greater than 0.",
-            stepRange.initStep,
-            stepRange.endStep,
-            stepRange.dumpStep);
-    
-    return stepRange;
-}
-
-StepRange& InputReader::parseRange(const std::string& rangeString, const uint64_t dumpStep)
-{
-    const char message[] = "Invalid range syntax: %s\nMust be of form <init>-<end>, e.g., 0-1000000";
-
-    auto pos = rangeString.find_first_not_of("0123456789-");
-    if (pos != string::npos)
-        errorAll(Error::SYNTAXERROR, message, rangeString);
-    
-    auto count = std::count(rangeString.begin(), rangeString.end(), '-');
-    if (count != 1)
-        errorAll(Error::SYNTAXERROR, message, rangeString);
-
-    pos = rangeString.find('-');
-    if (pos == 0UL || pos == rangeString.size() - 1UL)
-        errorAll(Error::SYNTAXERROR, message, rangeString);
-
-    StepRange stepRange;
-
-    stepRange.initStep = std::stoul(rangeString.substr(0, pos - 1));
-    stepRange.endStep = std::stoul(rangeString.substr(pos));
-    stepRange.dumpStep = dumpStep;
-
-    if (stepRange.endStep <= stepRange.initStep || stepRange.dumpStep == 0)
-        errorAll(
-            Error::ARGUMENTERROR,
-            "Invalid range: %d-%d:%d\n"
-            "End of range must be at least as large as beginning,"
-            " and the step size must be greater than 0.",
-            stepRange.initStep,
-            stepRange.endStep,
-            stepRange.dumpStep);
-    
-    return stepRange;
-}
 }
\ No newline at end of file
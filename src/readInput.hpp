@@ -14,11 +14,23 @@
 #include <mpi.h>
 
 #include "bcastContainers.hpp"
+#include "checkpoint.hpp"
 #include "error.hpp"
+#include "incremental.hpp"
+#include "instrument.hpp"
+#include "reduce.hpp"
+#include "resultCache.hpp"
 #include "stepRange.hpp"
 #include "trajectory.hpp"
 
+#include "bondACF.hpp"
+#include "chainMSD.hpp"
+#include "chi4.hpp"
+#include "cluster.hpp"
+#include "density.hpp"
 #include "msd.hpp"   // add other analysis files as we write them
+#include "rouse.hpp"
+#include "shape.hpp"
 
 namespace MDPAT
 {
@@ -34,16 +46,21 @@ namespace MDPAT
 
         void locateTrajFiles();
         void trajCmd(const std::vector<std::string>&);
+        void readTrajectory();
+        void readNewFrames(const std::vector<std::string>&);
+        void checkpointCmd(const std::vector<std::string>&);
+        void incrementalCmd(const std::vector<std::string>&);
+        void cacheCmd(const std::vector<std::string>&);
+        void profileCmd(const std::vector<std::string>&);
+        void reductionCmd(const std::vector<std::string>&);
         void incorrectArgs(
             const std::string& command,
             const int expected_nargs,
             const int found_nargs);
-        StepRange& parseRange(const std::string&);
-        StepRange& parseRange(const std::string&, const uint64_t);
 
         typedef void(*CommandPtr)(Trajectory&, const std::vector<std::string> &);
     private:
-        std::unordered_map<const char*, CommandPtr> m_commandMap;
+        std::unordered_map<std::string, CommandPtr> m_commandMap;
         std::filesystem::path m_inputFile;
         std::filesystem::path m_parentDir;
         bool m_multipleDumpfiles = false;
@@ -54,6 +71,8 @@ namespace MDPAT
         std::filesystem::path m_dumpfilePath;
         std::vector<std::filesystem::path> m_dumpfilePathsVec;
 
+        uint64_t m_step = 0UL;  // `traj` and analysis commands run so far
+        bool m_readPending = false;  // `traj` given, read put off until a command misses the cache
         int m_me;
     };
 
@@ -88,11 +107,146 @@ be first) is column 0.
 
 ## Simulation-specific definitions
 * `NN`: The number of atoms in a molecule. Generally used for the DP of a
-coarse-grained polymer chain.
+coarse-grained polymer chain. Molecules are assumed to be contiguous in atom ID
+(IDs 1..NN are the first molecule, and so on). Give it before `traj` when
+reading out of core, so that atom blocks hold whole molecules.
 * `dim`: The number of spatial dimensions in the simulation.
 * `dt`: The timestep of the simulation. Used with `dumpStep` to determine the
 amount of simulation time between dump files.
 
+## Trajectory
+* `traj <dumpfile> <init>-<end>:<dump>`: Reads the given steps from a single
+dump file, or from one file per step if `<dumpfile>` contains a substitution
+such as `dump.%09d.txt`.
+* `traj ... ooc <store> <cacheMiB> [<atomsPerBlock>]`: Out-of-core mode. Frames
+are written to `<store>` (node-local or parallel storage) as they are read
+instead of being kept in memory, and analyses fetch blocks of atoms through an
+LRU cache of at most `<cacheMiB>` MiB per rank, reading the next block while the
+current one is analyzed. By default a block is a quarter of the cache.
+* `traj ... unwrap [images|jumps]`: Unwraps `x y z` while each frame is parsed
+and relabels them `xu yu zu`. `images` adds the image flags `ix iy iz` times the
+box vectors of the frame; `jumps` follows each atom's minimum-image displacement
+from the previous frame (atoms must move less than half a box between frames),
+starting from the first frame, whose chains are joined along their bonds if `NN`
+is given before `traj`; chain analyses (`chainmsd`, `rouse`, `shape`, `bondacf`)
+stop with an error otherwise. The default is `images` if the dump has image
+flags, else `jumps`.
+* `traj ... ragged`: For dumps whose number of atoms changes between frames
+(deposition, evaporation, reactions, region selections). Frames are stored as
+they are, and the atoms are the union of all IDs. `msd` averages over the pairs
+of frames in which an atom is present, `density` and `cluster` use each frame's
+atoms; analyses that need the same atoms in every frame (`chainmsd`, `rouse`,
+`shape`, `bondacf`, `chi4`) stop with an error. Not with `ooc` or `unwrap jumps`.
+* `traj ... soa`: Stores each frame column by column (structure of arrays), so
+that `xu` of every atom in a frame is one contiguous array. Frame analyses
+(`density`, `shape`) then load only the columns they use, which pays off when
+the dump has many more columns than the analysis needs. Atom analyses are
+unaffected. Not with `ooc` or `ragged`.
+Options may be combined, e.g. `traj ... ooc <store> <cacheMiB> unwrap`.
+
+## Structure
+* `density slab <x|y|z> <nbins> [types <t>...] [columns <x> <y> <z>] [outfile <file>]`:
+Number density profile along one axis averaged over frames, written as text
+(position, density). Columns default to `x y z` (else `xu yu zu`); positions are
+wrapped into the box of their own frame, so bins scale with the box under NPT,
+and positions are given in the box averaged over frames. In a triclinic box the
+bins run along the cell edges (fractional coordinates).
+* `density grid <nx> <ny> <nz> ...`: Number density on a 3D grid, written as raw
+binary: nx, ny, nz (uint64), the (frame-averaged) box xlo xhi ylo yhi zlo zhi
+(double; without the tilt factors of a triclinic box), then the nx*ny*nz densities (double, z
+fastest). Each thread keeps a private grid, so
+memory is about 8 bytes per cell per thread plus 8 per cell per rank.
+* `cluster cutoff <rc> [types <t>...] [columns <x> <y> <z>] [timestep <dt>] [outfile <base>]`:
+Clusters of atoms connected by distances below `rc` (minimum image, also in
+triclinic boxes), found per frame with a cell list and a concurrent union-find. Writes the number of
+clusters, the largest cluster, and the weight-average size per frame to
+`<base>.txt`, and the mean number of clusters of each size per frame to
+`<base>.hist.txt`.
+
+## Dynamics
+* `msd [types <t>...] [steps <min>-<max>] [timestep <dt>] [columns <x> <y> <z>] [outfile <file>]`:
+Mean-squared displacement over all time origins for gaps in `steps` (in
+timesteps). Columns default to `xu yu zu`.
+* `msd ... ngp`: Also writes <r^4> and the non-Gaussian parameter
+alpha_2 = d <r^4> / ((d + 2) <r^2>^2) - 1 as extra columns.
+* `msd ... vanhove <step>... [bins <n>] [rmax <r>] [vanhovefile <file>]`: Also
+writes the distribution of |dr| (self van Hove function, 4 pi r^2 G_s(r, t) in
+3D) at each given gap, binned on [0, rmax). Both options are computed in the same
+sweep as the MSD.
+* `chi4 [a <cutoff>] [types <t>...] [steps ...] [timestep ...] [columns ...] [outfile <file>]`:
+Writes time, the mean overlap <Q(t)>/N, where Q counts atoms that moved less
+than `a` (default 0.3) over a gap, and the four-point susceptibility
+chi4 = (<Q^2> - <Q>^2)/N, with averages over time origins.
+
+## Polymer analyses
+These require `NN`.
+* `chainmsd [steps <min>-<max>] [timestep <dt>] [columns <x> <y> <z>] [outfile <file>]`:
+Writes time, g1 (monomer MSD), g2 (monomer MSD relative to the chain center of
+mass), and g3 (center-of-mass MSD) in one pass over the trajectory.
+* `rouse [modes <first>-<last>] [steps ...] [timestep ...] [columns ...] [outfile <file>]`:
+Writes time and the autocorrelation of each Rouse mode
+X_p = (1/N) sum_n r_n cos(p pi (n - 1/2) / N), N = NN, averaged over chains and
+time origins. Modes default to 1 through NN - 1.
+* `bondacf [steps ...] [timestep ...] [columns ...] [outfile <file>]`: Writes
+time, P1(t), and P2(t) of the unit bond vectors between consecutive atoms of each
+chain, correlated over all time origins by FFT.
+* `shape [bins <n>] [steps ...] [timestep ...] [columns ...] [outfile <base>]`:
+Per-frame averages of Rg^2, the gyration tensor eigenvalues, the asphericity,
+and Ree^2 (`<base>.txt`), histograms of Rg^2 and of the relative asphericity
+(`<base>.hist.txt`), and the end-to-end vector autocorrelation (`<base>.acf.txt`).
+
+## Diagnostics
+* `profile trace <prefix>`: In addition to the timing summary printed at the end
+of every run, write a Chrome trace (chrome://tracing) of the timed regions to
+`<prefix>.<rank>.json` for each rank.
+
+## Reductions
+* `reduction compensated|plain`: How the sums of the commands after it are
+reduced over ranks. `compensated` carries the rounding error of every addition
+along with the sum (TwoSum), so that long sums over many ranks are as accurate
+as in twice the precision and barely depend on the number of ranks; it sends
+twice the data. Only the sum over ranks is compensated: each rank's partial sums
+(e.g., of `msd`, `density` or `chi4` over its atoms or frames) are plain. `plain`
+(the default) sums doubles directly.
+
+## Checkpoints
+* `checkpoint <file> [every <minutes>]`: Before `traj`. Saves the progress of the
+run to `<file>` every 30 minutes (or as given; 0 saves as often as possible) and
+after every command. Out of core, this includes the frames read so far and, in
+the middle of an analysis over atom blocks (`msd`, `chi4`, `chainmsd`, `rouse`,
+`bondacf`), the blocks done and every rank's partial sums.
+* `restart <file> [every <minutes>]`: Before `traj`, in place of `checkpoint` in
+the same input file, on as many ranks. Reads only the frames that were not yet in
+the out-of-core store, skips the analyses that had finished, resumes the one that
+was interrupted from its last checkpoint, and keeps saving to `<file>`. In memory,
+the trajectory is read again and only finished analyses are skipped. Not with
+`ooc` and `unwrap jumps`.
+
+## Result cache
+* `cache <dir> [invalidate]`: Before `traj`. Keeps the output files of every
+analysis in `<dir>`, keyed on the `traj` and `NN` commands, the path, size and
+modification time of each dump file, the `reduction` mode, and the words of the
+analysis command. An
+analysis whose key is in the cache is not run; its files are copied back from
+the cache instead. The trajectory is only read once an analysis is not found,
+so a deck whose analyses are all cached runs without reading it (except with
+`checkpoint`). `invalidate` runs every analysis and replaces its entry. Not
+with `incremental`.
+
+## Incremental analysis
+* `incremental <file> <windowSteps>`: Before `traj`, for a trajectory that is
+still being written. The first run analyzes all frames and saves its state to
+`<file>`; each later run reads only the frames written since, plus the old
+frames up to `<windowSteps>` timesteps before them, and adds their
+contributions to the saved sums. The end of the `traj` step range is then only
+a limit: frames are read up to the last one completely written (new
+`dump.%09d.txt` files, or frames appended to a single dump file, whose frame
+offsets are kept in `<file>` as well). Only `msd` and `density` run
+incrementally. `msd` gaps default to (and may not exceed) the window, and gaps
+without frames yet are left out of its output; `density` weights every frame by
+its cell volume. A command may not be added to the deck of an existing state;
+remove `<file>` to start over. Not with `checkpoint`, `restart` or `cache`.
+
 ## Scattering definitions
 * `binFactor`: Indicates linear scaling of the scattering vector. The
 scattering vectors are scaled by this factor, starting from `2*binFactor*pi/L`.
@@ -0,0 +1,106 @@
+#include "reduce.hpp"
+
+namespace MDPAT
+{
+    bool Reduction::s_compensated = false;
+
+    /*
+     TwoSum of every pair: s + e is exactly a + b, so the error of each addition
+     is kept along with the sum.
+    */
+    static void compensatedSum(void* in, void* inout, int* len, MPI_Datatype*)
+    {
+        const double* a = static_cast<const double*>(in);
+        double* b = static_cast<double*>(inout);
+        for (int i = 0; i < *len; ++i)
+        {
+            const double x = a[2 * i], y = b[2 * i];
+            const double s = x + y;
+            const double v = s - x;
+            const double e = (x - (s - v)) + (y - v);
+            b[2 * i] = s;
+            b[2 * i + 1] += a[2 * i + 1] + e;
+        }
+    }
+
+    Reduction::Reduction(MPI_Comm comm)
+        : m_comm(comm)
+    {
+        MPI_Comm_rank(m_comm, &m_me);
+    }
+
+    Reduction::~Reduction()
+    {
+        wait();
+    }
+
+    void Reduction::setCompensated(const bool compensated)
+    {
+        s_compensated = compensated;
+    }
+
+    bool Reduction::isCompensated()
+    {
+        return s_compensated;
+    }
+
+    void Reduction::post(void* values, const uint64_t count, MPI_Datatype type, MPI_Op op)
+    {
+        m_requests.emplace_back();
+        if (m_me == 0)
+            MPI_Ireduce(MPI_IN_PLACE, values, count, type, op, 0, m_comm, &m_requests.back());
+        else
+            MPI_Ireduce(values, nullptr, count, type, op, 0, m_comm, &m_requests.back());
+    }
+
+    static MPI_Datatype pairType = MPI_DATATYPE_NULL;
+    static MPI_Op sumOp = MPI_OP_NULL;
+
+    /*
+     MPI_Finalize deletes the attributes of MPI_COMM_SELF first, while MPI still
+     works, so an attribute there frees the pair type and TwoSum op on the way out.
+    */
+    static int freeCompensated(MPI_Comm, int, void*, void*)
+    {
+        MPI_Op_free(&sumOp);
+        MPI_Type_free(&pairType);
+        return MPI_SUCCESS;
+    }
+
+    Reduction& Reduction::addCompensated(double* values, const uint64_t count)
+    {
+        if (pairType == MPI_DATATYPE_NULL)
+        {
+            MPI_Type_contiguous(2, MPI_DOUBLE, &pairType);
+            MPI_Type_commit(&pairType);
+            MPI_Op_create(compensatedSum, 1, &sumOp);
+            int keyval = MPI_KEYVAL_INVALID;
+            MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, freeCompensated, &keyval, nullptr);
+            MPI_Comm_set_attr(MPI_COMM_SELF, keyval, nullptr);
+            MPI_Comm_free_keyval(&keyval);
+        }
+
+        m_compensated.push_back({values, std::vector<double>(2 * count, 0.0)});
+        auto& pairs = m_compensated.back().pairs;
+        for (uint64_t i = 0; i < count; ++i)
+            pairs[2 * i] = values[i];
+        for (uint64_t first = 0; first < count; first += chunk)
+            post(pairs.data() + 2 * first, std::min(chunk, count - first), pairType, sumOp);
+        return *this;
+    }
+
+    void Reduction::wait()
+    {
+        if (m_requests.empty())
+            return;
+        ScopedTimer timer(Region::REDUCTION);
+        MPI_Waitall(m_requests.size(), m_requests.data(), MPI_STATUSES_IGNORE);
+        m_requests.clear();
+
+        if (m_me == 0)
+            for (const auto& compensated : m_compensated)
+                for (uint64_t i = 0; i < compensated.pairs.size() / 2; ++i)
+                    compensated.values[i] = compensated.pairs[2 * i] + compensated.pairs[2 * i + 1];
+        m_compensated.clear();
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <type_traits>
+#include <vector>
+
+#include <mpi.h>
+
+#include "instrument.hpp"
+#include "mpiType.hpp"
+
+namespace MDPAT
+{
+    /*
+     * Sums arrays over all ranks of comm into rank 0 without blocking. `add` posts
+     * an MPI_Ireduce per chunk of the array and returns at once, so that the next
+     * block of work (e.g., the next chunk of gaps) runs while the sums travel;
+     * `wait` (or the destructor) completes every reduction posted. An array must
+     * not be touched between its `add` and `wait`, and every rank must add the
+     * same arrays in the same order. As with reduceToRoot, the sums are only
+     * meaningful on rank 0.
+     *
+     *     Reduction(MPI_COMM_WORLD).add(msd).add(nSelected).wait();
+     *
+     * With compensated sums (`reduction compensated` in readInput.hpp), doubles
+     * are reduced as (sum, error) pairs: each step adds two sums exactly with
+     * TwoSum, carrying the rounding error along, and the error is only added back
+     * on rank 0. The sum is as accurate as if it were taken in twice the precision,
+     * so it hardly depends on the number of ranks or the shape of the reduction tree.
+     * Only this sum over ranks is compensated; each rank's own sums, which the
+     * kernels accumulate before `add`, are plain.
+     */
+    class Reduction
+    {
+    public:
+        explicit Reduction(MPI_Comm comm);
+        ~Reduction();
+
+        template <typename T>
+        Reduction& add(std::vector<T>& values)
+        {
+            return add(values.data(), values.size());
+        }
+
+        template <typename T>
+        Reduction& add(T& value)
+        {
+            return add(&value, 1UL);
+        }
+
+        template <typename T>
+        Reduction& add(T* values, const uint64_t count)
+        {
+            if (count == 0)
+                return *this;
+            ScopedTimer timer(Region::REDUCTION);
+            Instrument::get().addBytes(Region::REDUCTION, count * sizeof(T));
+            if constexpr (std::is_same_v<T, double>)
+            {
+                if (s_compensated)
+                    return addCompensated(values, count);
+            }
+            for (uint64_t first = 0; first < count; first += chunk)
+                post(values + first, std::min(chunk, count - first), mpi_get_type<T>(), MPI_SUM);
+            return *this;
+        }
+
+        void wait();
+
+        // Whether sums of doubles are compensated, for every reduction posted afterwards
+        static void setCompensated(const bool);
+        static bool isCompensated();
+    private:
+        Reduction(const Reduction&) = delete;
+        Reduction& operator=(const Reduction&) = delete;
+
+        // Chunks stay well within the int counts of MPI
+        static constexpr uint64_t chunk = 1UL << 28;
+
+        void post(void* values, const uint64_t count, MPI_Datatype, MPI_Op);
+        Reduction& addCompensated(double* values, const uint64_t count);
+
+        // (sum, error) pairs of an array reduced with compensation, and where the sums go
+        struct Compensated
+        {
+            double* values;
+            std::vector<double> pairs;
+        };
+    private:
+        MPI_Comm m_comm;
+        int m_me = 0;
+        std::vector<MPI_Request> m_requests;
+        std::deque<Compensated> m_compensated;
+
+        static bool s_compensated;
+    };
+
+    /*
+     * Sums values over all ranks of comm into rank 0. The result is only
+     * meaningful on rank 0; other ranks keep their local sums.
+     */
+    template <typename T>
+    void reduceToRoot(T* values, const int count, MPI_Comm comm)
+    {
+        Reduction(comm).add(values, count).wait();
+    }
+
+    // In chunks, so that vectors longer than an int can hold are reduced too
+    template <typename T>
+    void reduceToRoot(std::vector<T>& values, MPI_Comm comm)
+    {
+        Reduction(comm).add(values).wait();
+    }
+}
@@ -0,0 +1,164 @@
+#include "resultCache.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "checkpoint.hpp"
+#include "error.hpp"
+#include "instrument.hpp"
+#include "reduce.hpp"
+
+namespace fs = std::filesystem;
+
+namespace MDPAT
+{
+
+ResultCache& ResultCache::get()
+{
+    static ResultCache instance;
+    return instance;
+}
+
+void ResultCache::enable(const fs::path& dir, const bool invalidate)
+{
+    MPI_Comm_rank(MPI_COMM_WORLD, &m_me);
+    m_enabled = true;
+    m_invalidate = invalidate;
+    m_dir = dir;
+    m_context = Checkpoint::hash("");
+
+    int ok = 1;
+    if (m_me == 0)
+    {
+        std::error_code error;
+        fs::create_directories(m_dir, error);
+        ok = fs::is_directory(m_dir);
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok)
+        errorAll(Error::IOERROR, "Could not create cache directory %s", m_dir.c_str());
+}
+
+bool ResultCache::isEnabled() const
+{
+    return m_enabled;
+}
+
+void ResultCache::addContext(const std::vector<std::string>& words)
+{
+    for (const auto& word : words)
+        m_context = Checkpoint::hash(word + '\n', m_context);
+}
+
+/*
+ A dump file is identified by its path, size and modification time, rather than by
+ hashing its contents, which would cost as much as reading it.
+*/
+void ResultCache::addDumpfiles(const std::vector<fs::path>& dumpfiles)
+{
+    if (!m_enabled || m_me != 0)
+        return;
+    for (const auto& dumpfile : dumpfiles)
+    {
+        std::error_code error;
+        const uint64_t size = fs::file_size(dumpfile, error);
+        const auto modified = fs::last_write_time(dumpfile, error).time_since_epoch().count();
+        m_context = Checkpoint::hash(dumpfile.string() + '\n' + std::to_string(size) + ' ' + std::to_string(modified) + '\n', m_context);
+    }
+}
+
+fs::path ResultCache::entryPath(const uint64_t key) const
+{
+    std::ostringstream oss;
+    oss << std::hex << std::setw(16) << std::setfill('0') << key;
+    return m_dir / oss.str();
+}
+
+bool ResultCache::restore(const std::vector<std::string>& words)
+{
+    if (!m_enabled)
+        return false;
+    ScopedTimer timer(Region::OUTPUT);
+    // The reduction mode in effect, wherever `reduction` was given relative to `cache`
+    m_command = Checkpoint::hash(Reduction::isCompensated() ? "reduction compensated\n" : "reduction plain\n", m_context);
+    for (const auto& word : words)
+        m_command = Checkpoint::hash(word + '\n', m_command);
+
+    // Manifest: one line per output, the name of its copy in the entry and its path
+    int hit = 0;
+    if (m_me == 0 && !m_invalidate)
+    {
+        const fs::path entry = entryPath(m_command);
+        std::ifstream manifest(entry / "manifest.txt");
+        hit = manifest.good();
+        std::string line;
+        while (hit && std::getline(manifest, line))
+        {
+            const auto tab = line.find('\t');
+            if (tab == std::string::npos)
+            {
+                hit = 0;
+                break;
+            }
+            std::error_code error;
+            const fs::path copy = entry / line.substr(0, tab);
+            fs::copy_file(copy, line.substr(tab + 1), fs::copy_options::overwrite_existing, error);
+            if (error)
+                hit = 0;
+            else
+                Instrument::get().addBytes(Region::OUTPUT, fs::file_size(copy, error));
+        }
+    }
+    MPI_Bcast(&hit, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    m_recording = !hit;
+    m_outputs.clear();
+    return hit;
+}
+
+void ResultCache::addOutput(const fs::path& outfile)
+{
+    if (m_recording && std::find(m_outputs.begin(), m_outputs.end(), outfile) == m_outputs.end())
+        m_outputs.push_back(outfile);
+}
+
+/*
+ The entry is put together in a temporary directory and renamed into place, so
+ that an interrupted run never leaves a partial entry behind.
+*/
+void ResultCache::store()
+{
+    if (!m_enabled || !m_recording)
+        return;
+    ScopedTimer timer(Region::OUTPUT);
+    m_recording = false;
+    if (m_me == 0)
+    {
+        const fs::path entry = entryPath(m_command);
+        const fs::path tempEntry = entry.string() + ".tmp";
+        std::error_code error;
+        fs::remove_all(tempEntry, error);
+        fs::create_directories(tempEntry, error);
+
+        std::ofstream manifest(tempEntry / "manifest.txt");
+        for (size_t i = 0; i < m_outputs.size() && !error; ++i)
+        {
+            const std::string name = std::to_string(i);
+            fs::copy_file(m_outputs[i], tempEntry / name, fs::copy_options::overwrite_existing, error);
+            manifest << name << '\t' << m_outputs[i].string() << '\n';
+        }
+        manifest.close();
+        if (!error && manifest.good())
+        {
+            fs::remove_all(entry, error);
+            fs::rename(tempEntry, entry, error);
+        }
+        if (error || !manifest.good())
+            errorOne(Error::IOERROR, "Could not store results in cache %s", m_dir.c_str());
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+namespace MDPAT
+{
+/*
+ * On-disk cache of the output files of analysis commands (see `cache` in
+ * readInput.hpp). An entry is keyed on everything its results depend on: the
+ * `traj` and `NN` commands before it, the size and modification time of every
+ * dump file read, the `reduction` mode in effect, and the command's own words
+ * (columns, types, steps, ...). It
+ * is a directory named after the key, holding a copy of each output file and a
+ * manifest of where they were written, so that a hit copies the files back in
+ * place of running the command.
+ */
+class ResultCache
+{
+public:
+    static ResultCache& get();
+
+    // Collective. Cache entries in dir; with `invalidate`, recompute and replace them
+    void enable(const std::filesystem::path& dir, const bool invalidate);
+    bool isEnabled() const;
+
+    // Commands the results depend on (`traj`, `NN`), and the dump files they read
+    void addContext(const std::vector<std::string>& words);
+    void addDumpfiles(const std::vector<std::filesystem::path>&);
+
+    // Collective. Copies the command's outputs back if they are cached; false on a miss
+    bool restore(const std::vector<std::string>& words);
+    // Rank 0. An output file of the command being run (see writeColumns)
+    void addOutput(const std::filesystem::path&);
+    // Collective. After a miss, saves the outputs of the command under its key
+    void store();
+private:
+    ResultCache() = default;
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    std::filesystem::path entryPath(const uint64_t key) const;
+private:
+    bool m_enabled = false;
+    bool m_invalidate = false;
+    int m_me = 0;
+    std::filesystem::path m_dir;
+
+    uint64_t m_context = 0UL;  // rank 0: hash of the commands and dump files so far
+    uint64_t m_command = 0UL;  // key of the command being run
+    bool m_recording = false;
+    std::vector<std::filesystem::path> m_outputs;
+};
+
+}
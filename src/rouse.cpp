@@ -0,0 +1,118 @@
+#include "rouse.hpp"
+
+#include <filesystem>
+
+#include <mpi.h>
+
+#include "analysisArgs.hpp"
+#include "atomBlocks.hpp"
+#include "error.hpp"
+#include "fft.hpp"
+#include "instrument.hpp"
+#include "msd.hpp"
+#include "output.hpp"
+#include "reduce.hpp"
+
+namespace MDPAT
+{
+    uint64_t rouseBlock(
+        const double* data,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t nFrames,
+        const uint64_t chainLength,
+        const std::vector<int>& coordCols,
+        const uint64_t firstMode,
+        const uint64_t lastMode,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        double* corr)
+    {
+        const uint64_t numGaps = maxGap - minGap + 1;
+        const uint64_t numModes = lastMode - firstMode + 1;
+        const uint64_t nChains = nAtoms / chainLength;
+        const uint64_t atomStride = nCols * nFrames;
+
+#pragma omp parallel
+        {
+            DCT dct(chainLength);
+            std::vector<double> positions(chainLength);
+            std::vector<double> amplitudes(chainLength);
+            std::vector<double> modes(numModes * nFrames);  // MODES x FRAMES
+
+#pragma omp for reduction(+ : corr[:numModes * numGaps])
+            for (uint64_t chain = 0; chain < nChains; ++chain)
+            {
+                const double* chainData = data + chain * chainLength * atomStride;
+                for (const int col : coordCols)
+                {
+                    for (uint64_t frame = 0; frame < nFrames; ++frame)
+                    {
+                        const double* frameData = chainData + col * nFrames + frame;
+                        for (uint64_t atom = 0; atom < chainLength; ++atom)
+                            positions[atom] = frameData[atom * atomStride];
+                        dct.forward(positions.data(), amplitudes.data());
+                        for (uint64_t p = firstMode; p <= lastMode; ++p)
+                            modes[(p - firstMode) * nFrames + frame] = amplitudes[p] / chainLength;
+                    }
+
+                    for (uint64_t mode = 0; mode < numModes; ++mode)
+                        accumulateCorrelation(modes.data() + mode * nFrames, nFrames, minGap, maxGap, corr + mode * numGaps);
+                }
+            }
+        }
+        return nChains;
+    }
+
+    void rouseModes(Trajectory& traj, const std::vector<std::string>& words)
+    {
+        int me = 0;
+        MPI_Comm_rank(MPI_COMM_WORLD, &me);
+
+        const AnalysisArgs args("rouse", words, {"modes", "steps", "timestep", "columns", "outfile"});
+        const auto coordCols = unwrappedColumns(traj, args);
+        const double timestep = args.getDouble("timestep", 1.0);
+        const std::filesystem::path outfile = args.getString("outfile", "rouse.txt");
+
+        const uint64_t nn = chainLength(traj, "rouse");
+        if (nn < 2 && !args.has("modes"))
+            errorAll(Error::ARGUMENTERROR, "Command rouse needs NN > 1 for internal modes");
+        const auto modeRange = args.getRange("modes", 1UL, nn - 1);
+        const uint64_t firstMode = modeRange.first, lastMode = modeRange.second;
+        if (lastMode >= nn)
+            errorAll(Error::ARGUMENTERROR, "Rouse modes must be less than NN (%llu)", (unsigned long long)nn);
+        const uint64_t numModes = lastMode - firstMode + 1;
+
+        const uint64_t nFrames = traj.getStepsGlobal().size();
+        const uint64_t nCols = traj.getColumnLabels().size();
+        const uint64_t delta = dumpStep(traj);
+        const auto gaps = gapRange(traj, args);
+        const uint64_t minGap = gaps.first, maxGap = gaps.second;
+        const uint64_t numGaps = maxGap - minGap + 1;
+
+        std::vector<double> corr(numModes * numGaps, 0.0);
+        uint64_t nChains = 0UL;
+
+        forEachAtomBlock(traj, nn, [&](const double* data, const uint64_t nAtoms) {
+            nChains += rouseBlock(data, nAtoms, nCols, nFrames, nn, coordCols, firstMode, lastMode, minGap, maxGap, corr.data());
+        }, Accumulators().add(corr).add(nChains));
+
+        Reduction(MPI_COMM_WORLD).add(corr).add(nChains).wait();
+
+        if (me == 0)
+        {
+            ScopedTimer timer(Region::OUTPUT);
+            std::vector<double> columns((numModes + 1) * numGaps);
+            for (uint64_t gap = minGap; gap <= maxGap; ++gap)
+            {
+                const uint64_t i = gap - minGap;
+                columns[i] = gap * delta * timestep;
+                for (uint64_t mode = 0; mode < numModes; ++mode)
+                    columns[(mode + 1) * numGaps + i] = corr[mode * numGaps + i] / nChains / (nFrames - gap);
+            }
+            if (writeColumns(columns, numModes + 1, outfile))
+                errorOne(Error::IOERROR, "Couldn't write to file %s", outfile.c_str());
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "trajectory.hpp"
+
+namespace MDPAT
+{
+    /*
+     * rouse [modes <first>-<last>] [steps <min>-<max>] [timestep <dt>] [columns <x> <y> <z>] [outfile <file>]
+     * Writes time and the autocorrelation <X_p(t0 + t) . X_p(t0)> of each Rouse mode
+     * X_p = (1/N) sum_n r_n cos(p pi (n - 1/2) / N) over chains of N = NN atoms.
+     * Modes default to 1 through N - 1.
+     */
+    void rouseModes(
+        Trajectory&,
+        const std::vector<std::string>&
+    );
+
+    /*
+     * Accumulates corr[(p - firstMode) * numGaps + gap - minGap] over the chains of
+     * a block laid out as ATOMS x PROPS x FRAMES holding whole chains. The modes of
+     * each chain and frame come from one DCT-II. Returns the number of chains.
+     */
+    uint64_t rouseBlock(
+        const double* data,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t nFrames,
+        const uint64_t chainLength,
+        const std::vector<int>& coordCols,
+        const uint64_t firstMode,
+        const uint64_t lastMode,
+        const uint64_t minGap,
+        const uint64_t maxGap,
+        double* corr);
+}
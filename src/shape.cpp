@@ -0,0 +1,297 @@
+#include "shape.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+
+#include <mpi.h>
+
+#include "analysisArgs.hpp"
+#include "atomBlocks.hpp"
+#include "error.hpp"
+#include "instrument.hpp"
+#include "msd.hpp"
+#include "output.hpp"
+#include "reduce.hpp"
+#include "splitValues.hpp"
+#include "stridedView.hpp"
+
+namespace MDPAT
+{
+    std::array<double, 3> symmetricEigenvalues(const std::array<double, 6>& a)
+    {
+        const auto [xx, yy, zz, xy, xz, yz] = a;
+        std::array<double, 3> eig;
+
+        const double offDiag = xy * xy + xz * xz + yz * yz;
+        if (offDiag == 0.0)
+        {
+            eig = {xx, yy, zz};
+        }
+        else
+        {
+            // Trigonometric solution of the characteristic cubic
+            const double q = (xx + yy + zz) / 3.0;
+            const double p = std::sqrt(((xx - q) * (xx - q) + (yy - q) * (yy - q) + (zz - q) * (zz - q) + 2.0 * offDiag) / 6.0);
+            const double bxx = (xx - q) / p, byy = (yy - q) / p, bzz = (zz - q) / p;
+            const double bxy = xy / p, bxz = xz / p, byz = yz / p;
+            const double det = bxx * (byy * bzz - byz * byz) - bxy * (bxy * bzz - byz * bxz) + bxz * (bxy * byz - byy * bxz);
+            const double r = std::clamp(det / 2.0, -1.0, 1.0);
+            const double phi = std::acos(r) / 3.0;
+            eig[0] = q + 2.0 * p * std::cos(phi);
+            eig[2] = q + 2.0 * p * std::cos(phi + 2.0 * M_PI / 3.0);
+            eig[1] = 3.0 * q - eig[0] - eig[2];
+        }
+        std::sort(eig.begin(), eig.end(), std::greater<double>());
+        return eig;
+    }
+
+    void shapeBlock(
+        const double* data,
+        const uint64_t nFrames,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t atomStride,
+        const uint64_t colStride,
+        const uint64_t chainLength,
+        const std::vector<int>& coordCols,
+        ChainShape* shapes)
+    {
+        const uint64_t nChains = nAtoms / chainLength;
+
+#pragma omp parallel for collapse(2) schedule(static)
+        for (uint64_t frame = 0; frame < nFrames; ++frame)
+        {
+            for (uint64_t chain = 0; chain < nChains; ++chain)
+            {
+                // The chain's atoms x columns, and its coordinates over atoms
+                const StridedView2<const double> atoms(
+                    data + frame * nAtoms * nCols + chain * chainLength * atomStride, chainLength, nCols, atomStride, colStride);
+                const StridedView<const double> x = atoms.col(coordCols[0]), y = atoms.col(coordCols[1]), z = atoms.col(coordCols[2]);
+
+                double mx = 0.0, my = 0.0, mz = 0.0;
+#pragma omp simd reduction(+ : mx, my, mz)
+                for (uint64_t atom = 0; atom < chainLength; ++atom)
+                {
+                    mx += x[atom];
+                    my += y[atom];
+                    mz += z[atom];
+                }
+                mx /= chainLength;
+                my /= chainLength;
+                mz /= chainLength;
+
+                // Centered second moments, so large unwrapped coordinates don't cancel
+                double sxx = 0.0, syy = 0.0, szz = 0.0, sxy = 0.0, sxz = 0.0, syz = 0.0;
+#pragma omp simd reduction(+ : sxx, syy, szz, sxy, sxz, syz)
+                for (uint64_t atom = 0; atom < chainLength; ++atom)
+                {
+                    const double dx = x[atom] - mx;
+                    const double dy = y[atom] - my;
+                    const double dz = z[atom] - mz;
+                    sxx += dx * dx;
+                    syy += dy * dy;
+                    szz += dz * dz;
+                    sxy += dx * dy;
+                    sxz += dx * dz;
+                    syz += dy * dz;
+                }
+
+                ChainShape& shape = shapes[frame * nChains + chain];
+                const std::array<double, 6> tensor = {
+                    sxx / chainLength, syy / chainLength, szz / chainLength,
+                    sxy / chainLength, sxz / chainLength, syz / chainLength};
+                shape.rg2 = tensor[0] + tensor[1] + tensor[2];
+                shape.lambda = symmetricEigenvalues(tensor);
+
+                const uint64_t last = chainLength - 1;
+                shape.ree = {x[last] - x[0], y[last] - y[0], z[last] - z[0]};
+            }
+        }
+    }
+
+    /*
+     * Redistributes end-to-end vectors from frames (as analyzed) to chains, so that
+     * each rank holds the whole time series of its chains as CHAINS x DIMS x FRAMES.
+     */
+    static std::vector<double> transposeEndToEnd(
+        const std::vector<ChainShape>& shapes,
+        const std::vector<uint64_t>& myFrames,
+        const uint64_t nChains,
+        const uint64_t nFrames)
+    {
+        int me = 0, nprocs = 1;
+        MPI_Comm_rank(MPI_COMM_WORLD, &me);
+        MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+        ScopedTimer timer(Region::TRANSPOSE);
+
+        // Which frames every rank holds
+        const int nMyFrames = myFrames.size();
+        std::vector<int> frameCounts(nprocs), frameDispls(nprocs, 0);
+        MPI_Allgather(&nMyFrames, 1, MPI_INT, frameCounts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+        for (int r = 1; r < nprocs; ++r)
+            frameDispls[r] = frameDispls[r - 1] + frameCounts[r - 1];
+        std::vector<uint64_t> allFrames(nFrames);
+        MPI_Allgatherv(
+            myFrames.data(), nMyFrames, MPI_UINT64_T,
+            allFrames.data(), frameCounts.data(), frameDispls.data(), MPI_UINT64_T, MPI_COMM_WORLD);
+
+        std::vector<int> sendCounts(nprocs), sendDispls(nprocs), recvCounts(nprocs), recvDispls(nprocs);
+        std::vector<double> sendBuffer(3 * nMyFrames * nChains);
+        uint64_t pos = 0;
+        for (int r = 0; r < nprocs; ++r)
+        {
+            const auto [firstChain, nRankChains] = splitValues(nChains, r, nprocs);
+            sendDispls[r] = pos;
+            for (int frame = 0; frame < nMyFrames; ++frame)
+                for (uint64_t chain = firstChain; chain < firstChain + nRankChains; ++chain)
+                    for (int dim = 0; dim < 3; ++dim)
+                        sendBuffer[pos++] = shapes[frame * nChains + chain].ree[dim];
+            sendCounts[r] = pos - sendDispls[r];
+        }
+
+        const auto [myFirstChain, nMyChains] = splitValues(nChains, me, nprocs);
+        for (int r = 0; r < nprocs; ++r)
+        {
+            recvCounts[r] = 3 * frameCounts[r] * nMyChains;
+            recvDispls[r] = 3 * frameDispls[r] * nMyChains;
+        }
+        std::vector<double> recvBuffer(3 * nFrames * nMyChains);
+        MPI_Alltoallv(
+            sendBuffer.data(), sendCounts.data(), sendDispls.data(), MPI_DOUBLE,
+            recvBuffer.data(), recvCounts.data(), recvDispls.data(), MPI_DOUBLE, MPI_COMM_WORLD);
+        Instrument::get().addBytes(Region::TRANSPOSE, sendBuffer.size() * sizeof(double));
+
+        std::vector<double> series(3 * nFrames * nMyChains);
+        for (uint64_t i = 0; i < nFrames; ++i)
+            for (uint64_t chain = 0; chain < nMyChains; ++chain)
+                for (int dim = 0; dim < 3; ++dim)
+                    series[(chain * 3 + dim) * nFrames + allFrames[i]] = recvBuffer[(i * nMyChains + chain) * 3 + dim];
+        return series;
+    }
+
+    void chainShape(Trajectory& traj, const std::vector<std::string>& words)
+    {
+        int me = 0;
+        MPI_Comm_rank(MPI_COMM_WORLD, &me);
+
+        const AnalysisArgs args("shape", words, {"bins", "steps", "timestep", "columns", "outfile"});
+        const auto coordCols = unwrappedColumns(traj, args);
+        if (coordCols.size() != 3)
+            errorAll(Error::ARGUMENTERROR, "Command shape needs three coordinate columns");
+        const uint64_t numBins = args.getUInt("bins", 100UL);
+        const double timestep = args.getDouble("timestep", 1.0);
+        const std::string outfile = args.getString("outfile", "shape");
+
+        const uint64_t nn = chainLength(traj, "shape");
+        const uint64_t nAtoms = traj.getNumAtoms();
+        const uint64_t nChains = nAtoms / nn;
+        const uint64_t nCols = traj.getColumnLabels().size();
+        const auto& steps = traj.getStepsGlobal();
+        const uint64_t nFrames = steps.size();
+        const uint64_t delta = dumpStep(traj);
+        const auto gaps = gapRange(traj, args);
+        const uint64_t minGap = gaps.first, maxGap = gaps.second;
+        const uint64_t numGaps = maxGap - minGap + 1;
+
+        // One fused pass over this rank's frames
+        std::vector<ChainShape> shapes;
+        std::vector<uint64_t> myFrames;
+        forEachFrameBlock(traj, [&](const double* data, const uint64_t firstFrame, const uint64_t nBlockFrames,
+                                    const uint64_t atomStride, const uint64_t colStride) {
+            shapes.resize(shapes.size() + nBlockFrames * nChains);
+            shapeBlock(data, nBlockFrames, nAtoms, nCols, atomStride, colStride, nn, coordCols, shapes.data() + myFrames.size() * nChains);
+            for (uint64_t frame = firstFrame; frame < firstFrame + nBlockFrames; ++frame)
+                myFrames.push_back(frame);
+        });
+
+        // Per-frame averages, already laid out as output columns after the time column
+        constexpr uint64_t nAverages = 6;
+        std::vector<double> averages(nAverages * nFrames, 0.0);
+        double maxRg2 = 0.0;
+        for (uint64_t i = 0; i < myFrames.size(); ++i)
+        {
+            const uint64_t frame = myFrames[i];
+            for (uint64_t chain = 0; chain < nChains; ++chain)
+            {
+                const ChainShape& s = shapes[i * nChains + chain];
+                averages[frame] += s.rg2;
+                averages[nFrames + frame] += s.lambda[0];
+                averages[2 * nFrames + frame] += s.lambda[1];
+                averages[3 * nFrames + frame] += s.lambda[2];
+                averages[4 * nFrames + frame] += s.lambda[0] - 0.5 * (s.lambda[1] + s.lambda[2]);
+                averages[5 * nFrames + frame] += s.ree[0] * s.ree[0] + s.ree[1] * s.ree[1] + s.ree[2] * s.ree[2];
+                maxRg2 = std::max(maxRg2, s.rg2);
+            }
+        }
+        MPI_Allreduce(MPI_IN_PLACE, &maxRg2, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+        // Histograms of Rg^2 over [0, max] and of b / Rg^2 over [0, 1]
+        const double rg2Width = maxRg2 > 0.0 ? maxRg2 / numBins : 1.0;
+        const double asphWidth = 1.0 / numBins;
+        std::vector<double> hist(2 * numBins, 0.0);
+        for (const auto& s : shapes)
+        {
+            hist[std::min<uint64_t>(s.rg2 / rg2Width, numBins - 1)] += 1.0;
+            const double relAsph = s.rg2 > 0.0 ? (s.lambda[0] - 0.5 * (s.lambda[1] + s.lambda[2])) / s.rg2 : 0.0;
+            hist[numBins + std::min<uint64_t>(relAsph / asphWidth, numBins - 1)] += 1.0;
+        }
+
+        // Averages and histograms are summed while the end-to-end vectors are
+        // redistributed and correlated over the chains this rank then holds
+        Reduction reduction(MPI_COMM_WORLD);
+        reduction.add(averages).add(hist);
+        std::vector<double> acf(numGaps, 0.0);
+        {
+            const auto series = transposeEndToEnd(shapes, myFrames, nChains, nFrames);
+            ScopedTimer timer(Region::ANALYSIS);
+            for (uint64_t i = 0; i < series.size() / nFrames; ++i)
+                accumulateCorrelation(series.data() + i * nFrames, nFrames, minGap, maxGap, acf.data());
+        }
+
+        reduction.add(acf).wait();
+
+        if (me == 0)
+        {
+            ScopedTimer timer(Region::OUTPUT);
+            const double nSamples = static_cast<double>(nChains) * nFrames;
+
+            std::vector<double> frameColumns(nFrames);
+            double meanRee2 = 0.0;
+            for (uint64_t frame = 0; frame < nFrames; ++frame)
+            {
+                frameColumns[frame] = steps[frame] * timestep;
+                meanRee2 += averages[5 * nFrames + frame] / nSamples;
+            }
+            for (auto& value : averages)
+                value /= nChains;
+            frameColumns.insert(frameColumns.end(), averages.begin(), averages.end());
+
+            std::vector<double> histColumns(4 * numBins);
+            for (uint64_t bin = 0; bin < numBins; ++bin)
+            {
+                histColumns[bin] = (bin + 0.5) * rg2Width;
+                histColumns[numBins + bin] = hist[bin] / nSamples / rg2Width;
+                histColumns[2 * numBins + bin] = (bin + 0.5) * asphWidth;
+                histColumns[3 * numBins + bin] = hist[numBins + bin] / nSamples / asphWidth;
+            }
+
+            std::vector<double> acfColumns(3 * numGaps);
+            for (uint64_t gap = minGap; gap <= maxGap; ++gap)
+            {
+                const uint64_t i = gap - minGap;
+                acfColumns[i] = gap * delta * timestep;
+                acfColumns[numGaps + i] = acf[i] / nChains / (nFrames - gap);
+                acfColumns[2 * numGaps + i] = acfColumns[numGaps + i] / meanRee2;
+            }
+
+            if (writeColumns(frameColumns, 1 + nAverages, outfile + ".txt"))
+                errorOne(Error::IOERROR, "Couldn't write to file %s.txt", outfile.c_str());
+            if (writeColumns(histColumns, 4, outfile + ".hist.txt"))
+                errorOne(Error::IOERROR, "Couldn't write to file %s.hist.txt", outfile.c_str());
+            if (writeColumns(acfColumns, 3, outfile + ".acf.txt"))
+                errorOne(Error::IOERROR, "Couldn't write to file %s.acf.txt", outfile.c_str());
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "trajectory.hpp"
+
+namespace MDPAT
+{
+    /*
+     * shape [bins <n>] [steps <min>-<max>] [timestep <dt>] [columns <x> <y> <z>] [outfile <base>]
+     * For chains of NN atoms, writes
+     *     <base>.txt:      time, <Rg^2>, <lambda1>, <lambda2>, <lambda3>, <b>, <Ree^2> per frame
+     *     <base>.hist.txt: histograms of Rg^2 and of the relative asphericity b / Rg^2
+     *     <base>.acf.txt:  time, <Ree(t0 + t) . Ree(t0)>, and the same divided by <Ree^2>
+     * where lambda1 >= lambda2 >= lambda3 are the eigenvalues of the gyration tensor
+     * and b = lambda1 - (lambda2 + lambda3) / 2 is the asphericity.
+     */
+    void chainShape(
+        Trajectory&,
+        const std::vector<std::string>&
+    );
+
+    // Rg^2, lambda1, lambda2, lambda3, and the end-to-end vector of one chain in one frame
+    struct ChainShape
+    {
+        double rg2;
+        std::array<double, 3> lambda;
+        std::array<double, 3> ree;
+    };
+
+    /*
+     * Shapes of every chain in every frame of a block, stored as
+     * shapes[frame * nChains + chain]; column c of atom a in frame f is
+     * data[f * nAtoms * nCols + a * atomStride + c * colStride].
+     */
+    void shapeBlock(
+        const double* data,
+        const uint64_t nFrames,
+        const uint64_t nAtoms,
+        const uint64_t nCols,
+        const uint64_t atomStride,
+        const uint64_t colStride,
+        const uint64_t chainLength,
+        const std::vector<int>& coordCols,
+        ChainShape* shapes);
+
+    // Eigenvalues of a symmetric 3x3 matrix {xx, yy, zz, xy, xz, yz}, in decreasing order
+    std::array<double, 3> symmetricEigenvalues(const std::array<double, 6>&);
+}
@@ -10,7 +10,7 @@ namespace MDPAT
      * Returns the first index and number of values for process me when split evenly
      * among nprocs processes.
      */
-    std::pair<uint64_t, uint64_t> splitValues(uint64_t totalNumValues, int me, int nProcs)
+    inline std::pair<uint64_t, uint64_t> splitValues(uint64_t totalNumValues, int me, int nProcs)
     {
         std::pair<uint64_t, uint64_t> pair;
         const auto div = std::div(totalNumValues, nProcs);
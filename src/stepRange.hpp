@@ -25,7 +25,7 @@ public:
     using difference_type = std::ptrdiff_t;
     using value_type = uint64_t;
     using pointer = size_t;
-    using reference = value_type&;
+    using reference = const value_type&;
 public:
     StepIterator (pointer idx, value_type iStep, value_type eStep, value_type dStep, value_type nStep)
         : index(idx), initStep(iStep), endStep(eStep), dumpStep(dStep), nSteps(nStep), step(iStep + dStep * idx) {}
@@ -60,7 +60,7 @@ public:
         return tmp;
     }
 
-    reference operator[](pointer idx) { return step + dumpStep * idx; }
+    value_type operator[](pointer idx) const { return step + dumpStep * idx; }
 
     friend bool operator==(const StepIterator& a, const StepIterator& b) { return (a.step == b.step) && (a.index == b.index); }
     friend bool operator!=(const StepIterator& a, const StepIterator& b) { return (a.step != b.step) && (a.index != b.index); }
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace MDPAT
+{
+/*
+ * Zero-copy view of n elements spaced `stride` apart, e.g., one column of one
+ * atom over frames. With stride 1 (the axis is innermost) loops over it
+ * vectorize as plain arrays; otherwise as gathers.
+ */
+template <typename T>
+class StridedView
+{
+public:
+    StridedView() = default;
+    StridedView(T* data, const uint64_t size, const uint64_t stride) :
+        m_data(data),
+        m_size(size),
+        m_stride(stride)
+    {
+    }
+
+    T& operator[](const uint64_t i) const
+    {
+        return m_data[i * m_stride];
+    }
+
+    uint64_t size() const
+    {
+        return m_size;
+    }
+
+    uint64_t stride() const
+    {
+        return m_stride;
+    }
+
+    bool isContiguous() const
+    {
+        return m_stride == 1;
+    }
+
+    T* data() const
+    {
+        return m_data;
+    }
+private:
+    T* m_data = nullptr;
+    uint64_t m_size = 0UL;
+    uint64_t m_stride = 1UL;
+};
+
+/*
+ * Zero-copy view of an n0 x n1 slice with the strides of any layout, e.g., a
+ * column over frames x atoms. `(i, j)` is element [i * stride0 + j * stride1];
+ * `row(i)` and `col(j)` are the 1D views along either index.
+ */
+template <typename T>
+class StridedView2
+{
+public:
+    StridedView2() = default;
+    StridedView2(T* data, const uint64_t size0, const uint64_t size1, const uint64_t stride0, const uint64_t stride1) :
+        m_data(data),
+        m_size{size0, size1},
+        m_stride{stride0, stride1}
+    {
+    }
+
+    T& operator()(const uint64_t i, const uint64_t j) const
+    {
+        return m_data[i * m_stride[0] + j * m_stride[1]];
+    }
+
+    StridedView<T> row(const uint64_t i) const
+    {
+        return StridedView<T>(m_data + i * m_stride[0], m_size[1], m_stride[1]);
+    }
+
+    StridedView<T> col(const uint64_t j) const
+    {
+        return StridedView<T>(m_data + j * m_stride[1], m_size[0], m_stride[0]);
+    }
+
+    uint64_t size(const int dim) const
+    {
+        return m_size[dim];
+    }
+
+    uint64_t stride(const int dim) const
+    {
+        return m_stride[dim];
+    }
+
+    T* data() const
+    {
+        return m_data;
+    }
+private:
+    T* m_data = nullptr;
+    uint64_t m_size[2] = {0UL, 0UL};
+    uint64_t m_stride[2] = {0UL, 0UL};
+};
+
+}
@@ -0,0 +1,40 @@
+#include "topology.hpp"
+
+namespace MDPAT
+{
+    static NodeTopology splitNodes()
+    {
+        NodeTopology topology;
+        int me = 0;
+        MPI_Comm_rank(MPI_COMM_WORLD, &me);
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, me, MPI_INFO_NULL, &topology.nodeComm);
+        MPI_Comm_rank(topology.nodeComm, &topology.localRank);
+        MPI_Comm_size(topology.nodeComm, &topology.localSize);
+
+        // Local rank 0 is the lowest world rank of its node; a scan over these
+        // leaders numbers the nodes and gives each its first rank in `comm`
+        const int isLeader = topology.localRank == 0;
+        int leaders[2] = {isLeader, isLeader ? topology.localSize : 0};
+        int before[2] = {0, 0};
+        MPI_Exscan(leaders, before, 2, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+        if (me == 0)
+            before[0] = before[1] = 0;
+        MPI_Bcast(before, 2, MPI_INT, 0, topology.nodeComm);
+        topology.node = before[0];
+        MPI_Allreduce(&isLeader, &topology.numNodes, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+        int sizes[2] = {topology.localSize, -topology.localSize};
+        MPI_Allreduce(MPI_IN_PLACE, sizes, 2, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+        topology.uniform = sizes[0] == -sizes[1];
+
+        MPI_Comm_split(MPI_COMM_WORLD, 0, before[1] + topology.localRank, &topology.comm);
+        MPI_Comm_split(MPI_COMM_WORLD, topology.localRank, topology.node, &topology.crossComm);
+        return topology;
+    }
+
+    const NodeTopology& nodeTopology()
+    {
+        static const NodeTopology topology = splitNodes();
+        return topology;
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <mpi.h>
+
+namespace MDPAT
+{
+    /*
+     * The ranks grouped by node. `comm` holds every rank, numbered node by node
+     * (nodes in the order of their lowest rank in MPI_COMM_WORLD, so that rank 0
+     * stays rank 0), so that values split among its ranks with splitValues give
+     * each node one contiguous range. `nodeComm` holds the ranks of my node and
+     * `crossComm` the ranks with my local rank on every node, ordered by node.
+     */
+    struct NodeTopology
+    {
+        MPI_Comm comm = MPI_COMM_WORLD;
+        MPI_Comm nodeComm = MPI_COMM_SELF;
+        MPI_Comm crossComm = MPI_COMM_WORLD;
+        int node = 0;
+        int numNodes = 1;
+        int localRank = 0;
+        int localSize = 1;
+        bool uniform = true;  // every node has localSize ranks
+    };
+
+    // Collective over MPI_COMM_WORLD on the first call
+    const NodeTopology& nodeTopology();
+}
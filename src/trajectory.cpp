@@ -1,10 +1,15 @@
 #include "trajectory.hpp"
 
 #include <algorithm>
+#include <climits>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <string_view>
 
 #include <mpi.h>
 
@@ -12,9 +17,14 @@
 #include "mpi_stub.h"
 #endif
 
+#include "bcastContainers.hpp"
+#include "checkpoint.hpp"
 #include "error.hpp"
+#include "instrument.hpp"
+#include "layout.hpp"
+#include "lineReader.hpp"
 #include "splitValues.hpp"
-#include "mdbin.h"
+#include "topology.hpp"
 
 using std::string;
 using std::vector;
@@ -29,13 +39,24 @@ Trajectory::Trajectory()
 
 Trajectory::~Trajectory()
 {
-    std::filesystem::remove(std::filesystem::path(m_tempfileName));
+    m_blockCache.reset();
+    if (m_me == 0)
+    {
+        std::filesystem::remove(std::filesystem::path(m_tempfileName));
+        if (m_outOfCore)
+            std::filesystem::remove(m_storePath);
+    }
 }
 
+/*
+ Ranks are numbered node by node, so that the frames read, and every range of an
+ axis split among the ranks, are contiguous within a node.
+*/
 void Trajectory::initMPI()
 {
-    MPI_Comm_rank(MPI_COMM_WORLD, &m_me);
-    MPI_Comm_size(MPI_COMM_WORLD, &m_nprocs);
+    m_comm = nodeTopology().comm;
+    MPI_Comm_rank(m_comm, &m_me);
+    MPI_Comm_size(m_comm, &m_nprocs);
 }
 
 const bool Trajectory::isLoaded() const
@@ -43,10 +64,15 @@ const bool Trajectory::isLoaded() const
     return m_loaded;
 }
 
+/*
+ Returns the index of the column within PROPS, or -1 if there is no such column.
+*/
 const int Trajectory::getColumnIndex(const char* label) const
 {
     auto it = std::find(m_columnLabels.begin(), m_columnLabels.end(), label);
-    return 0;
+    if (it == m_columnLabels.end())
+        return -1;
+    return it - m_columnLabels.begin();
 }
 
 const bool Trajectory::hasColumn(const char* label) const
@@ -74,25 +100,332 @@ const Trajectory::AxisOrder& Trajectory::getAxisOrder() const
     return m_axisOrder;
 }
 
-const std::vector<uint64_t>& Trajectory::getSteps const
+const std::vector<uint64_t>& Trajectory::getSteps() const
 {
     return m_steps;
 }
 
-const std::vector<uint64_t>& Trajectory::getStepsGlobal const
+const std::vector<uint64_t>& Trajectory::getStepsGlobal() const
 {
     return m_stepsGlobal;
 }
 
+const uint64_t Trajectory::getFirstIndex() const
+{
+    return m_firstIndex;
+}
+
+const uint64_t Trajectory::getNumAtoms() const
+{
+    return m_natoms;
+}
+
+const std::vector<uint64_t>& Trajectory::getAtomIds() const
+{
+    return m_atomIndex.ids();
+}
+
+/*
+ Call before `read`. Frames may hold different numbers of atoms: local frames
+ are stored one after another, frame i as rows [offsets[i], offsets[i + 1]) of
+ `getFrameOffsets()`, sorted by ID, with the ID of each row in `getRowIds()`.
+*/
+void Trajectory::setRagged(const bool ragged)
+{
+    m_ragged = ragged;
+}
+
+const bool Trajectory::isRagged() const
+{
+    return m_ragged;
+}
+
+/*
+ Call before `read`. Each frame is parsed straight into column-major order,
+ FRAMES x PROPS x ATOMS, so that a column of a frame (e.g., `xu` of every atom)
+ is one contiguous array and kernels that use a few of many columns load only
+ those. Frame kernels follow `getFrameOrder`, which `permuteDims` returns to.
+*/
+void Trajectory::setSoA(const bool soa)
+{
+    m_soa = soa;
+}
+
+const bool Trajectory::isSoA() const
+{
+    return m_soa;
+}
+
+// Layout of frames as read: FRAMES x ATOMS x PROPS, or FRAMES x PROPS x ATOMS with SoA
+Trajectory::AxisOrder Trajectory::getFrameOrder() const
+{
+    if (m_soa)
+        return {Axis::FRAMES, Axis::PROPS, Axis::ATOMS};
+    return {Axis::FRAMES, Axis::ATOMS, Axis::PROPS};
+}
+
+const std::vector<uint64_t>& Trajectory::getFrameOffsets() const
+{
+    return m_frameOffsets;
+}
+
+const std::vector<uint64_t>& Trajectory::getRowIds() const
+{
+    return m_rowIds;
+}
+
+/*
+ Collective, for ragged trajectories. Redistributes the rows by atom: this rank
+ gets an even share of the atoms (slots of `getAtomIds()`), and for each of them
+ the frames it is in, ascending, with its row in each. Atom a has the samples
+ [offsets[a], offsets[a + 1]) of frames and rows; returns the first atom slot.
+*/
+uint64_t Trajectory::gatherAtomSeries(
+    std::vector<uint64_t>& offsets,
+    std::vector<uint64_t>& frames,
+    std::vector<double>& rows) const
+{
+    ScopedTimer timer(Region::TRANSPOSE);
+    const uint64_t ncols = m_ncols;
+    const uint64_t nRows = m_rowIds.size();
+    const auto [firstAtom, nAtoms] = splitValues(m_natoms, m_me, m_nprocs);
+
+    // Owner of every atom slot under splitValues
+    const uint64_t quot = m_natoms / m_nprocs, rem = m_natoms % m_nprocs;
+    auto owner = [quot, rem](const uint64_t slot) {
+        return (slot < rem * (quot + 1)) ? slot / (quot + 1) : rem + (slot - rem * (quot + 1)) / quot;
+    };
+
+    std::vector<uint64_t> slots(nRows);
+    std::vector<int> sendCounts(m_nprocs, 0), sendDispls(m_nprocs, 0), recvCounts(m_nprocs), recvDispls(m_nprocs, 0);
+    for (uint64_t row = 0; row < nRows; ++row)
+    {
+        slots[row] = m_atomIndex.slot(m_rowIds[row]);
+        ++sendCounts[owner(slots[row])];
+    }
+    MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, m_comm);
+    for (int r = 1; r < m_nprocs; ++r)
+    {
+        sendDispls[r] = sendDispls[r - 1] + sendCounts[r - 1];
+        recvDispls[r] = recvDispls[r - 1] + recvCounts[r - 1];
+    }
+    const uint64_t nRecv = recvDispls.back() + recvCounts.back();
+
+    // (slot, global frame) pairs and rows, bucketed by owner in frame order
+    std::vector<uint64_t> sendKeys(2 * nRows);
+    std::vector<double> sendRows(nRows * ncols);
+    std::vector<int> next(sendDispls);
+    for (uint64_t frame = 0; frame + 1 < m_frameOffsets.size(); ++frame)
+    {
+        for (uint64_t row = m_frameOffsets[frame]; row < m_frameOffsets[frame + 1]; ++row)
+        {
+            const uint64_t pos = next[owner(slots[row])]++;
+            sendKeys[2 * pos] = slots[row];
+            sendKeys[2 * pos + 1] = m_firstIndex + frame;
+            std::memcpy(&sendRows[pos * ncols], &m_data[row * ncols], ncols * sizeof(double));
+        }
+    }
+
+    std::vector<uint64_t> recvKeys(2 * nRecv);
+    std::vector<double> recvRows(nRecv * ncols);
+    auto scaled = [](std::vector<int> v, const int factor) {
+        for (auto& x : v)
+            x *= factor;
+        return v;
+    };
+    MPI_Alltoallv(
+        sendKeys.data(), scaled(sendCounts, 2).data(), scaled(sendDispls, 2).data(), MPI_UINT64_T,
+        recvKeys.data(), scaled(recvCounts, 2).data(), scaled(recvDispls, 2).data(), MPI_UINT64_T, m_comm);
+    MPI_Alltoallv(
+        sendRows.data(), scaled(sendCounts, ncols).data(), scaled(sendDispls, ncols).data(), MPI_DOUBLE,
+        recvRows.data(), scaled(recvCounts, ncols).data(), scaled(recvDispls, ncols).data(), MPI_DOUBLE, m_comm);
+    Instrument::get().addBytes(Region::TRANSPOSE, nRecv * (2 * sizeof(uint64_t) + ncols * sizeof(double)));
+
+    // Counting sort by atom; stable, and ranks hold ascending frame ranges, so frames stay ascending
+    offsets.assign(nAtoms + 1, 0UL);
+    for (uint64_t i = 0; i < nRecv; ++i)
+        ++offsets[recvKeys[2 * i] - firstAtom + 1];
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    frames.resize(nRecv);
+    rows.resize(nRecv * ncols);
+    std::vector<uint64_t> fill(offsets.begin(), offsets.end() - 1);
+    for (uint64_t i = 0; i < nRecv; ++i)
+    {
+        const uint64_t pos = fill[recvKeys[2 * i] - firstAtom]++;
+        frames[pos] = recvKeys[2 * i + 1];
+        std::memcpy(&rows[pos * ncols], &recvRows[i * ncols], ncols * sizeof(double));
+    }
+    return firstAtom;
+}
+
+const Box& Trajectory::getBox() const
+{
+    return m_box;
+}
+
+const Box& Trajectory::getBox(const uint64_t frame) const
+{
+    return m_boxesGlobal[frame];
+}
+
+const bool Trajectory::isTriclinic() const
+{
+    return m_triclinic;
+}
+
+const bool Trajectory::hasFixedBox() const
+{
+    return m_fixedBox;
+}
+
+void Trajectory::setAtomsPerMolecule(const uint64_t atomsPerMolecule)
+{
+    m_atomsPerMolecule = atomsPerMolecule;
+}
+
+const uint64_t Trajectory::getAtomsPerMolecule() const
+{
+    return m_atomsPerMolecule;
+}
+
+/*
+ Call before `read`. Unwraps the wrapped columns x y z of every frame as it is
+ parsed and relabels them xu yu zu. IMAGES adds the image flags ix iy iz times
+ the box vectors of the frame; JUMPS follows each atom's minimum-image
+ displacements between consecutive frames, starting from a first frame whose
+ chains are joined along their bonds if NN is set; AUTO uses the image flags if
+ the dump has them.
+*/
+void Trajectory::setUnwrap(const Unwrap unwrap)
+{
+    m_unwrap = unwrap;
+}
+
+const bool Trajectory::chainsWhole(const uint64_t length) const
+{
+    return m_unwrap != Unwrap::JUMPS || m_wholeChainLength == length;
+}
+
+const bool Trajectory::isOutOfCore() const
+{
+    return m_outOfCore;
+}
+
+BlockCache& Trajectory::getBlockCache()
+{
+    if (!m_blockCache)
+        errorAll(Error::ARGUMENTERROR, "Trajectory is not loaded out of core");
+    return *m_blockCache;
+}
+
+/*
+ Call before `read`. Instead of holding every local frame in memory, each frame
+ is written to a store at `storePath` as soon as it is parsed, and analyses fetch
+ atom or frame blocks through an LRU cache of at most `cacheBytes` bytes.
+*/
+void Trajectory::setOutOfCore(
+    const std::filesystem::path& storePath,
+    const uint64_t cacheBytes,
+    const uint64_t atomsPerBlock,
+    const uint64_t framesPerBlock)
+{
+    m_outOfCore = true;
+    m_storePath = storePath;
+    m_cacheBytes = cacheBytes;
+    m_atomsPerBlock = atomsPerBlock;
+    m_framesPerBlock = framesPerBlock;
+}
+
 const double & Trajectory::operator[](std::size_t idx) const
 {
     return m_data[idx];
 }
 
+/*
+ Element strides of each axis, indexed FRAMES, ATOMS, PROPS, for data laid out
+ in `order` with the given lengths (in that order); the last axis is contiguous.
+*/
+Trajectory::Strides Trajectory::layoutStrides(const AxisOrder& order, const Dimensions& lengths)
+{
+    Strides strides;
+    strides[static_cast<int>(order[2]) - 1] = 1UL;
+    strides[static_cast<int>(order[1]) - 1] = lengths[2];
+    strides[static_cast<int>(order[0]) - 1] = lengths[1] * lengths[2];
+    return strides;
+}
+
+Trajectory::Strides Trajectory::getStrides() const
+{
+    return layoutStrides(m_axisOrder, m_axisLengths);
+}
+
+/*
+ Views resolve their strides here, once, from the current axis order, so a kernel
+ written against them runs unchanged after `permuteDims`; indices are local
+ (along the split axis, counted from `getFirstIndex`). A view is invalidated by
+ the next `permuteDims` or `read`. They need the data in memory and not ragged.
+
+ column(label): frames x atoms of one column (split along PROPS, one this rank holds)
+ atom(i):       frames x columns of one atom
+ frame(t):      atoms x columns of one frame
+*/
+StridedView2<const double> Trajectory::column(const char* label) const
+{
+    const int col = getColumnIndex(label);
+    if (col < 0)
+        errorAll(Error::ARGUMENTERROR, "No column %s in dump file", label);
+    checkViewable();
+    // Labels name global columns; split along PROPS, a rank holds only some of them
+    uint64_t localCol = col;
+    if (m_axisOrder[0] == Axis::PROPS)
+    {
+        if (localCol < m_firstIndex || localCol - m_firstIndex >= localLength(Axis::PROPS))
+            errorOne(Error::ARGUMENTERROR, "Column %s is not on this rank", label);
+        localCol -= m_firstIndex;
+    }
+    const Strides strides = getStrides();
+    return StridedView2<const double>(
+        m_data.data() + localCol * strides[2], localLength(Axis::FRAMES), localLength(Axis::ATOMS), strides[0], strides[1]);
+}
+
+StridedView2<const double> Trajectory::atom(const uint64_t atom) const
+{
+    checkViewable();
+    const Strides strides = getStrides();
+    return StridedView2<const double>(
+        m_data.data() + atom * strides[1], localLength(Axis::FRAMES), localLength(Axis::PROPS), strides[0], strides[2]);
+}
+
+StridedView2<const double> Trajectory::frame(const uint64_t frame) const
+{
+    checkViewable();
+    const Strides strides = getStrides();
+    return StridedView2<const double>(
+        m_data.data() + frame * strides[0], localLength(Axis::ATOMS), localLength(Axis::PROPS), strides[1], strides[2]);
+}
+
+void Trajectory::checkViewable() const
+{
+    if (m_outOfCore || m_ragged)
+        errorAll(Error::ARGUMENTERROR, "Views need a trajectory in memory with the same atoms in every frame");
+}
+
+uint64_t Trajectory::localLength(const Axis axis) const
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        if (m_axisOrder[i] == axis)
+            return m_axisLengths[i];
+    }
+    return 0UL;
+}
+
 void Trajectory::read(
     const std::filesystem::path& dumpfile,
     const StepRange& stepRange)
 {
+    ScopedTimer timer(Region::READ);
+
     // Remove tempfile, if it exists
     if (m_me == 0 && std::filesystem::is_regular_file(m_tempfilePath))
         std::filesystem::remove(m_tempfilePath);
@@ -110,123 +443,610 @@ void Trajectory::read(
         m_steps[i] = stepRange.initStep + (firstFrame + i) * stepRange.dumpStep;
 
     // Assume dumpfile exists and open, start reading, throw if it doesn't
-    std::ifstream instream(dumpfile);
+    std::ifstream instream;
+    openDump(instream, dumpfile);
     if (!instream.good())
-        errorAll(Error::IOERROR, "Could not open file %s", m_dumpfilePath.c_str());
+        errorAll(Error::IOERROR, "Could not open file %s", dumpfile.c_str());
+
+    // With an index of the frames, go straight to my first one
+    if (firstFrame < m_frameIndex.size())
+        instream.seekg(m_frameIndex[firstFrame]);
+    m_frameIndex.clear();
     
     // Loop through my expected timesteps
+    beginStoreRounds();
     bool headerDone = false;
-    for (const auto step : m_steps)
+    uint64_t steadyAllocations = 0UL;
+    m_boxes.resize(numFrames);
+    for (size_t i = 0; i < m_steps.size(); ++i)
     {
+        m_arena.reset();
+        const uint64_t allocations = heapAllocations();
+        const auto step = m_steps[i];
         uint64_t dumpfileTimestep = getTimestep(instream);
         while (dumpfileTimestep < step && instream.good())
         {
-            skipDumpHeader(instream);
-            skipDumpBody(instream);
+            m_arena.reset();
+            skipDumpBody(instream, skipDumpHeader(instream));
+            dumpfileTimestep = getTimestep(instream);
         }
 
         if (dumpfileTimestep != step)
-            errorAll(Error::IOERROR, "Specified timestep %ull not found in dump file", step);
+            errorOne(Error::IOERROR, "Specified timestep %llu not found in dump file", step);
 
+        uint64_t frameAtoms = m_natoms;
         if (headerDone)
         {
-            skipDumpHeader(instream);
+            frameAtoms = skipDumpHeader(instream, &m_boxes[i]);
         }
         else
         {
             readDumpHeader(instream);
             headerDone = true;
-            reserve();
-            m_data.resize(numFrames * m_natoms * m_ncols);
+            allocateFrames(numFrames);
+            prepareUnwrap();
+            m_boxes[i] = m_box;
+            frameAtoms = m_natoms;
         }
-        readDumpBody(instream);
+        readOrSkipFrame(instream, i, frameAtoms, firstFrame + i);
+        if (i > 0)
+            steadyAllocations += heapAllocations() - allocations;
     }
-
-    // If all successful, set member vars
-    MPI_Barrier(MPI_COMM_WORLD);
-    m_loaded = true;
-
-    m_axisOrder = {Trajectory::Axis::FRAMES, Trajectory::Axis::ATOMS, Trajectory::Axis::PROPS};
-    m_axisLengths = {numFrames, m_natoms, m_columnLabels.size()};
-    m_axisLengthsGlobal = {m_stepsGlobal.size(), m_natoms, m_columnLabels.size()};
-
+    endStoreRounds(numFrames);
+    Instrument::get().addBytes(Region::READ, instream.tellg());
+    Instrument::get().addAllocations(Region::READ, steadyAllocations);
     instream.close();
+
+    finishRead();
 }
 
-void Trajectory::read(const std::filesystem::path&)
+void Trajectory::read(const std::filesystem::path& dumpfile)
 {
+    ScopedTimer timer(Region::READ);
+
     // TODO: Before each read, clear vectors, remove file, etc. in `clean` method
     // Remove tempfile, if it exists
     if (m_me == 0 && std::filesystem::is_regular_file(m_tempfilePath))
         std::filesystem::remove(m_tempfilePath);
 
     // Assume dumpfile exists and open, start reading, throw if it doesn't
-    std::ifstream instream(dumpfile);
+    std::ifstream instream;
+    openDump(instream, dumpfile);
     if (!instream.good())
-        errorAll(Error::IOERROR, "Could not open file %s", m_dumpfilePath.c_str());
+        errorAll(Error::IOERROR, "Could not open file %s", dumpfile.c_str());
     
     // Loop through entire file once and determine the timesteps (no StepRange)
+    m_stepsGlobal.clear();
     if (m_me == 0)
     {
-        step = getTimestep(instream);
+        uint64_t step = getTimestep(instream);
         if (step == ULLONG_MAX)
-            errorAll(Error::IOERROR, "Unexpected end of file %s", m_dumpfilePath.c_str());
+            errorOne(Error::IOERROR, "Unexpected end of file %s", dumpfile.c_str());
         
         m_stepsGlobal.push_back(step);
         readDumpHeader(instream);
-        skipDumpBody(instream);
+        skipDumpBody(instream, m_natoms);
         while (instream.good())
         {
+            m_arena.reset();
             step = getTimestep(instream);
-            m_stepsGlobal.push_back(step);
             if (step == ULLONG_MAX)
                 break;
-            skipDumpHeader(instream);
-            skipDumpBody(instream);
+            m_stepsGlobal.push_back(step);
+            skipDumpBody(instream, skipDumpHeader(instream));
         }
     }
-    MPI_Barrier(MPI_COMM_WORLD);
-    bcast(m_stepsGlobal, MPI_UINT64_T, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&m_natoms, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&m_ncols, 1, MPI_UINT32_T, 0, MPI_COMM_WORLD);
-    MPI_Bcast(m_box.data(), m_box.size(), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Barrier(m_comm);
+    bcast(m_stepsGlobal, MPI_UINT64_T, 0, m_comm);
+    bcast(m_columnLabels, 0, m_comm);
+    MPI_Bcast(&m_natoms, 1, MPI_UINT64_T, 0, m_comm);
+    MPI_Bcast(&m_ncols, 1, MPI_UINT32_T, 0, m_comm);
     m_nframes = m_stepsGlobal.size();
-    reserve();
-    m_data.resize(numFrames * m_natoms * m_ncols);
 
-    auto [firstFrame, numFrames] = splitValues(m_nframes, m_me, m_nprocs);
+    const auto [firstFrame, numFrames] = splitValues(m_nframes, m_me, m_nprocs);
     m_steps.resize(numFrames);
     for (size_t i = 0; i < numFrames; ++i)
         m_steps[i] = m_stepsGlobal[i + firstFrame];
+    allocateFrames(numFrames);
+    prepareUnwrap();
 
+    instream.clear();
     instream.seekg(0);
     for (size_t i = 0; i < firstFrame; ++i)
     {
-        skipDumpHeader(instream);
-        skipDumpBody(instream);
+        m_arena.reset();
+        skipDumpBody(instream, skipDumpHeader(instream));
     }
 
+    uint64_t steadyAllocations = 0UL;
+    m_boxes.resize(numFrames);
+    beginStoreRounds();
     for (size_t i = 0; i < numFrames; ++i)
     {
-        skipDumpHeader(instream);
-        readDumpBody(instream, i * m_natoms * m_ncols);
+        m_arena.reset();
+        const uint64_t allocations = heapAllocations();
+        const uint64_t frameAtoms = skipDumpHeader(instream, &m_boxes[i]);
+        readOrSkipFrame(instream, i, frameAtoms, firstFrame + i);
+        if (i > 0)
+            steadyAllocations += heapAllocations() - allocations;
     }
+    endStoreRounds(numFrames);
+    Instrument::get().addBytes(Region::READ, instream.tellg());
+    Instrument::get().addAllocations(Region::READ, steadyAllocations);
     instream.close();
-    MPI_Barrier(MPI_COMM_WORLD);
+
+    finishRead();
+}
+
+/*
+ Collective. Rank 0 scans the dump file from the last frame in `offsets` (from
+ the start if it is empty) and appends the byte offset of each further frame of
+ stepRange, up to the end of the range or the first frame that is not completely
+ written yet. Returns the number of frames indexed.
+*/
+uint64_t Trajectory::indexFrames(
+    const std::filesystem::path& dumpfile,
+    const StepRange& stepRange,
+    std::vector<uint64_t>& offsets)
+{
+    ScopedTimer timer(Region::READ);
+    if (m_me == 0)
+    {
+        std::ifstream instream;
+        openDump(instream, dumpfile);
+        if (!instream.good())
+            errorOne(Error::IOERROR, "Could not open file %s", dumpfile.c_str());
+
+        // The last frame indexed is scanned again, which checks that it is still there
+        if (!offsets.empty())
+        {
+            instream.seekg(offsets.back());
+            offsets.pop_back();
+        }
+
+        // A frame is complete if the file does not end before its last atom's newline
+        while (offsets.size() < stepRange.nSteps)
+        {
+            m_arena.reset();
+            const uint64_t position = instream.tellg();
+            LineReader lines(instream, m_arena);
+            std::string_view line, word;
+            while (word.empty() && lines.next(line) && !instream.eof())
+                word = nextToken(line);
+            if (word.empty())
+                break;
+            if (word != "ITEM:" || nextToken(line) != "TIMESTEP")
+                errorOne(Error::SYNTAXERROR, "Syntax error while reading dump file");
+            uint64_t step = 0UL;
+            if (!lines.next(line) || instream.eof() || !parseNumber(nextToken(line), step))
+                break;
+
+            uint64_t natoms = 0UL;
+            bool atoms = false;
+            while (!atoms && lines.next(line) && !instream.eof())
+            {
+                if (nextToken(line) != "ITEM:")
+                    continue;
+                const std::string_view item = nextToken(line);
+                if (item == "NUMBER" && lines.next(line))
+                    parseNumber(nextToken(line), natoms);  // ITEM: NUMBER OF ATOMS
+                else if (item == "ATOMS")
+                    atoms = true;
+            }
+            if (!atoms)
+                break;
+            skipDumpBody(instream, natoms);
+            if (instream.eof() || step > stepRange.endStep)
+                break;
+
+            const uint64_t expected = stepRange.initStep + offsets.size() * stepRange.dumpStep;
+            if (step > expected)
+                errorOne(Error::IOERROR, "Specified timestep %llu not found in dump file %s", expected, dumpfile.c_str());
+            if (step == expected)
+                offsets.push_back(position);
+        }
+        instream.close();
+    }
+    bcast(offsets, MPI_UINT64_T, 0, m_comm);
+    return offsets.size();
+}
+
+void Trajectory::setFrameIndex(const std::vector<uint64_t>& offsets)
+{
+    m_frameIndex = offsets;
+}
+
+/*
+ One dump file per frame, e.g., `dump.%09d.txt`; each rank opens only its own files.
+*/
+void Trajectory::read(
+    const std::vector<std::filesystem::path>& dumpfiles,
+    const StepRange& stepRange)
+{
+    ScopedTimer timer(Region::READ);
+
+    if (m_me == 0 && std::filesystem::is_regular_file(m_tempfilePath))
+        std::filesystem::remove(m_tempfilePath);
+
+    if (dumpfiles.size() != stepRange.nSteps)
+        errorAll(Error::ARGUMENTERROR, "Expected %llu dump files, found %llu", stepRange.nSteps, dumpfiles.size());
+
+    m_nframes = stepRange.nSteps;
+    m_stepsGlobal.resize(m_nframes);
+    for (size_t i = 0; i < m_stepsGlobal.size(); ++i)
+        m_stepsGlobal[i] = stepRange.initStep + i * stepRange.dumpStep;
+
+    const auto [firstFrame, numFrames] = splitValues(m_nframes, m_me, m_nprocs);
+    m_steps.resize(numFrames);
+    for (size_t i = 0; i < numFrames; ++i)
+        m_steps[i] = m_stepsGlobal[i + firstFrame];
+
+    // One stream for all files, so that its buffer is set up once
+    uint64_t nbytes = 0UL, steadyAllocations = 0UL;
+    std::ifstream instream;
+    m_boxes.resize(numFrames);
+    beginStoreRounds();
+    for (size_t i = 0; i < numFrames; ++i)
+    {
+        m_arena.reset();
+        const uint64_t allocations = heapAllocations();
+        const auto& dumpfile = dumpfiles[firstFrame + i];
+        openDump(instream, dumpfile);
+        if (!instream.good())
+            errorOne(Error::IOERROR, "Could not open file %s", dumpfile.c_str());
+
+        if (getTimestep(instream) != m_steps[i])
+            errorOne(Error::IOERROR, "Specified timestep %llu not found in dump file %s", m_steps[i], dumpfile.c_str());
+
+        uint64_t frameAtoms = m_natoms;
+        if (i == 0)
+        {
+            readDumpHeader(instream);
+            allocateFrames(numFrames);
+            prepareUnwrap();
+            m_boxes[i] = m_box;
+            frameAtoms = m_natoms;
+        }
+        else
+        {
+            frameAtoms = skipDumpHeader(instream, &m_boxes[i]);
+        }
+        readOrSkipFrame(instream, i, frameAtoms, firstFrame + i);
+        nbytes += instream.tellg();
+        instream.close();
+        if (i > 0)
+            steadyAllocations += heapAllocations() - allocations;
+    }
+    endStoreRounds(numFrames);
+    Instrument::get().addBytes(Region::READ, nbytes);
+    Instrument::get().addAllocations(Region::READ, steadyAllocations);
+
+    finishRead();
+}
+
+void Trajectory::read(const std::vector<std::filesystem::path>& dumpfiles)
+{
+    if (dumpfiles.size() == 0)
+        errorAll(Error::ARGUMENTERROR, "No dump files given");
+    read(dumpfiles, StepRange(0UL, dumpfiles.size() - 1UL, 1UL));
+}
+
+/*
+ Opens a dump file on a reused stream. The stream reads through a buffer of the
+ trajectory's, set before the first open, so that reopening it for every file
+ does not allocate a new one.
+*/
+void Trajectory::openDump(std::ifstream& instream, const std::filesystem::path& dumpfile)
+{
+    if (!instream.is_open() && m_streamBuffer.empty())
+        m_streamBuffer.resize(streamBufferSize);
+    if (!instream.is_open())
+        instream.rdbuf()->pubsetbuf(m_streamBuffer.data(), m_streamBuffer.size());
+    instream.clear();
+    instream.open(dumpfile);
+}
+
+/*
+ Sizes m_data for numFrames local frames, or for a single frame buffer when
+ reading out of core (in which case the store is opened here as well).
+*/
+void Trajectory::allocateFrames(const uint64_t numFrames)
+{
+    m_atomIndex.clear();
+    if (m_ragged)
+    {
+        if (m_outOfCore)
+            errorAll(Error::ARGUMENTERROR, "Ragged trajectories cannot be read out of core");
+        if (m_soa)
+            errorAll(Error::ARGUMENTERROR, "Ragged trajectories cannot be read as SoA");
+        m_data.clear();
+        m_rowIds.clear();
+        m_frameOffsets.assign(1, 0UL);
+    }
+    else if (m_outOfCore)
+    {
+        if (m_soa)
+            errorAll(Error::ARGUMENTERROR, "Trajectories read out of core cannot be read as SoA");
+        m_data.assign(m_natoms * m_ncols, 0.0);
+        openStore();
+    }
+    else
+    {
+        reserve();
+        m_data.resize(numFrames * m_natoms * m_ncols);
+    }
+}
+
+uint64_t Trajectory::frameOffset(const uint64_t localFrame) const
+{
+    if (m_outOfCore)
+        return 0UL;
+    return localFrame * m_natoms * m_ncols;
+}
+
+/*
+ Collective. Shares the dimensions (a rank with no frames never read a header)
+ and sets the member vars once every rank has read its frames.
+*/
+void Trajectory::finishRead()
+{
+    // splitValues always gives rank 0 at least one frame
+    bcast(m_columnLabels, 0, m_comm);
+    MPI_Bcast(&m_natoms, 1, MPI_UINT64_T, 0, m_comm);
+    MPI_Bcast(&m_ncols, 1, MPI_UINT32_T, 0, m_comm);
+    shareAtomIds();
+    gatherBoxes();
+
+    int unwrap = static_cast<int>(m_unwrap);
+    MPI_Bcast(&unwrap, 1, MPI_INT, 0, m_comm);
+    m_unwrap = static_cast<Unwrap>(unwrap);
+    MPI_Bcast(&m_wholeChainLength, 1, MPI_UINT64_T, 0, m_comm);
+    MPI_Bcast(m_coordCols.data(), 3, MPI_INT, 0, m_comm);
+    if (m_unwrap == Unwrap::JUMPS && m_outOfCore && Checkpoint::get().isRestarting())
+        errorAll(Error::ARGUMENTERROR, "Out-of-core reads unwrapped with jumps cannot be restarted; use image flags");
+    if (m_unwrap == Unwrap::JUMPS && m_nprocs > 1)
+        shiftUnwrapped();
+    m_unwrapReady = false;
+    std::vector<double>().swap(m_firstWrapped);
+    std::vector<double>().swap(m_lastWrapped);
+    std::vector<double>().swap(m_lastUnwrapped);
+
+    m_axisOrder = getFrameOrder();
+    m_firstIndex = splitAxis(m_stepsGlobal.size(), 1UL).first;
+    m_splitGranularity = 1UL;
+    m_axisLengths = {m_steps.size(), m_natoms, m_columnLabels.size()};
+    m_axisLengthsGlobal = {m_stepsGlobal.size(), m_natoms, m_columnLabels.size()};
+    if (m_soa)
+    {
+        std::swap(m_axisLengths[1], m_axisLengths[2]);
+        std::swap(m_axisLengthsGlobal[1], m_axisLengthsGlobal[2]);
+    }
+
+    if (m_outOfCore)
+    {
+        closeStore();
+        m_axisLengths[0] = 0UL;
+        std::vector<double>().swap(m_data);
+    }
+    if (m_ragged)
+    {
+        m_data.shrink_to_fit();
+        m_rowIds.shrink_to_fit();
+    }
+    Instrument::get().addElements(Region::READ, m_ragged ? m_data.size() : m_steps.size() * m_natoms * m_ncols);
+
+    MPI_Barrier(m_comm);
+    m_loaded = true;
+}
+
+/*
+ Collective. Ranks built their ID index from their own first frames; all must
+ hold the same atoms, and ranks without frames take rank 0's index.
+*/
+void Trajectory::shareAtomIds()
+{
+    if (m_ragged)
+    {
+        shareRaggedAtomIds();
+        return;
+    }
+    std::vector<uint64_t> ids = m_atomIndex.ids();
+    bcast(ids, MPI_UINT64_T, 0, m_comm);
+    int mismatch = !m_steps.empty() && ids != m_atomIndex.ids();
+    MPI_Allreduce(MPI_IN_PLACE, &mismatch, 1, MPI_INT, MPI_LOR, m_comm);
+    if (mismatch)
+        errorAll(Error::IOERROR, "Frames hold different sets of atom ids");
+    if (m_steps.empty())
+        m_atomIndex.build(ids);
+}
+
+/*
+ Collective. The atoms of a ragged trajectory are the union of the IDs in all
+ frames; getNumAtoms() counts them.
+*/
+void Trajectory::shareRaggedAtomIds()
+{
+    std::vector<uint64_t> mine(m_rowIds);
+    std::sort(mine.begin(), mine.end());
+    mine.erase(std::unique(mine.begin(), mine.end()), mine.end());
+
+    const int count = mine.size();
+    std::vector<int> counts(m_nprocs), displs(m_nprocs, 0);
+    MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, m_comm);
+    for (int r = 1; r < m_nprocs; ++r)
+        displs[r] = displs[r - 1] + counts[r - 1];
+    std::vector<uint64_t> ids(displs.back() + counts.back());
+    MPI_Allgatherv(
+        mine.data(), count, MPI_UINT64_T,
+        ids.data(), counts.data(), displs.data(), MPI_UINT64_T, m_comm);
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    m_atomIndex.build(ids);
+    m_natoms = ids.size();
+}
+
+/*
+ Collective. Every rank gets the boxes of all frames: they are tiny next to the
+ frames themselves, and frames move between ranks (permuteDims, out-of-core frame
+ blocks), so analyses look boxes up by global frame index.
+*/
+void Trajectory::gatherBoxes()
+{
+    std::vector<int> counts(m_nprocs), displs(m_nprocs);
+    for (int r = 0; r < m_nprocs; ++r)
+    {
+        const auto [firstFrame, numFrames] = splitValues(m_stepsGlobal.size(), r, m_nprocs);
+        counts[r] = numFrames * Box::packedSize;
+        displs[r] = firstFrame * Box::packedSize;
+    }
+
+    std::vector<double> packed(m_boxes.size() * Box::packedSize);
+    for (size_t i = 0; i < m_boxes.size(); ++i)
+        m_boxes[i].pack(&packed[i * Box::packedSize]);
+    std::vector<double> packedGlobal(m_stepsGlobal.size() * Box::packedSize);
+    MPI_Allgatherv(
+        packed.data(), packed.size(), MPI_DOUBLE,
+        packedGlobal.data(), counts.data(), displs.data(), MPI_DOUBLE, m_comm);
+
+    m_boxesGlobal.resize(m_stepsGlobal.size());
+    m_triclinic = false;
+    m_fixedBox = true;
+    for (size_t i = 0; i < m_boxesGlobal.size(); ++i)
+    {
+        m_boxesGlobal[i].unpack(&packedGlobal[i * Box::packedSize]);
+        m_triclinic |= m_boxesGlobal[i].triclinic;
+        m_fixedBox &= m_boxesGlobal[i] == m_boxesGlobal[0];
+    }
+    m_box = m_boxesGlobal.empty() ? Box() : m_boxesGlobal[0];
+    std::vector<Box>().swap(m_boxes);
+}
+
+/*
+ Each rank opens the store independently and writes its frames at their global
+ offsets; rank 0 adds the header in `closeStore` once the dimensions are known.
+*/
+void Trajectory::openStore()
+{
+    if (m_storeOpen)
+        return;
+    MPI_File_open(MPI_COMM_SELF, m_storePath.c_str(), MPI_MODE_CREATE | MPI_MODE_RDWR, MPI_INFO_NULL, &m_storeFile);
+    m_storeOpen = true;
+}
+
+void Trajectory::storeFrame(const uint64_t globalFrame)
+{
+    ScopedTimer timer(Region::TEMPFILE_WRITE);
+    const uint64_t offset = tempfileHeaderSize + globalFrame * m_data.size() * sizeof(double);
+    writeDoubles(m_storeFile, offset, m_data.data(), m_data.size());
+    Instrument::get().addBytes(Region::TEMPFILE_WRITE, m_data.size() * sizeof(double));
+}
+
+void Trajectory::closeStore()
+{
+    if (m_storeOpen)
+        MPI_File_close(&m_storeFile);
+    m_storeOpen = false;
+    MPI_Barrier(m_comm);
+
+    if (m_me == 0)
+    {
+        std::fstream outstream(m_storePath, std::ios::in | std::ios::out | std::ios::binary);
+        if (!outstream.good())
+            errorOne(Error::IOERROR, "Couldn't write to file %s", m_storePath.c_str());
+        writeTempfileHeader(outstream);
+        outstream.close();
+    }
+    MPI_Barrier(m_comm);
+
+    // By default, a block is a quarter of the cache. Atom blocks hold whole molecules.
+    const uint64_t quarterCache = m_cacheBytes / 4 / sizeof(double);
+    if (m_atomsPerBlock == 0)
+        m_atomsPerBlock = std::max<uint64_t>(1UL, quarterCache / (m_axisLengthsGlobal[0] * m_axisLengthsGlobal[2]));
+    if (m_atomsPerMolecule > 1)
+        m_atomsPerBlock = std::max(1UL, m_atomsPerBlock / m_atomsPerMolecule) * m_atomsPerMolecule;
+    if (m_framesPerBlock == 0)
+        m_framesPerBlock = std::max<uint64_t>(1UL, quarterCache / (m_axisLengthsGlobal[1] * m_axisLengthsGlobal[2]));
+
+    m_blockCache = std::make_unique<BlockCache>(
+        m_storePath,
+        tempfileHeaderSize,
+        m_axisLengthsGlobal[0],
+        m_axisLengthsGlobal[1],
+        m_axisLengthsGlobal[2],
+        m_atomsPerBlock,
+        m_framesPerBlock,
+        m_cacheBytes);
+    if (m_unwrap == Unwrap::JUMPS && m_nprocs > 1)
+    {
+        std::vector<uint64_t> firstFrames(m_nprocs + 1, m_axisLengthsGlobal[0]);
+        for (int rank = 0; rank < m_nprocs; ++rank)
+            firstFrames[rank] = splitValues(m_axisLengthsGlobal[0], rank, m_nprocs).first;
+        m_blockCache->setShifts(firstFrames, m_coordCols);
+    }
+}
+
+/*
+ Reading out of core is a checkpointed pass whose rounds are local frames (rank
+ 0, which has the most, sets the number). A restart resumes with the frames that
+ every rank had stored at the checkpoint.
+*/
+void Trajectory::beginStoreRounds()
+{
+    m_resumeFrames = 0UL;
+    if (m_outOfCore)
+        m_resumeFrames = Checkpoint::get().beginPass(splitValues(m_nframes, 0, m_nprocs).second);
+}
+
+/*
+ Parses local frame i, whose header has been read, and stores it out of core,
+ unless a restart finds it in the store already: then only its body is skipped
+ (except for the first frame, which builds the ID index).
+*/
+void Trajectory::readOrSkipFrame(std::istream& is, const uint64_t localFrame, const uint64_t natoms, const uint64_t globalFrame)
+{
+    if (localFrame > 0 && localFrame < m_resumeFrames)
+    {
+        skipDumpBody(is, natoms);
+    }
+    else
+    {
+        readFrame(is, localFrame, natoms);
+        if (m_outOfCore)
+            storeFrame(globalFrame);
+    }
+    if (m_outOfCore)
+        Checkpoint::get().endRound(localFrame + 1);
+}
+
+// Ranks with fewer frames than rank 0 join its remaining checkpoint rounds
+void Trajectory::endStoreRounds(const uint64_t numFrames)
+{
+    if (!m_outOfCore)
+        return;
+    const uint64_t rounds = splitValues(m_nframes, 0, m_nprocs).second;
+    for (uint64_t round = numFrames; round < rounds; ++round)
+        Checkpoint::get().endRound(round + 1);
 }
 
-void Trajectory::swap(double* x, double* y)
+/*
+ Independent write at a byte offset, split into pieces that fit in an int count.
+*/
+void Trajectory::writeDoubles(MPI_File file, const uint64_t offset, const double* values, const uint64_t count)
 {
-    double tmp = *x;
-    *x = *y;
-    *y = tmp;
+    const uint64_t maxChunk = std::numeric_limits<int>::max() / sizeof(double);
+    for (uint64_t done = 0UL; done < count; done += maxChunk)
+    {
+        const int n = std::min(maxChunk, count - done);
+        MPI_File_write_at(file, offset + done * sizeof(double), values + done, n, MPI_DOUBLE, MPI_STATUS_IGNORE);
+    }
 }
 
 /*
  Returns idxMap, a permutation of {0, 1, 2}, such that order1[i] == order2[idxMap[i]]
 */
-Trajectory::IdxMap& Trajectory::getIdxMap(const Trajectory::AxisOrder& order1,
-                                          const Trajectory::AxisOrder& order2) const
+Trajectory::IdxMap Trajectory::getIdxMap(const Trajectory::AxisOrder& order1,
+                                         const Trajectory::AxisOrder& order2) const
 {
     Trajectory::IdxMap idxMap = {0U, 0U, 0U};
     for (size_t i = 0; i < 3; ++i)
@@ -255,6 +1075,23 @@ void Trajectory::checkValidAxis(const AxisOrder& axisOrder) const
     return;
 }
 
+/*
+ Returns my first index and number of values when an axis of the given length
+ is split among the ranks in whole multiples of granularity (e.g., molecules).
+*/
+std::pair<uint64_t, uint64_t> Trajectory::splitAxis(const uint64_t length, const uint64_t granularity) const
+{
+    return splitAxis(length, granularity, m_me);
+}
+
+std::pair<uint64_t, uint64_t> Trajectory::splitAxis(const uint64_t length, const uint64_t granularity, const int rank) const
+{
+    const uint64_t ngroups = (length + granularity - 1) / granularity;
+    const auto [firstGroup, numGroups] = splitValues(ngroups, rank, m_nprocs);
+    const uint64_t first = std::min(firstGroup * granularity, length);
+    return {first, std::min(numGroups * granularity, length - first)};
+}
+
 void Trajectory::reserve()
 {
     uint64_t max_nSteps = (uint64_t)ceil((double)m_stepsGlobal.size() / (double)m_nprocs);
@@ -263,117 +1100,429 @@ void Trajectory::reserve()
     m_data.reserve(max_nSteps * max_nAtoms * max_nCols);
 }
 
-uint64_t Trajectory::getTimestep(std::istream &is) const
+uint64_t Trajectory::getTimestep(std::istream &is)
 {
-    string word;
-    is >> word;
-    if (word == "")
-        return ULLONG_MAX;
-    if (word != "ITEM:")
-        errorAll(Error::SYNTAXERROR, "Syntax error while reading dump file");
-    is >> word;
-    if (word != "TIMESTEP")
+    LineReader lines(is, m_arena);
+    std::string_view line, word;
+    while (word.empty())
+    {
+        if (!lines.next(line))
+            return ULLONG_MAX;
+        word = nextToken(line);
+    }
+    if (word != "ITEM:" || nextToken(line) != "TIMESTEP")
         errorAll(Error::SYNTAXERROR, "Syntax error while reading dump file");
-    
+
     uint64_t timestep = 0UL;
-    is >> timestep;
+    if (!lines.next(line) || !parseNumber(nextToken(line), timestep))
+        errorAll(Error::SYNTAXERROR, "Syntax error while reading dump file");
     return timestep;
 }
 
+/*
+ Parses the rest of the first header after `getTimestep`: box, number of atoms
+ and column labels. Items it does not know (units, time) are skipped.
+*/
 void Trajectory::readDumpHeader(std::istream &is)
 {
-    string word;
-    m_box.fill(0.0);
+    m_box = Box();
     m_natoms = 0UL;
-    is >> word;
-
-    if (word != "ITEM:")
-        errorAll(Error::SYNTAXERROR, "Syntax error while reading dump file");
-
-    while (is.good())
+    LineReader lines(is, m_arena);
+    std::string_view line;
+    while (lines.next(line))
     {
-        is >> word;
-        if (word == "TIMESTEP")
-        {
-            is >> word;
-        }
-        else if (word == "BOX")
+        if (nextToken(line) != "ITEM:")
+            continue;
+        const std::string_view item = nextToken(line);
+        if (item == "BOX")
         {
-            is >> word >> word >> word >> word; // ITEM: BOX BOUNDS ab ab ab
-            for (size_t i = 0; i < m_box.size(); ++i)
-                is >> m_box[i];
+            m_box = Box::read(line, lines);  // ITEM: BOX BOUNDS [xy xz yz] ab ab ab
         }
-        else if (word == "NUMBER")
+        else if (item == "NUMBER")
         {
-            is >> word >> word; // ITEM: NUMBER OF ATOMS
-            is >> m_natoms;
+            // ITEM: NUMBER OF ATOMS
+            if (!lines.next(line) || !parseNumber(nextToken(line), m_natoms))
+                errorAll(Error::SYNTAXERROR, "Syntax error while reading dump file");
         }
-        else if (word == "ATOMS")
+        else if (item == "ATOMS")
         {
-            std::getline(is, word); // ITEM: ATOMS id type x y z ... => word == {"id", "type", ...}
-            std::istringstream labelstream(word);
-            m_columnLabels.clear();
-            labelstream >> word;
-            if (word != "id")
+            // ITEM: ATOMS id type x y z ... => m_columnLabels == {"type", "x", ...}
+            if (nextToken(line) != "id")
                 errorAll(Error::SYNTAXERROR, "First column of dump file must be 'id'");
-            while (labelstream.good() && word != "")
-            {
-                m_columnLabels.push_back(word);
-                labelstream >> word;
-            }
+            m_columnLabels.clear();
+            for (std::string_view label = nextToken(line); !label.empty(); label = nextToken(line))
+                m_columnLabels.emplace_back(label);
             m_ncols = m_columnLabels.size();
             return;
         }
-        else
-        {
-            while (word != "ITEM:" && is.good())
-                is >> word;
-            if (!is.good())
-                errorAll(Error::IOERROR, "File ended before the header finished");
-        }
-        if (word != "ITEM:")
-            is >> word;
-        if (word != "ITEM:")
-            errorAll(Error::SYNTAXERROR, "Syntax error while reading dump file");
     }
     errorAll(Error::IOERROR, "File ended before the header finished");
 }
 
-void Trajectory::skipDumpHeader(std::istream& is) const
+/*
+ Skips to the atoms of a frame, assuming its columns are those of the first
+ header, and returns its number of atoms; parses the box bounds into `box` if
+ given.
+*/
+uint64_t Trajectory::skipDumpHeader(std::istream& is, Box* box)
 {
-    string word;
-    is >> word;
-    while (is.good())
+    ScopedTimer timer(Region::SKIP_HEADER);
+    LineReader lines(is, m_arena);
+    std::string_view line;
+    uint64_t natoms = 0UL;
+    while (lines.next(line))
     {
-        if (word != "ITEM:")
+        if (nextToken(line) != "ITEM:")
             continue;
-        is >> word;
-        if (word == "ATOMS")
+        const std::string_view item = nextToken(line);
+        if (item == "BOX" && box)
         {
-            is.ignore(512, '\n');
-            return;
+            *box = Box::read(line, lines);
+        }
+        else if (item == "NUMBER")
+        {
+            if (lines.next(line))
+                parseNumber(nextToken(line), natoms);  // ITEM: NUMBER OF ATOMS
+        }
+        else if (item == "ATOMS")
+        {
+            return natoms;
         }
     }
     errorAll(Error::IOERROR, "File ended before the header finished");
+    return 0UL;
+}
+
+/*
+ Parses the `natoms` atoms of local frame i into place and unwraps them.
+*/
+void Trajectory::readFrame(std::istream& is, const uint64_t localFrame, const uint64_t natoms)
+{
+    if (m_ragged)
+    {
+        readRaggedBody(is, natoms);
+    }
+    else
+    {
+        if (natoms != m_natoms)
+            errorOne(Error::IOERROR, "Number of atoms changes from %llu to %llu at step %llu; read with `traj ... ragged`",
+                     (unsigned long long)m_natoms, (unsigned long long)natoms, (unsigned long long)m_steps[localFrame]);
+        readDumpBody(is, frameOffset(localFrame));
+    }
+    unwrapFrame(localFrame);
+}
+
+/*
+ Parses the atom line `id v1 v2 ...` into id and the ncols values of row.
+*/
+static bool parseAtom(std::string_view line, const size_t ncols, uint64_t& id, double* row)
+{
+    bool ok = parseNumber(nextToken(line), id);
+    for (size_t j = 0; j < ncols; ++j)
+        ok &= parseNumber(nextToken(line), row[j]);
+    return ok;
+}
+
+/*
+ Appends a frame of `natoms` rows to the ragged layout, sorted by ID so that the
+ atoms two frames have in common can be found by merging.
+*/
+void Trajectory::readRaggedBody(std::istream& is, const uint64_t natoms)
+{
+    const size_t num_cols = m_columnLabels.size();
+    const uint64_t firstRow = m_rowIds.size();
+    m_rowIds.resize(firstRow + natoms);
+    m_data.resize((firstRow + natoms) * num_cols);
+
+    uint64_t* ids = &m_rowIds[firstRow];
+    double* rows = &m_data[firstRow * num_cols];
+    LineReader lines(is, m_arena);
+    std::string_view line;
+    for (size_t i = 0; i < natoms; ++i)
+    {
+        if (!lines.next(line) || !parseAtom(line, num_cols, ids[i], rows + i * num_cols))
+            errorOne(Error::IOERROR, "Could not parse atom %llu of a frame in dump file", (unsigned long long)i + 1);
+    }
+
+    if (!std::is_sorted(ids, ids + natoms))
+    {
+        uint64_t* order = m_arena.allocate<uint64_t>(natoms);
+        std::iota(order, order + natoms, 0UL);
+        std::sort(order, order + natoms, [ids](const uint64_t a, const uint64_t b) { return ids[a] < ids[b]; });
+        uint64_t* sortedIds = m_arena.allocate<uint64_t>(natoms);
+        double* sortedRows = m_arena.allocate<double>(natoms * num_cols);
+        for (size_t i = 0; i < natoms; ++i)
+        {
+            sortedIds[i] = ids[order[i]];
+            std::memcpy(sortedRows + i * num_cols, rows + order[i] * num_cols, num_cols * sizeof(double));
+        }
+        std::copy(sortedIds, sortedIds + natoms, ids);
+        std::copy(sortedRows, sortedRows + natoms * num_cols, rows);
+    }
+    if (std::adjacent_find(ids, ids + natoms) != ids + natoms)
+        errorOne(Error::IOERROR, "Duplicate atom ids in dump file");
+    m_frameOffsets.push_back(firstRow + natoms);
 }
 
+/*
+ The first frame a rank reads builds the ID index and is scattered into place;
+ later frames take each row's slot from the index, except that rows already in
+ slot order (sorted dumps) skip the lookup. With SoA, values are parsed straight
+ into their columns, m_natoms apart.
+*/
 void Trajectory::readDumpBody(std::istream& is, const size_t offset)
 {
-    size_t id;
-    size_t num_cols = m_columnLabels.size();
+    const size_t num_cols = m_columnLabels.size();
+    const uint64_t atomStride = m_soa ? 1UL : num_cols;
+    const uint64_t colStride = m_soa ? m_natoms : 1UL;
+    LineReader lines(is, m_arena);
+    std::string_view line;
+    uint64_t id;
+
+    if (m_atomIndex.size() == 0)
+    {
+        std::vector<uint64_t> ids(m_natoms);
+        std::vector<double> rows(m_natoms * num_cols);
+        for (size_t i = 0; i < m_natoms; ++i)
+        {
+            if (!lines.next(line) || !parseAtom(line, num_cols, ids[i], &rows[i * num_cols]))
+                errorOne(Error::IOERROR, "Could not parse atom %llu of a frame in dump file", (unsigned long long)i + 1);
+        }
+        if (!m_atomIndex.build(ids))
+            errorOne(Error::IOERROR, "Duplicate atom ids in dump file");
+        for (size_t i = 0; i < m_natoms; ++i)
+        {
+            double* row = &m_data[offset + m_atomIndex.slot(ids[i]) * atomStride];
+            for (size_t j = 0; j < num_cols; ++j)
+                row[j * colStride] = rows[i * num_cols + j];
+        }
+        return;
+    }
 
     for (size_t i = 0; i < m_natoms; ++i)
     {
-        is >> id;
+        if (!lines.next(line) || !parseNumber(nextToken(line), id))
+            errorOne(Error::IOERROR, "Could not parse atom %llu of a frame in dump file", (unsigned long long)i + 1);
+        const uint64_t slot = (id == m_atomIndex.id(i)) ? i : m_atomIndex.slot(id);
+        if (slot == AtomIndex::npos)
+            errorOne(Error::IOERROR, "Atom id %llu is not in the first frame", id);
+        double* row = &m_data[offset + slot * atomStride];
+        bool ok = true;
         for (size_t j = 0; j < num_cols; ++j)
-            is >> m_data[offset + (id-1) * num_cols + j];
+            ok &= parseNumber(nextToken(line), row[j * colStride]);
+        if (!ok)
+            errorOne(Error::IOERROR, "Could not parse atom %llu of a frame in dump file", (unsigned long long)id);
     }
 }
 
-void Trajectory::skipDumpBody(std::istream& is) const
+void Trajectory::skipDumpBody(std::istream& is, const uint64_t natoms) const
+{
+    for (uint64_t i = 0; i < natoms; ++i)
+        is.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+}
+
+/*
+ Called once the column labels are known, before the first frame is unwrapped.
+*/
+void Trajectory::prepareUnwrap()
 {
-    for (uint64_t i = 0; i < m_natoms; ++i)
-        is.ignore(512, '\n');
+    if (m_unwrap == Unwrap::NONE || m_unwrapReady)
+        return;
+    if (hasColumn("xu") || hasColumn("yu") || hasColumn("zu"))
+        errorAll(Error::ARGUMENTERROR, "Dump file already has unwrapped coordinates");
+
+    const char* coords[3] = {"x", "y", "z"};
+    const char* images[3] = {"ix", "iy", "iz"};
+    bool hasImages = true;
+    for (int d = 0; d < 3; ++d)
+    {
+        m_coordCols[d] = getColumnIndex(coords[d]);
+        if (m_coordCols[d] < 0)
+            errorAll(Error::ARGUMENTERROR, "Unwrapping needs column `%s` in the dump file", coords[d]);
+        m_imageCols[d] = getColumnIndex(images[d]);
+        hasImages &= m_imageCols[d] >= 0;
+    }
+    if (m_unwrap == Unwrap::AUTO)
+        m_unwrap = hasImages ? Unwrap::IMAGES : Unwrap::JUMPS;
+    if (m_unwrap == Unwrap::IMAGES && !hasImages)
+        errorAll(Error::ARGUMENTERROR, "Unwrapping with image flags needs columns ix iy iz in the dump file");
+    if (m_unwrap == Unwrap::JUMPS && m_ragged)
+        errorAll(Error::ARGUMENTERROR, "Ragged trajectories can only be unwrapped with image flags");
+
+    for (int d = 0; d < 3; ++d)
+        m_columnLabels[m_coordCols[d]] = std::string(coords[d]) + "u";
+    if (m_unwrap == Unwrap::JUMPS)
+    {
+        m_firstWrapped.assign(3 * m_natoms, 0.0);
+        m_lastWrapped.assign(3 * m_natoms, 0.0);
+        m_lastUnwrapped.assign(3 * m_natoms, 0.0);
+    }
+    m_unwrappedFrames = 0UL;
+    m_wholeChainLength = 0UL;
+    m_unwrapReady = true;
+}
+
+/*
+ Unwraps local frame i, just parsed, in place while it is still in cache.
+ With JUMPS, a rank's first frame stays as it is, except on rank 0, where each
+ chain of NN atoms is joined by following the minimum image along its bonds;
+ `shiftUnwrapped` continues the frames of later ranks from those of earlier ones
+ after reading.
+*/
+void Trajectory::unwrapFrame(const uint64_t localFrame)
+{
+    if (m_unwrap == Unwrap::NONE)
+        return;
+    const Box& box = m_boxes[localFrame];
+    const uint64_t offset = m_ragged ? m_frameOffsets[localFrame] * m_ncols : frameOffset(localFrame);
+    const uint64_t natoms = m_ragged ? m_frameOffsets[localFrame + 1] - m_frameOffsets[localFrame] : m_natoms;
+    double* frame = m_data.data() + offset;
+    const uint64_t atomStride = m_soa ? 1UL : m_ncols;
+    const uint64_t colStride = m_soa ? m_natoms : 1UL;
+    const uint64_t cx = m_coordCols[0] * colStride, cy = m_coordCols[1] * colStride, cz = m_coordCols[2] * colStride;
+
+    if (m_unwrap == Unwrap::IMAGES)
+    {
+        const uint64_t ix = m_imageCols[0] * colStride, iy = m_imageCols[1] * colStride, iz = m_imageCols[2] * colStride;
+        const double lx = box.length(0), ly = box.length(1), lz = box.length(2);
+        const double xy = box.xy, xz = box.xz, yz = box.yz;
+#pragma omp parallel for schedule(static)
+        for (uint64_t atom = 0; atom < natoms; ++atom)
+        {
+            double* row = frame + atom * atomStride;
+            row[cx] += row[ix] * lx + row[iy] * xy + row[iz] * xz;
+            row[cy] += row[iy] * ly + row[iz] * yz;
+            row[cz] += row[iz] * lz;
+        }
+    }
+    else
+    {
+        const bool first = m_unwrappedFrames == 0;
+        const uint64_t nn = m_atomsPerMolecule;
+        const bool joinChains = first && m_me == 0 && nn > 0 && natoms % nn == 0;
+        double* firstWrapped = m_firstWrapped.data();
+        double* lastWrapped = m_lastWrapped.data();
+        double* lastUnwrapped = m_lastUnwrapped.data();
+        withGeometry(box.triclinic, [&](auto tag) {
+            const typename decltype(tag)::type geometry(box);
+#pragma omp parallel for schedule(static)
+            for (uint64_t atom = 0; atom < natoms; ++atom)
+            {
+                double* row = frame + atom * atomStride;
+                double* wrapped = lastWrapped + 3 * atom;
+                double* unwrapped = lastUnwrapped + 3 * atom;
+                const double x = row[cx], y = row[cy], z = row[cz];
+                if (first)
+                {
+                    firstWrapped[3 * atom] = unwrapped[0] = x;
+                    firstWrapped[3 * atom + 1] = unwrapped[1] = y;
+                    firstWrapped[3 * atom + 2] = unwrapped[2] = z;
+                }
+                else
+                {
+                    double dx = x - wrapped[0], dy = y - wrapped[1], dz = z - wrapped[2];
+                    geometry.minimumImage(dx, dy, dz);
+                    unwrapped[0] += dx;
+                    unwrapped[1] += dy;
+                    unwrapped[2] += dz;
+                }
+                wrapped[0] = x;
+                wrapped[1] = y;
+                wrapped[2] = z;
+                row[cx] = unwrapped[0];
+                row[cy] = unwrapped[1];
+                row[cz] = unwrapped[2];
+            }
+            if (!joinChains)
+                return;
+#pragma omp parallel for schedule(static)
+            for (uint64_t chain = 0; chain < natoms / nn; ++chain)
+            {
+                for (uint64_t atom = chain * nn + 1; atom < (chain + 1) * nn; ++atom)
+                {
+                    const double* wrapped = lastWrapped + 3 * atom;
+                    double* unwrapped = lastUnwrapped + 3 * atom;
+                    double dx = wrapped[0] - wrapped[-3], dy = wrapped[1] - wrapped[-2], dz = wrapped[2] - wrapped[-1];
+                    geometry.minimumImage(dx, dy, dz);
+                    unwrapped[0] = unwrapped[-3] + dx;
+                    unwrapped[1] = unwrapped[-2] + dy;
+                    unwrapped[2] = unwrapped[-1] + dz;
+                    double* row = frame + atom * atomStride;
+                    row[cx] = unwrapped[0];
+                    row[cy] = unwrapped[1];
+                    row[cz] = unwrapped[2];
+                }
+            }
+        });
+        if (joinChains)
+            m_wholeChainLength = nn;
+    }
+    ++m_unwrappedFrames;
+}
+
+/*
+ Collective, for JUMPS on more than one rank. Each rank gets the last frame of
+ the previous rank, wrapped and unwrapped, and works out how far its own first
+ frame is from continuing it; a prefix sum of these over ranks is the shift
+ that every later rank adds to its local frames. Out of core, each rank instead
+ stores its shift after the frames, and the block cache adds it as blocks are
+ read, so the frames are not written twice.
+*/
+void Trajectory::shiftUnwrapped()
+{
+    const uint64_t n = 3 * m_natoms;
+    const auto [firstFrame, numFrames] = splitValues(m_stepsGlobal.size(), m_me, m_nprocs);
+    std::vector<double> shift(n, 0.0);
+
+    MPI_Request request = MPI_REQUEST_NULL;
+    std::vector<double> mine;
+    if (numFrames > 0 && m_me + 1 < m_nprocs && splitValues(m_stepsGlobal.size(), m_me + 1, m_nprocs).second > 0)
+    {
+        mine = m_lastWrapped;
+        mine.insert(mine.end(), m_lastUnwrapped.begin(), m_lastUnwrapped.end());
+        MPI_Isend(mine.data(), mine.size(), MPI_DOUBLE, m_me + 1, 0, m_comm, &request);
+    }
+    if (numFrames > 0 && m_me > 0)
+    {
+        std::vector<double> previous(2 * n);
+        MPI_Recv(previous.data(), previous.size(), MPI_DOUBLE, m_me - 1, 0, m_comm, MPI_STATUS_IGNORE);
+        const Box& box = m_boxesGlobal[firstFrame];
+        withGeometry(box.triclinic, [&](auto tag) {
+            const typename decltype(tag)::type geometry(box);
+            for (uint64_t atom = 0; atom < m_natoms; ++atom)
+            {
+                const double* first = &m_firstWrapped[3 * atom];
+                const double* wrapped = &previous[3 * atom];
+                const double* unwrapped = &previous[n + 3 * atom];
+                double dx = first[0] - wrapped[0], dy = first[1] - wrapped[1], dz = first[2] - wrapped[2];
+                geometry.minimumImage(dx, dy, dz);
+                shift[3 * atom] = unwrapped[0] + dx - first[0];
+                shift[3 * atom + 1] = unwrapped[1] + dy - first[1];
+                shift[3 * atom + 2] = unwrapped[2] + dz - first[2];
+            }
+        });
+    }
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    MPI_Scan(MPI_IN_PLACE, shift.data(), n, MPI_DOUBLE, MPI_SUM, m_comm);
+
+    if (m_outOfCore)
+    {
+        if (numFrames > 0)
+            writeDoubles(m_storeFile, tempfileHeaderSize + (m_stepsGlobal.size() * m_natoms * m_ncols + m_me * n) * sizeof(double), shift.data(), n);
+        return;
+    }
+    if (m_me == 0)
+        return;
+    const uint64_t atomStride = m_soa ? 1UL : m_ncols;
+    const uint64_t colStride = m_soa ? m_natoms : 1UL;
+    for (uint64_t i = 0; i < numFrames; ++i)
+    {
+        double* frame = m_data.data() + frameOffset(i);
+#pragma omp parallel for schedule(static)
+        for (uint64_t atom = 0; atom < m_natoms; ++atom)
+            for (int d = 0; d < 3; ++d)
+                frame[atom * atomStride + m_coordCols[d] * colStride] += shift[3 * atom + d];
+    }
 }
 
 int Trajectory::writeTempfileHeader(std::ostream& outstream) const
@@ -407,33 +1556,32 @@ int Trajectory::writeTempfileHeader(std::ostream& outstream) const
     return curPos;
 }
 
+/*
+ Collective. Rank 0 writes the header, then every rank writes its slice of the
+ first axis at its offset in the global array.
+*/
 void Trajectory::writeTempfile() const
 {
-    std::ofstream outstream;
-    outstream.open(m_tempfileName, std::ios::binary);
+    ScopedTimer timer(Region::TEMPFILE_WRITE);
+    Instrument::get().addBytes(Region::TEMPFILE_WRITE, m_data.size() * sizeof(double));
 
-    int curPos = 0;
     if (m_me == 0)
-        curPos = writeTempfileHeader(outstream);
-
-    for (size_t i = 0; i < m_nprocs; ++i)
     {
-        if (m_me == i)
-        {
-            outstream.seekp(curPos);
-            outstream.write(reinterpret_cast<const char*>(&m_data), m_data.size()*sizeof(double));
-            curPos = outstream.tellp();
-            if (i + 1 < m_nprocs)
-                MPI_Send(&curPos, 1, MPI_INT, i + 1, 0, MPI_COMM_WORLD);
-        }
-        else if (m_me == i+1)
-        {
-            MPI_Recv(&curPos, 1, MPI_INT, i, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        }
-        MPI_Barrier(MPI_COMM_WORLD);
-        // MPI_Bcast(&curPos, 1, MPI_INT, me, MPI_COMM_WORLD);
+        std::ofstream outstream(m_tempfilePath, std::ios::binary);
+        if (!outstream.good())
+            errorOne(Error::IOERROR, "Couldn't write to file %s", m_tempfileName);
+        writeTempfileHeader(outstream);
+        outstream.close();
     }
-    outstream.close();
+    MPI_Barrier(m_comm);
+
+    const auto [firstIdx, nValues] = splitAxis(m_axisLengthsGlobal[0], m_splitGranularity);
+    const uint64_t stride = m_axisLengthsGlobal[1] * m_axisLengthsGlobal[2];
+
+    MPI_File file;
+    MPI_File_open(m_comm, m_tempfilePath.c_str(), MPI_MODE_WRONLY, MPI_INFO_NULL, &file);
+    writeDoubles(file, tempfileHeaderSize + firstIdx * stride * sizeof(double), m_data.data(), m_data.size());
+    MPI_File_close(&file);
 }
 
 /*
@@ -443,7 +1591,7 @@ void Trajectory::writeTempfile() const
  Dimensions dims is the length of each dimension
  Returns with startPos = -1 on error.
 */
-Trajectory::TempfileHeaderResults& Trajectory::readTempfileHeader(std::istream& instream) const
+Trajectory::TempfileHeaderResults Trajectory::readTempfileHeader(std::istream& instream) const
 {
     Trajectory::TempfileHeaderResults results;
     results.startPos = -1;
@@ -475,6 +1623,7 @@ Trajectory::TempfileHeaderResults& Trajectory::readTempfileHeader(std::istream&
             break;
         }
     }
+    instream.ignore(1);  // 'D'
 
     uint64_t dims[] = {0UL, 0UL, 0UL};
     instream.read(reinterpret_cast<char*>(&dims), 3*sizeof(uint64_t));
@@ -485,165 +1634,348 @@ Trajectory::TempfileHeaderResults& Trajectory::readTempfileHeader(std::istream&
     return results;
 }
 
-void Trajectory::readTempfile(const Trajectory::AxisOrder& newAxisOrder)
+/*
+ Reads this rank's part of the tempfile in the new axis order. The part is the
+ slab of the file whose new first axis falls in this rank's range; it is read
+ with one collective call through a subarray view and then transposed in memory
+ by the kernel of the (file order, new order) pair of layouts.
+*/
+void Trajectory::readTempfile(const Trajectory::AxisOrder& newAxisOrder, const uint64_t granularity)
 {
-    std::ifstream instream;
-    instream.open(m_tempfileName, std::ios::binary);
+    ScopedTimer timer(Region::TEMPFILE_READ);
 
+    std::ifstream instream;
+    instream.open(m_tempfilePath, std::ios::binary);
     auto results = readTempfileHeader(instream);
+    instream.close();
     if (results.startPos == -1)
         errorAll(Error::IOERROR, "ERROR: Error reading file %s", m_tempfileName);
 
     // Now, we can say newAxisOrder[i] == results.order[new2oldIdx[i]]
     // and newGlobalLengths[i] == m_axisLengthsGlobal[new2oldIdx[i]]
     auto new2oldIdx = getIdxMap(newAxisOrder, results.order);
-    const auto [myFirstIdx, nValues] = splitValues(results.dims[new2oldIdx[0]], m_me, m_nprocs);
-    const uint64_t myLastIdx = myFirstIdx + nValues - 1;
-    MPI_Barrier(MPI_COMM_WORLD);
-
-    uint64_t linearReadIdx = 0UL;
-    Trajectory::Dimensions arrayReadIdx = {0UL, 0UL, 0UL};
-    for (arrayReadIdx[0] = 0; arrayReadIdx[0] < results.dims[0]; ++arrayReadIdx[0])
+    const int split = new2oldIdx[0];
+    const auto [myFirstIdx, nValues] = splitAxis(results.dims[split], granularity);
+
+    // My slab, in the file's order
+    Trajectory::Dimensions slabLengths = results.dims;
+    slabLengths[split] = nValues;
+    const uint64_t slabSize = slabLengths[0] * slabLengths[1] * slabLengths[2];
+    std::vector<double>().swap(m_data);  // already in the tempfile
+    std::vector<double> slab(slabSize);
+
+    MPI_Datatype slabType = MPI_DOUBLE;
+    if (slabSize > 0)
     {
-        for (arrayReadIdx[1] = 0; arrayReadIdx[1] < results.dims[1]; ++arrayReadIdx[1])
+        int sizes[3], subsizes[3], starts[3];
+        for (int i = 0; i < 3; ++i)
         {
-            for (arrayReadIdx[2] = 0; arrayReadIdx[2] < results.dims[2]; ++arrayReadIdx[2])
-            {
-                if (myFirstIdx <= arrayReadIdx[new2oldIdx[0]] && arrayReadIdx[new2oldIdx[0]] <= myLastIdx)
-                {
-                    Trajectory::Dimensions arrayWriteIdx = {
-                        arrayReadIdx[new2oldIdx[0]],
-                        arrayReadIdx[new2oldIdx[1]],
-                        arrayReadIdx[new2oldIdx[2]]
-                    };
+            sizes[i] = results.dims[i];
+            subsizes[i] = slabLengths[i];
+            starts[i] = (i == split) ? myFirstIdx : 0;
+        }
+        MPI_Type_create_subarray(3, sizes, subsizes, starts, MPI_ORDER_C, MPI_DOUBLE, &slabType);
+        MPI_Type_commit(&slabType);
+    }
 
-                    uint64_t linearWriteIdx = arrayWriteIdx[0] * results.dims[new2oldIdx[1]] * results.dims[new2oldIdx[2]]
-                                            + arrayWriteIdx[1] * results.dims[new2oldIdx[2]]
-                                            + arrayWriteIdx[2];
+    MPI_File file;
+    MPI_File_open(m_comm, m_tempfilePath.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file);
+    MPI_File_set_view(file, results.startPos, MPI_DOUBLE, slabType, "native", MPI_INFO_NULL);
 
-                    instream.read(reinterpret_cast<char*>(&m_data[linearWriteIdx]), sizeof(double));
-                }
-                else
-                {
-                    instream.ignore(sizeof(double));
-                }
-            }
-        }
+    // Collective reads, in chunks that fit an int count; every rank makes the same number of calls
+    const uint64_t maxChunk = std::numeric_limits<int>::max() / sizeof(double);
+    uint64_t nChunks = (slabSize + maxChunk - 1) / maxChunk;
+    MPI_Allreduce(MPI_IN_PLACE, &nChunks, 1, MPI_UINT64_T, MPI_MAX, m_comm);
+    for (uint64_t chunk = 0; chunk < nChunks; ++chunk)
+    {
+        const uint64_t done = std::min(chunk * maxChunk, slabSize);
+        const int n = std::min(maxChunk, slabSize - done);
+        MPI_File_read_at_all(file, done, slab.data() + done, n, MPI_DOUBLE, MPI_STATUS_IGNORE);
+    }
+    MPI_File_close(&file);
+    if (slabType != MPI_DOUBLE)
+        MPI_Type_free(&slabType);
+    Instrument::get().addBytes(Region::TEMPFILE_READ, slabSize * sizeof(double));
+
+    m_data.resize(slabSize);
+    withLayout(results.order, [&](auto from) {
+        withLayout(newAxisOrder, [&](auto to) {
+            transposeBlock<typename decltype(from)::type, typename decltype(to)::type>(slab.data(), slabLengths, m_data.data());
+        });
+    });
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        m_axisOrder[i] = newAxisOrder[i];
+        m_axisLengthsGlobal[i] = results.dims[new2oldIdx[i]];
+        m_axisLengths[i] = results.dims[new2oldIdx[i]];
     }
+    m_axisLengths[0] = nValues;
+    m_firstIndex = myFirstIdx;
+    m_splitGranularity = granularity;
 }
 
-void Trajectory::permuteDimsLocal(
-    const Trajectory::AxisOrder& newAxisOrder,
-    const Trajectory::Dimensions& newLengths,
-    const Trajectory::IdxMap& old2newIdx)
+/*
+ Permutes the local data with the kernel of the (current, new) pair of layouts.
+ When the first axis stays, this is in place, slice by slice; otherwise (for
+ `permuteDimsGlobal`) it goes through a copy.
+*/
+void Trajectory::permuteDimsLocal(const Trajectory::AxisOrder& newAxisOrder)
 {
-    int oldArrayIdx[3] = {0, 0, 0};
-    int newArrayIdx[3] = {0, 0, 0};
-
-    vector<bool> completed(m_data.size() - 1);
-    completed[0] = true;
+    withLayout(m_axisOrder, [&](auto fromTag) {
+        withLayout(newAxisOrder, [&](auto toTag) {
+            using From = typename decltype(fromTag)::type;
+            using To = typename decltype(toTag)::type;
+            if constexpr (From::axis[0] == To::axis[0])
+            {
+                transposeSlices<From, To>(m_data.data(), m_axisLengths);
+            }
+            else
+            {
+                std::vector<double> permuted(m_data.size());
+                transposeBlock<From, To>(m_data.data(), m_axisLengths, permuted.data());
+                m_data.swap(permuted);
+            }
+        });
+    });
+}
 
-    // The first and last elements won't move during transposition
-    for (int start = 1; start < m_data.size() - 1; ++start)
+/*
+ Permutes the data when the split axis changes, in memory: each rank transposes
+ its slab to the new order, where the part bound for every other rank is a run
+ of whole rows of the new first axis, and the parts are exchanged all-to-all.
+ On several nodes with the same number of ranks each, the exchange takes two
+ steps: ranks first trade within their node, so that each gathers the parts its
+ node sends to the ranks of its local rank, then trade across nodes with the
+ ranks of the same local rank. A pair of nodes then exchanges localSize larger
+ messages instead of localSize squared small ones. Returns false, having changed
+ nothing, if a count does not fit an int; the caller then uses the tempfile.
+*/
+bool Trajectory::permuteDimsGlobal(const Trajectory::AxisOrder& newAxisOrder, const uint64_t granularity)
+{
+    const auto old2newIdx = getIdxMap(m_axisOrder, newAxisOrder);
+    const uint32_t split = old2newIdx[0];  // new position of the axis split so far
+    Trajectory::Dimensions newLengthsGlobal = {0, 0, 0};
+    for (size_t i = 0; i < 3; ++i)
+        newLengthsGlobal[old2newIdx[i]] = m_axisLengthsGlobal[i];
+
+    // Lengths and first indices, in the new order, of the part of rank `from` bound for rank `to`
+    auto part = [&](const int from, const int to) {
+        const auto [oldFirst, oldN] = splitAxis(m_axisLengthsGlobal[0], m_splitGranularity, from);
+        const auto [newFirst, newN] = splitAxis(newLengthsGlobal[0], granularity, to);
+        Trajectory::Dimensions lengths = newLengthsGlobal, starts = {newFirst, 0, 0};
+        lengths[0] = newN;
+        if (split == 0)
+        {
+            starts[0] = std::max(newFirst, oldFirst);
+            const uint64_t end = std::min(newFirst + newN, oldFirst + oldN);
+            lengths[0] = end > starts[0] ? end - starts[0] : 0;
+        }
+        else
+        {
+            starts[split] = oldFirst;
+            lengths[split] = oldN;
+        }
+        return std::make_pair(lengths, starts);
+    };
+    auto partSize = [&](const int from, const int to) {
+        const auto lengths = part(from, to).first;
+        return lengths[0] * lengths[1] * lengths[2];
+    };
+
+    const auto& topology = nodeTopology();
+    const bool twoLevel = topology.uniform && topology.numNodes > 1 && topology.localSize > 1;
+    const int nLocal = topology.localSize, nNodes = topology.numNodes;
+    const int myLocal = m_me % nLocal, myNode = m_me / nLocal;
+
+    // The counts of every exchange must fit an int
+    const auto [myNewFirst, myNewN] = splitAxis(newLengthsGlobal[0], granularity);
+    const uint64_t outSize = myNewN * newLengthsGlobal[1] * newLengthsGlobal[2];
+    uint64_t gathered = 0;  // two-level: parts held between the two steps
+    if (twoLevel)
+        for (int l = 0; l < nLocal; ++l)
+            for (int n = 0; n < nNodes; ++n)
+                gathered += partSize(myNode * nLocal + l, n * nLocal + myLocal);
+    int tooLarge = std::max({(uint64_t)m_data.size(), outSize, gathered}) > (uint64_t)std::numeric_limits<int>::max();
+    MPI_Allreduce(MPI_IN_PLACE, &tooLarge, 1, MPI_INT, MPI_LOR, m_comm);
+    if (tooLarge)
+        return false;
+
+    // My slab in the new order; the part for rank `to` starts at row `starts[0] - firstRow`
+    const uint64_t firstRow = (split == 0) ? m_firstIndex : 0UL;
+    uint64_t rowSize = 1UL;
+    for (size_t i = 1; i < 3; ++i)
+        rowSize *= (i == split) ? m_axisLengths[0] : newLengthsGlobal[i];
+    permuteDimsLocal(newAxisOrder);
+    auto partOffset = [&](const int to) {
+        const auto [lengths, starts] = part(m_me, to);
+        return lengths[0] > 0 ? (starts[0] - firstRow) * rowSize : 0UL;
+    };
+
+    std::vector<int> sendCounts(m_nprocs), sendDispls(m_nprocs), recvCounts(m_nprocs), recvDispls(m_nprocs, 0);
+    std::vector<double> received;  // allocated once the slab and the buffers of the first step are freed
+    uint64_t bytes = m_data.size() * sizeof(double);
+    if (!twoLevel)
     {
-        if (completed[start])
-            continue;
-
-        int newLinearIdx = start;
-        // Can likely improve this loop. std::div twice on every element is bad
-        while (true)
+        for (int r = 0; r < m_nprocs; ++r)
         {
-            // int q = 0;
-            // [q, oldArrayIdx[2]] = std::div(newLinearIdx, m_axisLengths[2]);
-            const auto& div1 = std::div(newLinearIdx, m_axisLengths[2]);
-            // [oldArrayIdx[0], oldArrayIdx[1]] = std::div(q, m_axisLengths[1]);
-            const auto& div2 = std::div(div1.quot, m_axisLengths[1]);
-
-            oldArrayIdx[0] = div2.quot;
-            oldArrayIdx[1] = div2.rem;
-            oldArrayIdx[2] = div1.rem;
-
-            for(int i = 0; i < 3; ++i)
-                newArrayIdx[old2newIdx[i]] = oldArrayIdx[i];
-
-            newLinearIdx = newArrayIdx[0] * newLengths[1] * newLengths[2]
-                         + newArrayIdx[1] * newLengths[2]
-                         + newArrayIdx[2];
-
-            completed[newLinearIdx] = true;
+            sendCounts[r] = partSize(m_me, r);
+            sendDispls[r] = partOffset(r);
+            recvCounts[r] = partSize(r, m_me);
+            if (r > 0)
+                recvDispls[r] = recvDispls[r - 1] + recvCounts[r - 1];
+        }
+        received.resize(outSize);
+        MPI_Alltoallv(
+            m_data.data(), sendCounts.data(), sendDispls.data(), MPI_DOUBLE,
+            received.data(), recvCounts.data(), recvDispls.data(), MPI_DOUBLE, m_comm);
+    }
+    else
+    {
+        // Within the node: to local rank l, my parts for local rank l of every node, by node
+        std::vector<int> counts(nLocal, 0), displs(nLocal, 0), inCounts(nLocal, 0), inDispls(nLocal, 0);
+        std::vector<double> packed(m_data.size());
+        uint64_t pos = 0;
+        for (int l = 0; l < nLocal; ++l)
+        {
+            displs[l] = pos;
+            for (int n = 0; n < nNodes; ++n)
+            {
+                const int to = n * nLocal + l;
+                const uint64_t count = partSize(m_me, to);
+                std::copy_n(m_data.data() + partOffset(to), count, packed.data() + pos);
+                pos += count;
+            }
+            counts[l] = pos - displs[l];
+            for (int n = 0; n < nNodes; ++n)
+                inCounts[l] += partSize(myNode * nLocal + l, n * nLocal + myLocal);
+            if (l > 0)
+                inDispls[l] = inDispls[l - 1] + inCounts[l - 1];
+        }
+        std::vector<double>().swap(m_data);
+        std::vector<double> gatheredParts(gathered);
+        MPI_Alltoallv(
+            packed.data(), counts.data(), displs.data(), MPI_DOUBLE,
+            gatheredParts.data(), inCounts.data(), inDispls.data(), MPI_DOUBLE, topology.nodeComm);
+
+        // Across nodes: to node n, the parts of my node for its rank of my local rank, by local rank
+        std::vector<int> nodeCounts(nNodes, 0), nodeDispls(nNodes, 0), inNodeCounts(nNodes, 0), inNodeDispls(nNodes, 0);
+        packed.resize(gathered);
+        pos = 0;
+        for (int n = 0; n < nNodes; ++n)
+        {
+            nodeDispls[n] = pos;
+            for (int l = 0; l < nLocal; ++l)
+            {
+                uint64_t offset = inDispls[l];
+                for (int m = 0; m < n; ++m)
+                    offset += partSize(myNode * nLocal + l, m * nLocal + myLocal);
+                const uint64_t count = partSize(myNode * nLocal + l, n * nLocal + myLocal);
+                std::copy_n(gatheredParts.data() + offset, count, packed.data() + pos);
+                pos += count;
+                inNodeCounts[n] += partSize(n * nLocal + l, m_me);
+            }
+            nodeCounts[n] = pos - nodeDispls[n];
+            if (n > 0)
+                inNodeDispls[n] = inNodeDispls[n - 1] + inNodeCounts[n - 1];
+        }
+        std::vector<double>().swap(gatheredParts);
+        received.resize(outSize);
+        MPI_Alltoallv(
+            packed.data(), nodeCounts.data(), nodeDispls.data(), MPI_DOUBLE,
+            received.data(), inNodeCounts.data(), inNodeDispls.data(), MPI_DOUBLE, topology.crossComm);
+        bytes += gathered * sizeof(double);
+    }
+    std::vector<double>().swap(m_data);
+    Instrument::get().addBytes(Region::TRANSPOSE, bytes);
+
+    // Received parts are in the order of the sending rank; each is a box of my slab
+    m_data.resize(outSize);
+    const uint64_t outLengths[3] = {myNewN, newLengthsGlobal[1], newLengthsGlobal[2]};
+    uint64_t pos = 0;
+    for (int r = 0; r < m_nprocs; ++r)
+    {
+        const auto box = part(r, m_me);
+        const auto& lengths = box.first;
+        auto starts = box.second;
+        starts[0] -= myNewFirst;
+        const double* in = received.data() + pos;
+        double* out = m_data.data();
+#pragma omp parallel for collapse(2) schedule(static)
+        for (uint64_t i = 0; i < lengths[0]; ++i)
+            for (uint64_t j = 0; j < lengths[1]; ++j)
+                std::copy_n(
+                    in + (i * lengths[1] + j) * lengths[2], lengths[2],
+                    out + ((starts[0] + i) * outLengths[1] + starts[1] + j) * outLengths[2] + starts[2]);
+        pos += lengths[0] * lengths[1] * lengths[2];
+    }
 
-            if (newLinearIdx == start)
-                break;
-            
-            swap(&m_data[start], &m_data[newLinearIdx]);
-        }        
+    for (size_t i = 0; i < 3; ++i)
+    {
+        m_axisOrder[i] = newAxisOrder[i];
+        m_axisLengthsGlobal[i] = newLengthsGlobal[i];
+        m_axisLengths[i] = outLengths[i];
     }
+    m_firstIndex = myNewFirst;
+    m_splitGranularity = granularity;
+    return true;
 }
 
-void Trajectory::permuteDims(const AxisOrder& newAxisOrder)
+/*
+ Permutes the axes of the data. The new first axis is split among the ranks in
+ multiples of granularity, e.g., pass the number of atoms per molecule with
+ ATOMS first so that no molecule is split between ranks.
+*/
+void Trajectory::permuteDims(const AxisOrder& newAxisOrder, const uint64_t granularity)
 {
     checkValidAxis(newAxisOrder);
+    if (m_ragged)
+        errorAll(Error::ARGUMENTERROR, "The axes of a ragged trajectory cannot be permuted");
     
-    if (newAxisOrder == m_axisOrder)
+    if (newAxisOrder == m_axisOrder && granularity == m_splitGranularity)
         return;
 
+    if (m_outOfCore)
+        errorAll(Error::ARGUMENTERROR, "Cannot permute a trajectory read out of core; use its block cache instead");
+
+    ScopedTimer timer(Region::TRANSPOSE);
+    Instrument::get().addElements(Region::TRANSPOSE, m_data.size());
+
     auto old2newIdx = getIdxMap(m_axisOrder, newAxisOrder);
     /*
      m_axisOrder[i] == newAxisOrder[idxMap[i]]
     */
 
     Trajectory::Dimensions newLengths = {0, 0, 0};
+    Trajectory::Dimensions newLengthsGlobal = {0, 0, 0};
     for (size_t i = 0; i < 3; ++i)
+    {
         newLengths[old2newIdx[i]] = m_axisLengths[i];
+        newLengthsGlobal[old2newIdx[i]] = m_axisLengthsGlobal[i];
+    }
     
-    if (old2newIdx[0] == 0)
+    if (old2newIdx[0] == 0 && granularity == m_splitGranularity)
     {
-        permuteDimsLocal(newAxisOrder, newLengths, old2newIdx);
+        permuteDimsLocal(newAxisOrder);
         for (size_t i = 0; i < 3; ++i)
         {
             m_axisLengths[i] = newLengths[i];
+            m_axisLengthsGlobal[i] = newLengthsGlobal[i];
             m_axisOrder[i] = newAxisOrder[i];
         }
         return;
     }
-    else
+    else if (!permuteDimsGlobal(newAxisOrder, granularity))
     {
+        // Too large for the counts of MPI. The tempfile records its own axis
+        // order, so it is written once and can be re-read into any later order
         if (!m_tempfileExists)
         {
-            MDBIN::HeaderInfo info;
-            info.initStep = m_stepsGlobal.front();
-            info.endStep = m_stepsGlobal.back();
-            info.deltaStep = m_stepsGlobal[1] - m_stepsGlobal[0];
-            info.columnLabels = m_columnLabels;
-            info.numFrames = m_axisLengthsGlobal[0];
-            info.numAtoms = m_axisLengthsGlobal[1];
-            info.numCols = m_axisLengthsGlobal[2];
-            if (m_me == 0 && MDBIN::write(m_tempfilePath, info, m_data))
-                errorAll(Error::IOERROR, "Couldn't write to file %s", m_tempfileName);
-            
-            MPI_Barrier(MPI_COMM_WORLD);
-            for (int i = 0; i < m_nprocs; ++i)
-            {
-                if (i != 0 && m_me == i)
-                    MDBIN::append(m_tempfilePath, m_data);
-
-                MPI_Barrier(MPI_COMM_WORLD);
-            }
-            // writeTempfile();
+            writeTempfile();
             m_tempfileExists = true;
         }
-        readTempfile(newAxisOrder);
+        readTempfile(newAxisOrder, granularity);
     }
-
-    // Below is the original implementation plan with minimal wasted memory and no writes to disk
-
-    // Determine initial, intermediate (maximum), and final dimensions of vector
-    // Resize vector to maximum necessary size
-    // Copy data to appropriate buffer locations
-    // MPI All-to-All data communication
-    // Copy data back to appropriate locations
-    // Resize vector to final size
-    // Update axisOder, axisLengthsLocal, m_axisLengthsGlobal, etc.
 }
 
 void Trajectory::reset()
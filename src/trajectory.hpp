@@ -3,10 +3,19 @@
 #include <array>
 #include <cstdint>
 #include <filesystem>
+#include <iosfwd>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include <mpi.h>
+
+#include "arena.hpp"
+#include "atomIndex.hpp"
+#include "blockCache.hpp"
+#include "box.hpp"
 #include "stepRange.hpp"
+#include "stridedView.hpp"
 
 namespace MDPAT
 {
@@ -17,6 +26,9 @@ public:
     enum class Axis {NONE = 0, FRAMES = 1, ATOMS = 2, PROPS = 3};
     typedef std::array<Axis, 3> AxisOrder;
     typedef std::array<size_t, 3> Dimensions;
+    typedef std::array<uint64_t, 3> Strides;  // element strides of FRAMES, ATOMS, PROPS
+    // Read-time unwrapping of x y z (see `setUnwrap`)
+    enum class Unwrap {NONE = 0, AUTO = 1, IMAGES = 2, JUMPS = 3};
 public:
     Trajectory();
     ~Trajectory();
@@ -25,6 +37,9 @@ public:
     void read(const std::filesystem::path&);
     void read(const std::vector<std::filesystem::path>&, const MDPAT::StepRange&);
     void read(const std::vector<std::filesystem::path>&);
+    // Single dump file: byte offsets of its frames, to seek to them (see `indexFrames`)
+    uint64_t indexFrames(const std::filesystem::path&, const MDPAT::StepRange&, std::vector<uint64_t>&);
+    void setFrameIndex(const std::vector<uint64_t>&);
 
     const bool isLoaded() const;
     const int getColumnIndex(const char*) const;
@@ -33,15 +48,66 @@ public:
     const Dimensions& getAxisLengths() const;
     const Dimensions& getAxisLengthsGlobal() const;
     const AxisOrder& getAxisOrder() const;
-    const std::vector<uint64_t>& getSteps const;
+    const std::vector<uint64_t>& getSteps() const;
+    const std::vector<uint64_t>& getStepsGlobal() const;
+    const uint64_t getFirstIndex() const;
+    const uint64_t getNumAtoms() const;
+    // Atom ID of each slot along ATOMS (ascending)
+    const std::vector<uint64_t>& getAtomIds() const;
+
+    // Ragged mode, for frames with different atoms (see `setRagged`)
+    void setRagged(const bool);
+    const bool isRagged() const;
+    const std::vector<uint64_t>& getFrameOffsets() const;
+    const std::vector<uint64_t>& getRowIds() const;
+    uint64_t gatherAtomSeries(std::vector<uint64_t>&, std::vector<uint64_t>&, std::vector<double>&) const;
+
+    // Column-major frames, each column an array over atoms (see `setSoA`)
+    void setSoA(const bool);
+    const bool isSoA() const;
+    AxisOrder getFrameOrder() const;
+
+    // Box of the first frame, and of any frame by global index
+    const Box& getBox() const;
+    const Box& getBox(const uint64_t frame) const;
+    // True if any frame has a tilted box; true if all frames have the same box
+    const bool isTriclinic() const;
+    const bool hasFixedBox() const;
     const double & operator[](std::size_t idx) const;
+
+    // Zero-copy views of the local data in the current axis order (see `column`)
+    Strides getStrides() const;
+    static Strides layoutStrides(const AxisOrder&, const Dimensions&);
+    StridedView2<const double> column(const char* label) const;
+    StridedView2<const double> atom(const uint64_t) const;
+    StridedView2<const double> frame(const uint64_t) const;
+
+    // Atoms per molecule (NN); 0 if not set
+    void setAtomsPerMolecule(const uint64_t);
+    const uint64_t getAtomsPerMolecule() const;
+
+    // Out-of-core mode (see `setOutOfCore`)
+    void setOutOfCore(
+        const std::filesystem::path& storePath,
+        const uint64_t cacheBytes,
+        const uint64_t atomsPerBlock,
+        const uint64_t framesPerBlock);
+    const bool isOutOfCore() const;
+    BlockCache& getBlockCache();
+
+    // Unwrapping of wrapped coordinates while reading (see `setUnwrap`)
+    void setUnwrap(const Unwrap);
+    // Whether chains of `length` atoms are whole, i.e., unless unwrapped with jumps without that NN
+    const bool chainsWhole(const uint64_t length) const;
     
-    void permuteDims(const AxisOrder&);
+    void permuteDims(const AxisOrder&, const uint64_t granularity = 1UL);
     // void selectColumns(const std::vector<std::string> &);
     void reset();
 
 private:
     typedef std::array<uint32_t, 3> IdxMap;
+    // 'P', nprocs, "R3A", three axis chars, 'D', three lengths (see writeTempfileHeader)
+    static constexpr uint64_t tempfileHeaderSize = 1 + sizeof(int) + 3 + 3 + 1 + 3 * sizeof(size_t);
     struct TempfileHeaderResults
     {
         int startPos = 0;
@@ -51,32 +117,57 @@ private:
 private:
     void initMPI();
     void checkValidAxis(const AxisOrder&) const;
+    void checkViewable() const;
+    uint64_t localLength(const Axis) const;
+    std::pair<uint64_t, uint64_t> splitAxis(const uint64_t, const uint64_t) const;
+    std::pair<uint64_t, uint64_t> splitAxis(const uint64_t, const uint64_t, const int rank) const;
 
     // Permuting axes
-    void swap(double *, double *);
-    IdxMap& getIdxMap(const AxisOrder&, const AxisOrder&) const;
-    void permuteDimsLocal(
-        const AxisOrder&,
-        const Dimensions&,
-        const IdxMap&);
+    IdxMap getIdxMap(const AxisOrder&, const AxisOrder&) const;
+    void permuteDimsLocal(const AxisOrder&);
+    bool permuteDimsGlobal(const AxisOrder&, const uint64_t);
 
     // Read text dumpfile methods
     void reserve();
-    uint64_t getTimestep(std::istream&) const;
+    void allocateFrames(const uint64_t);
+    uint64_t frameOffset(const uint64_t) const;
+    void finishRead();
+    void shareAtomIds();
+    void shareRaggedAtomIds();
+    void gatherBoxes();
+    void openDump(std::ifstream&, const std::filesystem::path&);
+    uint64_t getTimestep(std::istream&);
     void readDumpHeader(std::istream&);
-    void skipDumpHeader(std::istream&) const;
+    uint64_t skipDumpHeader(std::istream&, Box* box = nullptr);
+    void readFrame(std::istream&, const uint64_t, const uint64_t);
     void readDumpBody(std::istream&, const size_t);
-    void skipDumpBody(std::istream&) const;
+    void readRaggedBody(std::istream&, const uint64_t);
+    void skipDumpBody(std::istream&, const uint64_t) const;
+
+    // Read-time unwrapping methods
+    void prepareUnwrap();
+    void unwrapFrame(const uint64_t);
+    void shiftUnwrapped();
     
     // Tempfile methods (for transposing/perumting axes)
     int writeTempfileHeader(std::ostream &outstream) const;
     void writeTempfile() const;
-    TempfileHeaderResults& readTempfileHeader(std::istream &instream) const;
-    void readTempfile(const AxisOrder&);
+    TempfileHeaderResults readTempfileHeader(std::istream &instream) const;
+    void readTempfile(const AxisOrder&, const uint64_t);
+    static void writeDoubles(MPI_File, const uint64_t, const double*, const uint64_t);
+
+    // Out-of-core store methods
+    void openStore();
+    void storeFrame(const uint64_t);
+    void closeStore();
+    void beginStoreRounds();
+    void readOrSkipFrame(std::istream&, const uint64_t, const uint64_t, const uint64_t);
+    void endStoreRounds(const uint64_t);
 private:
     std::vector<double> m_data;  // main data
 
     // MPI vars
+    MPI_Comm m_comm = MPI_COMM_WORLD;  // every rank, numbered node by node (see topology.hpp)
     int m_me = 0;
     int m_nprocs = 1;
 
@@ -87,22 +178,60 @@ private:
     Dimensions m_axisLengths = {0, 0, 0};
     Dimensions m_axisLengthsGlobal = {0, 0, 0};
     std::vector<std::string> m_columnLabels = {};
+    uint64_t m_firstIndex = 0UL;        // global index of my first element along axis 0
+    uint64_t m_splitGranularity = 1UL;  // axis 0 is split among ranks in multiples of this
+    uint64_t m_atomsPerMolecule = 0UL;
     // std::vector<std::string> m_originalColumnLabels;
     
     // Dumpfile vars
     uint64_t m_nframes = 0UL;
     uint64_t m_natoms = 0UL;
     uint32_t m_ncols = 0U;
-    std::array<double, 6> m_box = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    AtomIndex m_atomIndex;  // built from the first frame read
+    bool m_ragged = false;
+    bool m_soa = false;  // frames read as FRAMES x PROPS x ATOMS
+    std::vector<uint64_t> m_frameOffsets;  // ragged: first row of each local frame, and the end
+    std::vector<uint64_t> m_rowIds;        // ragged: atom ID of each row
+    Arena m_arena;  // per-frame parse buffers, reset at every frame
+    static constexpr size_t streamBufferSize = 1UL << 20;
+    std::vector<char> m_streamBuffer;
+    Box m_box;
+    std::vector<Box> m_boxes;        // per local frame, while reading
+    std::vector<Box> m_boxesGlobal;  // per frame, on every rank
+    bool m_triclinic = false;
+    bool m_fixedBox = true;
     std::vector<uint64_t> m_stepsGlobal;
     std::vector<uint64_t> m_steps;
     std::filesystem::path m_dumpfilePath;
     std::vector<std::filesystem::path> m_dumpfilePathsVec;
+    std::vector<uint64_t> m_frameIndex;  // byte offset of each frame of the next read, if known
+
+    // Unwrapping vars
+    Unwrap m_unwrap = Unwrap::NONE;
+    bool m_unwrapReady = false;
+    std::array<int, 3> m_coordCols = {-1, -1, -1};
+    std::array<int, 3> m_imageCols = {-1, -1, -1};
+    uint64_t m_unwrappedFrames = 0UL;  // local frames unwrapped so far
+    uint64_t m_wholeChainLength = 0UL;  // NN whose chains were joined in the first frame (JUMPS)
+    std::vector<double> m_firstWrapped;   // my first frame, wrapped (JUMPS)
+    std::vector<double> m_lastWrapped;    // my latest frame, wrapped (JUMPS)
+    std::vector<double> m_lastUnwrapped;  // my latest frame, unwrapped (JUMPS)
 
     // Tempfile vars
     bool m_tempfileExists = false;
     const char* m_tempfileName = "tempfile.bin";
     std::filesystem::path m_tempfilePath;
+
+    // Out-of-core vars
+    bool m_outOfCore = false;
+    bool m_storeOpen = false;
+    std::filesystem::path m_storePath;
+    MPI_File m_storeFile;
+    uint64_t m_cacheBytes = 0UL;
+    uint64_t m_atomsPerBlock = 0UL;
+    uint64_t m_framesPerBlock = 0UL;
+    std::unique_ptr<BlockCache> m_blockCache;
+    uint64_t m_resumeFrames = 0UL;  // local frames already in the store on a restart
 };
 
 }
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace MDPAT
+{
+/*
+ * Lock-free disjoint sets for concurrent unions from many threads. Roots are
+ * linked with a compare-and-swap, always the larger index under the smaller, so
+ * no cycles can form; `find` halves paths with CAS as it goes, and losing a race
+ * only means a slightly longer path. The root of a set is its smallest element.
+ */
+class UnionFind
+{
+public:
+    explicit UnionFind(const uint64_t n) :
+        m_n(n),
+        m_parent(new std::atomic<uint64_t>[n])
+    {
+        reset();
+    }
+
+    // Every element in its own set; call outside of parallel unions
+    void reset()
+    {
+#pragma omp parallel for schedule(static)
+        for (uint64_t i = 0; i < m_n; ++i)
+            m_parent[i].store(i, std::memory_order_relaxed);
+    }
+
+    uint64_t find(uint64_t x)
+    {
+        while (true)
+        {
+            uint64_t parent = m_parent[x].load(std::memory_order_relaxed);
+            if (parent == x)
+                return x;
+            const uint64_t grandparent = m_parent[parent].load(std::memory_order_relaxed);
+            if (parent != grandparent)
+                m_parent[x].compare_exchange_weak(parent, grandparent, std::memory_order_relaxed);
+            x = grandparent;
+        }
+    }
+
+    void unite(uint64_t a, uint64_t b)
+    {
+        while (true)
+        {
+            a = find(a);
+            b = find(b);
+            if (a == b)
+                return;
+            if (a < b)
+                std::swap(a, b);
+            uint64_t expected = a;
+            if (m_parent[a].compare_exchange_strong(expected, b, std::memory_order_acq_rel))
+                return;
+        }
+    }
+
+    uint64_t size() const
+    {
+        return m_n;
+    }
+private:
+    uint64_t m_n;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_parent;
+};
+
+}
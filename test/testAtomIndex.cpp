@@ -0,0 +1,95 @@
+#define BOOST_TEST_MODULE header-only testAtomIndex
+#include <boost/test/included/unit_test.hpp>
+#include "../src/atomIndex.cpp"
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <set>
+
+// Checks every ID against its slot (ascending order) and some absent IDs against npos
+void checkIndex(const MDPAT::AtomIndex& index, const std::vector<uint64_t>& ids, const std::vector<uint64_t>& absent)
+{
+    std::vector<uint64_t> sorted(ids);
+    std::sort(sorted.begin(), sorted.end());
+    BOOST_TEST(index.size() == sorted.size());
+    BOOST_TEST(index.ids() == sorted, boost::test_tools::per_element());
+
+    bool allFound = true;
+    for (uint64_t slot = 0; slot < sorted.size(); ++slot)
+        allFound = allFound && index.slot(sorted[slot]) == slot && index.id(slot) == sorted[slot];
+    BOOST_TEST(allFound);
+
+    for (const uint64_t id : absent)
+        BOOST_TEST(index.slot(id) == MDPAT::AtomIndex::npos);
+}
+
+BOOST_AUTO_TEST_CASE(dense_shuffled)
+{
+    // IDs 1..N in dump order, which is not sorted
+    std::vector<uint64_t> ids(1000);
+    for (uint64_t i = 0; i < ids.size(); ++i)
+        ids[i] = i + 1;
+    std::shuffle(ids.begin(), ids.end(), std::mt19937_64(7));
+
+    MDPAT::AtomIndex index;
+    BOOST_TEST(index.build(ids));
+    checkIndex(index, ids, {0, 1001, 5000, UINT64_MAX - 1});
+}
+
+BOOST_AUTO_TEST_CASE(dense_with_gaps)
+{
+    // Every third ID deleted: still within a quarter of the range, so the dense table
+    std::vector<uint64_t> ids;
+    for (uint64_t id = 100; id < 400; ++id)
+        if (id % 3 != 0)
+            ids.push_back(id);
+
+    MDPAT::AtomIndex index;
+    BOOST_TEST(index.build(ids));
+    checkIndex(index, ids, {99, 102, 300, 400});
+}
+
+BOOST_AUTO_TEST_CASE(sparse_hash)
+{
+    // Far fewer IDs than their range, so the hash table; absent IDs probe past collisions
+    std::mt19937_64 rng(11);
+    std::set<uint64_t> unique;
+    while (unique.size() < 5000)
+        unique.insert(rng() % (UINT64_MAX / 2));
+    std::vector<uint64_t> ids(unique.begin(), unique.end());
+    std::shuffle(ids.begin(), ids.end(), rng);
+
+    std::vector<uint64_t> absent;
+    while (absent.size() < 1000)
+    {
+        const uint64_t id = rng() % (UINT64_MAX / 2);
+        if (!unique.count(id))
+            absent.push_back(id);
+    }
+
+    MDPAT::AtomIndex index;
+    BOOST_TEST(index.build(ids));
+    checkIndex(index, ids, absent);
+}
+
+BOOST_AUTO_TEST_CASE(duplicates_and_rebuild)
+{
+    MDPAT::AtomIndex index;
+    BOOST_TEST(!index.build({5, 9, 5}));
+    BOOST_TEST(!index.build({1000000, 3, 1000000}));
+
+    // A failed build leaves nothing behind that a later build could see
+    BOOST_TEST(index.build({1000000000, 3}));
+    checkIndex(index, {1000000000, 3}, {5, 9});
+    BOOST_TEST(index.build({2, 1, 3}));
+    checkIndex(index, {1, 2, 3}, {0, 4, 1000000000});
+}
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+    MDPAT::AtomIndex index;
+    BOOST_TEST(index.build({}));
+    checkIndex(index, {}, {0, 1, 12345});
+    index.clear();
+    checkIndex(index, {}, {1});
+}
@@ -0,0 +1,138 @@
+#define BOOST_TEST_MODULE header-only testCheckpoint
+#include <boost/test/included/unit_test.hpp>
+#include <mpi.h>
+#include "../src/checkpoint.hpp"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+int ME = 0, NPROCS = 1;
+struct MPISetup
+{
+    MPISetup()
+    {
+        int argc = 0;
+        char **argv = nullptr;
+        MPI_Init(&argc, &argv);
+        MPI_Comm_rank(MPI_COMM_WORLD, &ME);
+        MPI_Comm_size(MPI_COMM_WORLD, &NPROCS);
+    }
+    ~MPISetup() { MPI_Finalize(); }
+};
+
+BOOST_TEST_GLOBAL_FIXTURE(MPISetup);
+
+BOOST_AUTO_TEST_CASE(accumulators_pack_unpack)
+{
+    std::vector<double> sums = {1.5, -2.0, 3.25};
+    uint64_t count = 42;
+    std::vector<int> hist = {7, 8};
+    const MDPAT::Accumulators accumulators = MDPAT::Accumulators().add(sums).add(count).add(hist);
+    BOOST_TEST(accumulators.bytes() == 3 * sizeof(double) + sizeof(uint64_t) + 2 * sizeof(int));
+
+    std::vector<char> buffer;
+    accumulators.pack(buffer);
+    BOOST_TEST(buffer.size() == accumulators.bytes());
+
+    sums = {0.0, 0.0, 0.0};
+    count = 0;
+    hist = {0, 0};
+    BOOST_TEST(accumulators.unpack(buffer));
+    BOOST_TEST(sums == std::vector<double>({1.5, -2.0, 3.25}), boost::test_tools::per_element());
+    BOOST_TEST(count == 42U);
+    BOOST_TEST(hist == std::vector<int>({7, 8}), boost::test_tools::per_element());
+
+    // A section of the wrong size is refused and changes nothing
+    buffer.pop_back();
+    sums[0] = 9.0;
+    BOOST_TEST(!accumulators.unpack(buffer));
+    BOOST_TEST(sums[0] == 9.0);
+    BOOST_TEST(!accumulators.unpack(std::vector<char>()));
+}
+
+BOOST_AUTO_TEST_CASE(save_and_restart)
+{
+    const fs::path path = fs::temp_directory_path() / "mdpat_test.ckpt";
+    const uint64_t deck = MDPAT::Checkpoint::hash("traj dump.txt\nmsd\n");
+    MDPAT::Checkpoint& checkpoint = MDPAT::Checkpoint::get();
+    checkpoint.setDeck(deck);
+    checkpoint.enable(path, 0.0);
+    BOOST_TEST(checkpoint.isEnabled());
+    BOOST_TEST(!checkpoint.isRestarting());
+
+    // Ranks accumulate different amounts, so sections differ in content and size
+    std::vector<double> sums(2 + ME, 0.0);
+    uint64_t rounds = 0;
+    auto accumulators = [&]() { return MDPAT::Accumulators().add(sums).add(rounds); };
+    BOOST_TEST(!checkpoint.beginStep(0));
+    BOOST_TEST(checkpoint.beginPass(10, accumulators()) == 0U);
+    for (uint64_t round = 0; round < 4; ++round)
+    {
+        for (auto& sum : sums)
+            sum += 0.5 * (ME + 1);
+        ++rounds;
+        checkpoint.endRound(round + 1, accumulators());
+    }
+
+    // The header and the table of section sizes
+    if (ME == 0)
+    {
+        std::ifstream is(path, std::ios::binary);
+        MDPAT::Checkpoint::Header header;
+        is.read(reinterpret_cast<char*>(&header), sizeof(header));
+        std::vector<uint64_t> sizes(NPROCS);
+        is.read(reinterpret_cast<char*>(sizes.data()), NPROCS * sizeof(uint64_t));
+        BOOST_TEST(is.good());
+        BOOST_TEST(std::memcmp(header.magic, "MDCK", 4) == 0);
+        BOOST_TEST(header.nprocs == NPROCS);
+        BOOST_TEST(header.deck == deck);
+        BOOST_TEST(header.completed == 0U);
+        BOOST_TEST(header.step == 0U);
+        BOOST_TEST(header.pass == 1U);
+        BOOST_TEST(header.rounds == 4U);
+        for (int rank = 0; rank < NPROCS; ++rank)
+            BOOST_TEST(sizes[rank] == (2 + rank) * sizeof(double) + sizeof(uint64_t));
+    }
+    BOOST_TEST(!fs::exists(path.string() + ".tmp"));
+
+    // Only the same deck on as many ranks may restart from it
+    MDPAT::Checkpoint::Header header;
+    header.nprocs = NPROCS;
+    header.deck = deck;
+    BOOST_TEST(checkpoint.mismatch(header, NPROCS).empty());
+    BOOST_TEST(checkpoint.mismatch(header, NPROCS + 1) == "written by " + std::to_string(NPROCS) + " ranks; restart it with as many");
+    header.deck = MDPAT::Checkpoint::hash("traj dump.txt\nmsd 2\n");
+    BOOST_TEST(checkpoint.mismatch(header, NPROCS) == "written by a different input deck");
+    header.deck = deck;
+    header.magic[0] = 'X';
+    BOOST_TEST(checkpoint.mismatch(header, NPROCS) == "not a checkpoint file");
+
+    // Restart: the pass resumes after round 4 with every rank's own accumulators
+    std::fill(sums.begin(), sums.end(), 0.0);
+    rounds = 0;
+    checkpoint.restart(path, 0.0);
+    BOOST_TEST(checkpoint.isRestarting());
+    BOOST_TEST(!checkpoint.beginStep(0));
+    BOOST_TEST(checkpoint.beginPass(10, accumulators()) == 4U);
+    BOOST_TEST(rounds == 4U);
+    for (const double sum : sums)
+        BOOST_TEST(sum == 2.0 * (ME + 1));
+    // A later pass of the same step starts over
+    BOOST_TEST(checkpoint.beginPass(10, accumulators()) == 0U);
+
+    // Once the step is finished, a restart skips it and whole passes in it
+    checkpoint.endStep();
+    checkpoint.restart(path, 0.0);
+    BOOST_TEST(checkpoint.beginStep(0));
+    BOOST_TEST(checkpoint.beginPass(7) == 7U);
+    BOOST_TEST(!checkpoint.beginStep(1));
+    BOOST_TEST(checkpoint.beginPass(7) == 0U);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (ME == 0)
+        fs::remove(path);
+}
@@ -0,0 +1,185 @@
+#define BOOST_TEST_MODULE header-only testCluster
+#include <boost/test/included/unit_test.hpp>
+#include <mpi.h>
+#include "../src/cluster.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <set>
+#include <utility>
+
+int ME = 0, NPROCS = 1;
+struct MPISetup
+{
+    MPISetup()
+    {
+        int argc = 0;
+        char **argv = nullptr;
+        MPI_Init(&argc, &argv);
+        MPI_Comm_rank(MPI_COMM_WORLD, &ME);
+        MPI_Comm_size(MPI_COMM_WORLD, &NPROCS);
+    }
+    ~MPISetup() { MPI_Finalize(); }
+};
+
+BOOST_TEST_GLOBAL_FIXTURE(MPISetup);
+
+typedef std::set<std::pair<uint64_t, uint64_t>> PairSet;
+
+MDPAT::Box makeBox(double lx, double ly, double lz, double xy = 0.0, double xz = 0.0, double yz = 0.0)
+{
+    MDPAT::Box box;
+    box.lo = {-1.0, 0.5, 2.0};
+    box.hi = {box.lo[0] + lx, box.lo[1] + ly, box.lo[2] + lz};
+    box.xy = xy;
+    box.xz = xz;
+    box.yz = yz;
+    box.triclinic = (xy != 0.0 || xz != 0.0 || yz != 0.0);
+    return box;
+}
+
+// Positions anywhere in the box, some shifted out by whole periods as unwrapped dumps are
+std::vector<double> randomPositions(const MDPAT::Box& box, const uint64_t n, const uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::uniform_int_distribution<int> period(-1, 1);
+    std::vector<double> positions(3 * n);
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        const double s[3] = {unit(rng) + period(rng), unit(rng) + period(rng), unit(rng) + period(rng)};
+        positions[3 * i] = box.lo[0] + s[0] * box.length(0) + s[1] * box.xy + s[2] * box.xz;
+        positions[3 * i + 1] = box.lo[1] + s[1] * box.length(1) + s[2] * box.yz;
+        positions[3 * i + 2] = box.lo[2] + s[2] * box.length(2);
+    }
+    return positions;
+}
+
+// Every pair closer than the cutoff, searching the images within four periods
+PairSet referencePairs(const MDPAT::Box& box, const std::vector<double>& positions, const double cutoff)
+{
+    const uint64_t n = positions.size() / 3;
+    PairSet pairs;
+    for (uint64_t a = 0; a < n; ++a)
+    for (uint64_t b = a + 1; b < n; ++b)
+    {
+        double best = 1e300;
+        for (int i = -4; i <= 4; ++i)
+        for (int j = -4; j <= 4; ++j)
+        for (int k = -4; k <= 4; ++k)
+        {
+            const double dx = positions[3 * b] - positions[3 * a] + i * box.length(0) + j * box.xy + k * box.xz;
+            const double dy = positions[3 * b + 1] - positions[3 * a + 1] + j * box.length(1) + k * box.yz;
+            const double dz = positions[3 * b + 2] - positions[3 * a + 2] + k * box.length(2);
+            best = std::min(best, dx * dx + dy * dy + dz * dz);
+        }
+        if (best < cutoff * cutoff)
+            pairs.insert({a, b});
+    }
+    return pairs;
+}
+
+// Sorted cluster sizes from the pairs, by a plain serial union-find
+std::vector<uint64_t> referenceSizes(const uint64_t n, const PairSet& pairs)
+{
+    std::vector<uint64_t> parent(n);
+    for (uint64_t i = 0; i < n; ++i)
+        parent[i] = i;
+    auto find = [&parent](uint64_t x) {
+        while (parent[x] != x)
+            x = parent[x];
+        return x;
+    };
+    for (const auto& [a, b] : pairs)
+        parent[find(a)] = find(b);
+
+    std::vector<uint64_t> count(n, 0UL);
+    for (uint64_t i = 0; i < n; ++i)
+        ++count[find(i)];
+    std::vector<uint64_t> sizes;
+    for (const uint64_t c : count)
+        if (c > 0)
+            sizes.push_back(c);
+    std::sort(sizes.begin(), sizes.end());
+    return sizes;
+}
+
+template <typename Geometry>
+void checkAgainstReference(const MDPAT::Box& box, const uint64_t n, const double cutoff, const uint64_t seed)
+{
+    const auto positions = randomPositions(box, n, seed);
+    const PairSet expected = referencePairs(box, positions, cutoff);
+
+    MDPAT::CellList<Geometry> cells(box, cutoff);
+    cells.build(positions.data(), n);
+    BOOST_TEST(cells.size() == n);
+
+    PairSet found;
+    uint64_t calls = 0UL;
+    cells.forEachPair([&](const uint64_t a, const uint64_t b) {
+#pragma omp critical
+        {
+            found.insert({std::min(a, b), std::max(a, b)});
+            ++calls;
+        }
+    });
+    BOOST_TEST(calls == found.size());  // each pair exactly once
+    BOOST_TEST((found == expected));
+
+    MDPAT::UnionFind sets(n);
+    auto sizes = MDPAT::clusterSizes(cells, sets);
+    std::sort(sizes.begin(), sizes.end());
+    const auto expectedSizes = referenceSizes(n, expected);
+    BOOST_TEST(sizes == expectedSizes, boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(union_find_serial)
+{
+    MDPAT::UnionFind sets(8);
+    sets.unite(5, 2);
+    sets.unite(7, 5);
+    sets.unite(1, 3);
+    BOOST_TEST(sets.find(7) == 2U);  // root is the smallest element
+    BOOST_TEST(sets.find(3) == 1U);
+    BOOST_TEST(sets.find(0) == 0U);
+    BOOST_TEST(sets.find(4) == 4U);
+
+    sets.reset();
+    for (uint64_t i = 0; i < sets.size(); ++i)
+        BOOST_TEST(sets.find(i) == i);
+}
+
+BOOST_AUTO_TEST_CASE(union_find_concurrent_chain)
+{
+    // Threads unite neighbors of a ring in arbitrary order; all must end in one set rooted at 0
+    const uint64_t n = 100000;
+    MDPAT::UnionFind sets(n);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (uint64_t i = 0; i < n; ++i)
+        sets.unite((i * 7919) % n, (i * 7919 + 1) % n);
+    bool allRoot = true;
+    for (uint64_t i = 0; i < n; ++i)
+        allRoot = allRoot && sets.find(i) == 0U;
+    BOOST_TEST(allRoot);
+}
+
+BOOST_AUTO_TEST_CASE(cell_list_orthogonal)
+{
+    checkAgainstReference<MDPAT::OrthoGeometry>(makeBox(8.0, 9.0, 10.0), 400, 1.1, 1);
+}
+
+BOOST_AUTO_TEST_CASE(cell_list_orthogonal_few_cells)
+{
+    // Fewer than three cells along x and y, where neighbor cells would repeat
+    checkAgainstReference<MDPAT::OrthoGeometry>(makeBox(3.0, 5.0, 10.0), 200, 1.4, 2);
+}
+
+BOOST_AUTO_TEST_CASE(cell_list_triclinic)
+{
+    checkAgainstReference<MDPAT::TriclinicGeometry>(makeBox(8.0, 9.0, 10.0, 2.5, -1.5, 3.0), 400, 1.1, 3);
+}
+
+BOOST_AUTO_TEST_CASE(cell_list_triclinic_few_cells)
+{
+    checkAgainstReference<MDPAT::TriclinicGeometry>(makeBox(4.0, 6.0, 5.0, 1.5, 1.0, -2.0), 200, 1.3, 4);
+}
@@ -0,0 +1,93 @@
+#define BOOST_TEST_MODULE header-only testIncremental
+#include <boost/test/included/unit_test.hpp>
+#include <mpi.h>
+#include "../src/incremental.hpp"
+#include <cstdint>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+int ME = 0, NPROCS = 1;
+struct MPISetup
+{
+    MPISetup()
+    {
+        int argc = 0;
+        char **argv = nullptr;
+        MPI_Init(&argc, &argv);
+        MPI_Comm_rank(MPI_COMM_WORLD, &ME);
+        MPI_Comm_size(MPI_COMM_WORLD, &NPROCS);
+    }
+    ~MPISetup() { MPI_Finalize(); }
+};
+
+BOOST_TEST_GLOBAL_FIXTURE(MPISetup);
+
+BOOST_AUTO_TEST_CASE(state_resumes_next_run)
+{
+    const fs::path path = fs::temp_directory_path() / "mdpat_test.state";
+    if (ME == 0)
+        fs::remove(path);
+    MPI_Barrier(MPI_COMM_WORLD);
+    const uint64_t trajectory = MDPAT::Checkpoint::hash("dump.txt 0 100");
+    MDPAT::Incremental& incremental = MDPAT::Incremental::get();
+
+    // First run: no state yet, so every frame is new and sums start from zero
+    incremental.enable(path, 5);
+    BOOST_TEST(incremental.isEnabled());
+    BOOST_TEST(incremental.getWindowSteps() == 5U);
+    incremental.setTrajectory(trajectory);
+    BOOST_TEST(incremental.getFramesDone() == 0U);
+    incremental.getFrameIndex() = {0, 120, 240, 360};
+    incremental.setFrames(0, 10);
+    BOOST_TEST(incremental.getFirstNewFrame() == 0U);
+
+    std::vector<double> sums(3, -1.0);
+    uint64_t count = 99;
+    auto accumulators = [&]() { return MDPAT::Accumulators().add(sums).add(count); };
+    for (int occurrence = 0; occurrence < 2; ++occurrence)
+    {
+        incremental.beginCommand({"msd", "types", "1"});
+        sums = {0.0, 0.0, 0.0};
+        count = 0;
+        incremental.resume(accumulators());
+        BOOST_TEST(sums == std::vector<double>({0.0, 0.0, 0.0}), boost::test_tools::per_element());
+        BOOST_TEST(count == 0U);
+        sums = {1.0 + occurrence, 2.0, 3.0};
+        count = 10 + occurrence;
+        incremental.keep(accumulators());
+    }
+    incremental.save();
+    BOOST_TEST(fs::exists(path));
+    BOOST_TEST(!fs::exists(path.string() + ".tmp"));
+
+    // Second run: the frames and offsets done, and rank 0's sums of each occurrence
+    incremental.enable(path, 5);
+    incremental.setTrajectory(trajectory);
+    BOOST_TEST(incremental.getFramesDone() == 10U);
+    BOOST_TEST(incremental.getFrameIndex() == std::vector<uint64_t>({0, 120, 240, 360}), boost::test_tools::per_element());
+    incremental.setFrames(7, 15);  // a window of 3 old frames before the new ones
+    BOOST_TEST(incremental.getFirstNewFrame() == 3U);
+
+    for (int occurrence = 0; occurrence < 2; ++occurrence)
+    {
+        incremental.beginCommand({"msd", "types", "1"});
+        sums = {0.0, 0.0, 0.0};
+        count = 0;
+        incremental.resume(accumulators());
+        if (ME == 0)
+        {
+            BOOST_TEST(sums == std::vector<double>({1.0 + occurrence, 2.0, 3.0}), boost::test_tools::per_element());
+            BOOST_TEST(count == 10U + occurrence);
+        }
+        else
+        {
+            BOOST_TEST(sums == std::vector<double>({0.0, 0.0, 0.0}), boost::test_tools::per_element());
+            BOOST_TEST(count == 0U);
+        }
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (ME == 0)
+        fs::remove(path);
+}
@@ -0,0 +1,80 @@
+#define BOOST_TEST_MODULE header-only testLayout
+#include <boost/test/included/unit_test.hpp>
+#include "../src/layout.hpp"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+typedef MDPAT::Trajectory::Axis Axis;
+
+const std::array<MDPAT::Trajectory::AxisOrder, 6> ORDERS = {{
+    {Axis::FRAMES, Axis::ATOMS, Axis::PROPS},
+    {Axis::FRAMES, Axis::PROPS, Axis::ATOMS},
+    {Axis::ATOMS, Axis::FRAMES, Axis::PROPS},
+    {Axis::ATOMS, Axis::PROPS, Axis::FRAMES},
+    {Axis::PROPS, Axis::FRAMES, Axis::ATOMS},
+    {Axis::PROPS, Axis::ATOMS, Axis::FRAMES},
+}};
+
+// Lengths of FRAMES, ATOMS, PROPS; distinct, so a swapped pair of axes shows
+const std::array<uint64_t, 3> LENGTHS = {3, 5, 4};
+
+// Value at frame f, atom a, column c
+double value(const uint64_t f, const uint64_t a, const uint64_t c)
+{
+    return 100.0 * f + 10.0 * a + c;
+}
+
+// Lengths of an order, by position
+MDPAT::Trajectory::Dimensions lengthsOf(const MDPAT::Trajectory::AxisOrder& order)
+{
+    return {LENGTHS[static_cast<int>(order[0]) - 1], LENGTHS[static_cast<int>(order[1]) - 1], LENGTHS[static_cast<int>(order[2]) - 1]};
+}
+
+// The whole array laid out in an order
+std::vector<double> laidOut(const MDPAT::Trajectory::AxisOrder& order)
+{
+    const auto strides = MDPAT::Trajectory::layoutStrides(order, lengthsOf(order));
+    std::vector<double> data(LENGTHS[0] * LENGTHS[1] * LENGTHS[2]);
+    for (uint64_t f = 0; f < LENGTHS[0]; ++f)
+        for (uint64_t a = 0; a < LENGTHS[1]; ++a)
+            for (uint64_t c = 0; c < LENGTHS[2]; ++c)
+                data[f * strides[0] + a * strides[1] + c * strides[2]] = value(f, a, c);
+    return data;
+}
+
+BOOST_AUTO_TEST_CASE(with_layout_matches_order)
+{
+    for (const auto& order : ORDERS)
+    {
+        MDPAT::withLayout(order, [&](auto tag) {
+            using L = typename decltype(tag)::type;
+            BOOST_TEST((L::order() == order));
+            for (int i = 0; i < 3; ++i)
+                BOOST_TEST(L::position(order[i]) == i);
+        });
+    }
+}
+
+BOOST_AUTO_TEST_CASE(transpose_every_pair_round_trip)
+{
+    for (const auto& from : ORDERS)
+    {
+        for (const auto& to : ORDERS)
+        {
+            const std::vector<double> in = laidOut(from);
+            const std::vector<double> expected = laidOut(to);
+            std::vector<double> out(in.size(), -1.0), back(in.size(), -1.0);
+            MDPAT::withLayout(from, [&](auto fromTag) {
+                MDPAT::withLayout(to, [&](auto toTag) {
+                    using From = typename decltype(fromTag)::type;
+                    using To = typename decltype(toTag)::type;
+                    MDPAT::transposeBlock<From, To>(in.data(), lengthsOf(from), out.data());
+                    MDPAT::transposeBlock<To, From>(out.data(), lengthsOf(to), back.data());
+                });
+            });
+            BOOST_TEST(out == expected, boost::test_tools::per_element());
+            BOOST_TEST(back == in, boost::test_tools::per_element());
+        }
+    }
+}
@@ -0,0 +1,199 @@
+#define BOOST_TEST_MODULE header-only testRagged
+#include <boost/test/included/unit_test.hpp>
+#include <mpi.h>
+#include "../src/msd.hpp"
+#include "../src/trajectory.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+
+namespace fs = std::filesystem;
+
+int ME = 0, NPROCS = 1;
+struct MPISetup
+{
+    MPISetup()
+    {
+        int argc = 0;
+        char **argv = nullptr;
+        MPI_Init(&argc, &argv);
+        MPI_Comm_rank(MPI_COMM_WORLD, &ME);
+        MPI_Comm_size(MPI_COMM_WORLD, &NPROCS);
+    }
+    ~MPISetup() { MPI_Finalize(); }
+};
+
+BOOST_TEST_GLOBAL_FIXTURE(MPISetup);
+
+const uint64_t NFRAMES = 7;
+const uint64_t MAXID = 40;
+
+// Atom `id` is in frame f unless this says otherwise; IDs above 30 appear only late
+bool inFrame(const uint64_t id, const uint64_t f)
+{
+    if (id > 30)
+        return f >= 4;
+    return (id * 7 + f * 3) % 5 != 0;
+}
+
+// Columns type xu yu zu, each a function of ID and frame
+std::array<double, 4> row(const uint64_t id, const uint64_t f)
+{
+    return {double(1 + id % 2), 0.5 * id + f, 0.25 * f * f - id, 0.1 * id * f};
+}
+
+std::vector<uint64_t> frameIds(const uint64_t f)
+{
+    std::vector<uint64_t> ids;
+    for (uint64_t id = 1; id <= MAXID; ++id)
+        if (inFrame(id, f))
+            ids.push_back(id);
+    return ids;
+}
+
+// One dump file, every frame's atoms in shuffled order
+fs::path writeDump()
+{
+    const fs::path path = fs::temp_directory_path() / "mdpat_test_ragged.txt";
+    if (ME == 0)
+    {
+        std::ofstream os(path);
+        std::mt19937_64 rng(5);
+        for (uint64_t f = 0; f < NFRAMES; ++f)
+        {
+            auto ids = frameIds(f);
+            std::shuffle(ids.begin(), ids.end(), rng);
+            os << "ITEM: TIMESTEP\n" << 10 * f << "\nITEM: NUMBER OF ATOMS\n" << ids.size() << "\n";
+            os << "ITEM: BOX BOUNDS pp pp pp\n0 10\n0 10\n0 10\nITEM: ATOMS id type xu yu zu\n";
+            for (const uint64_t id : ids)
+            {
+                const auto values = row(id, f);
+                os << id << " " << values[0] << " " << values[1] << " " << values[2] << " " << values[3] << "\n";
+            }
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    return path;
+}
+
+BOOST_AUTO_TEST_CASE(frames_as_csr)
+{
+    const fs::path path = writeDump();
+    MDPAT::Trajectory traj;
+    traj.setRagged(true);
+    traj.read(path);
+
+    std::set<uint64_t> all;
+    for (uint64_t f = 0; f < NFRAMES; ++f)
+        for (const uint64_t id : frameIds(f))
+            all.insert(id);
+    const std::vector<uint64_t> allIds(all.begin(), all.end());
+    BOOST_TEST(traj.getNumAtoms() == allIds.size());
+    BOOST_TEST(traj.getAtomIds() == allIds, boost::test_tools::per_element());
+
+    // Local frames back to back, each sorted by ID
+    const auto& offsets = traj.getFrameOffsets();
+    const auto& rowIds = traj.getRowIds();
+    const uint64_t nCols = traj.getColumnLabels().size();
+    BOOST_TEST(offsets.size() == traj.getSteps().size() + 1);
+    BOOST_TEST(offsets.front() == 0U);
+    BOOST_TEST(offsets.back() == rowIds.size());
+    bool rowsMatch = true;
+    for (uint64_t i = 0; i + 1 < offsets.size(); ++i)
+    {
+        const uint64_t f = traj.getFirstIndex() + i;
+        const auto ids = frameIds(f);
+        BOOST_TEST(offsets[i + 1] - offsets[i] == ids.size());
+        for (uint64_t k = 0; k < ids.size(); ++k)
+        {
+            const uint64_t r = offsets[i] + k;
+            const auto values = row(ids[k], f);
+            rowsMatch = rowsMatch && rowIds[r] == ids[k];
+            for (uint64_t c = 0; c < nCols; ++c)
+                rowsMatch = rowsMatch && std::abs(traj[r * nCols + c] - values[c]) < 1e-12;
+        }
+    }
+    BOOST_TEST(rowsMatch);
+    if (ME == 0)
+        fs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(series_by_atom)
+{
+    const fs::path path = writeDump();
+    MDPAT::Trajectory traj;
+    traj.setRagged(true);
+    traj.read(path);
+    const uint64_t nCols = traj.getColumnLabels().size();
+
+    std::vector<uint64_t> offsets, frames;
+    std::vector<double> rows;
+    const uint64_t firstAtom = traj.gatherAtomSeries(offsets, frames, rows);
+    const uint64_t nAtoms = offsets.size() - 1;
+
+    // Every atom has the frames it is in, ascending, and its row in each
+    bool seriesMatch = true;
+    for (uint64_t a = 0; a < nAtoms; ++a)
+    {
+        const uint64_t id = traj.getAtomIds()[firstAtom + a];
+        uint64_t s = offsets[a];
+        for (uint64_t f = 0; f < NFRAMES; ++f)
+        {
+            if (!inFrame(id, f))
+                continue;
+            seriesMatch = seriesMatch && s < offsets[a + 1] && frames[s] == f;
+            const auto values = row(id, f);
+            for (uint64_t c = 0; c < nCols; ++c)
+                seriesMatch = seriesMatch && std::abs(rows[s * nCols + c] - values[c]) < 1e-12;
+            ++s;
+        }
+        seriesMatch = seriesMatch && s == offsets[a + 1];
+    }
+    BOOST_TEST(seriesMatch);
+
+    uint64_t total = nAtoms;
+    MPI_Allreduce(MPI_IN_PLACE, &total, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    BOOST_TEST(total == traj.getNumAtoms());
+
+    // Ragged msd of type-1 atoms against the pairs of frames each is in
+    const uint64_t minGap = 1, maxGap = NFRAMES - 1, numGaps = maxGap - minGap + 1;
+    std::vector<double> msd(numGaps, 0.0), pairs(numGaps, 0.0);
+    uint64_t nSelected = MDPAT::msdRaggedBlock(
+        offsets.data(), frames.data(), rows.data(), nAtoms, nCols, {1, 2, 3}, 0, {1}, minGap, maxGap,
+        msd.data(), pairs.data());
+    MPI_Allreduce(MPI_IN_PLACE, &nSelected, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, msd.data(), numGaps, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, pairs.data(), numGaps, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    uint64_t expectedSelected = 0;
+    std::vector<double> expectedMsd(numGaps, 0.0), expectedPairs(numGaps, 0.0);
+    for (uint64_t id = 1; id <= MAXID; ++id)
+    {
+        if (row(id, 0)[0] != 1.0)
+            continue;
+        ++expectedSelected;
+        for (uint64_t i = 0; i < NFRAMES; ++i)
+        for (uint64_t j = i + 1; j < NFRAMES; ++j)
+        {
+            if (!inFrame(id, i) || !inFrame(id, j))
+                continue;
+            const auto a = row(id, i), b = row(id, j);
+            double rsq = 0.0;
+            for (int c = 1; c < 4; ++c)
+                rsq += (b[c] - a[c]) * (b[c] - a[c]);
+            expectedMsd[j - i - minGap] += rsq;
+            expectedPairs[j - i - minGap] += 1.0;
+        }
+    }
+    BOOST_TEST(nSelected == expectedSelected);
+    BOOST_TEST(pairs == expectedPairs, boost::test_tools::per_element());
+    for (uint64_t g = 0; g < numGaps; ++g)
+        BOOST_TEST(msd[g] == expectedMsd[g], boost::test_tools::tolerance(1e-9));
+    if (ME == 0)
+        fs::remove(path);
+}
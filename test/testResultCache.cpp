@@ -0,0 +1,102 @@
+#define BOOST_TEST_MODULE header-only testResultCache
+#include <boost/test/included/unit_test.hpp>
+#include <mpi.h>
+#include "../src/reduce.hpp"
+#include "../src/resultCache.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+int ME = 0, NPROCS = 1;
+struct MPISetup
+{
+    MPISetup()
+    {
+        int argc = 0;
+        char **argv = nullptr;
+        MPI_Init(&argc, &argv);
+        MPI_Comm_rank(MPI_COMM_WORLD, &ME);
+        MPI_Comm_size(MPI_COMM_WORLD, &NPROCS);
+    }
+    ~MPISetup() { MPI_Finalize(); }
+};
+
+BOOST_TEST_GLOBAL_FIXTURE(MPISetup);
+
+const fs::path ROOT = fs::temp_directory_path() / "mdpat_test_cache";
+
+void writeFile(const fs::path& path, const std::string& text)
+{
+    if (ME == 0)
+        std::ofstream(path) << text;
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+std::string readFile(const fs::path& path)
+{
+    std::ostringstream oss;
+    oss << std::ifstream(path).rdbuf();
+    return oss.str();
+}
+
+// Starts a run of a deck that reads `dump`, then looks up the command
+bool lookUp(const fs::path& dump, const std::vector<std::string>& words, const bool invalidate = false)
+{
+    MDPAT::ResultCache& cache = MDPAT::ResultCache::get();
+    cache.enable(ROOT / "cache", invalidate);
+    cache.addContext({"traj", dump.string()});
+    cache.addDumpfiles({dump});
+    return cache.restore(words);
+}
+
+BOOST_AUTO_TEST_CASE(keys_and_restore)
+{
+    if (ME == 0)
+    {
+        fs::remove_all(ROOT);
+        fs::create_directories(ROOT);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    const fs::path dump = ROOT / "dump.txt";
+    const fs::path out = ROOT / "msd.txt";
+    writeFile(dump, "frames\n");
+    MDPAT::ResultCache& cache = MDPAT::ResultCache::get();
+
+    // A miss runs the command and stores its output
+    BOOST_TEST(!lookUp(dump, {"msd", "types", "1"}));
+    BOOST_TEST(cache.isEnabled());
+    writeFile(out, "0 0.0\n1 0.5\n");
+    if (ME == 0)
+        cache.addOutput(out);
+    cache.store();
+
+    // The same deck on the same dump is a hit that puts the output back
+    writeFile(out, "overwritten\n");
+    BOOST_TEST(lookUp(dump, {"msd", "types", "1"}));
+    MPI_Barrier(MPI_COMM_WORLD);
+    BOOST_TEST(readFile(out) == "0 0.0\n1 0.5\n");
+
+    // Other words, or invalidation, miss
+    BOOST_TEST(!lookUp(dump, {"msd", "types", "2"}));
+    BOOST_TEST(!lookUp(dump, {"msd", "types", "1"}, true));
+
+    // As does another reduction mode, set before or after `cache`
+    MDPAT::Reduction::setCompensated(true);
+    BOOST_TEST(!lookUp(dump, {"msd", "types", "1"}));
+    MDPAT::Reduction::setCompensated(false);
+    BOOST_TEST(lookUp(dump, {"msd", "types", "1"}));
+
+    // So does the same dump once it is modified, even with the same size
+    if (ME == 0)
+        fs::last_write_time(dump, fs::last_write_time(dump) + std::chrono::hours(1));
+    MPI_Barrier(MPI_COMM_WORLD);
+    BOOST_TEST(!lookUp(dump, {"msd", "types", "1"}));
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (ME == 0)
+        fs::remove_all(ROOT);
+}
@@ -0,0 +1,156 @@
+#define BOOST_TEST_MODULE header-only testStridedView
+#include <boost/test/included/unit_test.hpp>
+#include <mpi.h>
+#include "../src/trajectory.hpp"
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+
+namespace fs = std::filesystem;
+typedef MDPAT::Trajectory::Axis Axis;
+
+int ME = 0, NPROCS = 1;
+struct MPISetup
+{
+    MPISetup()
+    {
+        int argc = 0;
+        char **argv = nullptr;
+        MPI_Init(&argc, &argv);
+        MPI_Comm_rank(MPI_COMM_WORLD, &ME);
+        MPI_Comm_size(MPI_COMM_WORLD, &NPROCS);
+    }
+    ~MPISetup() { MPI_Finalize(); }
+};
+
+BOOST_TEST_GLOBAL_FIXTURE(MPISetup);
+
+const uint64_t NFRAMES = 5;
+const uint64_t NATOMS = 7;
+const uint64_t NCOLS = 4;
+
+const std::array<MDPAT::Trajectory::AxisOrder, 6> ORDERS = {{
+    {Axis::FRAMES, Axis::ATOMS, Axis::PROPS},
+    {Axis::FRAMES, Axis::PROPS, Axis::ATOMS},
+    {Axis::ATOMS, Axis::FRAMES, Axis::PROPS},
+    {Axis::ATOMS, Axis::PROPS, Axis::FRAMES},
+    {Axis::PROPS, Axis::FRAMES, Axis::ATOMS},
+    {Axis::PROPS, Axis::ATOMS, Axis::FRAMES},
+}};
+
+// Value of column c of atom slot a in frame f
+double value(const uint64_t f, const uint64_t a, const uint64_t c)
+{
+    return 1000.0 * f + 10.0 * a + c;
+}
+
+fs::path writeDump()
+{
+    const fs::path path = fs::temp_directory_path() / "mdpat_test_views.txt";
+    if (ME == 0)
+    {
+        std::ofstream os(path);
+        for (uint64_t f = 0; f < NFRAMES; ++f)
+        {
+            os << "ITEM: TIMESTEP\n" << f << "\nITEM: NUMBER OF ATOMS\n" << NATOMS << "\n";
+            os << "ITEM: BOX BOUNDS pp pp pp\n0 10\n0 10\n0 10\nITEM: ATOMS id c0 c1 c2 c3\n";
+            for (uint64_t a = 0; a < NATOMS; ++a)
+            {
+                os << a + 1;
+                for (uint64_t c = 0; c < NCOLS; ++c)
+                    os << " " << value(f, a, c);
+                os << "\n";
+            }
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    return path;
+}
+
+BOOST_AUTO_TEST_CASE(view_offsets)
+{
+    // 3 x 4 x 5 array in one layout: strides (20, 5, 1) by position
+    std::vector<int> data(60);
+    std::iota(data.begin(), data.end(), 0);
+    const MDPAT::StridedView2<const int> view(data.data() + 5, 4, 5, 5, 1);  // slice 1 of the first axis
+
+    BOOST_TEST(view(0, 0) == 5);
+    BOOST_TEST(view(3, 4) == 5 + 3 * 5 + 4);
+    BOOST_TEST(view.row(2).isContiguous());
+    BOOST_TEST(view.row(2)[3] == 5 + 2 * 5 + 3);
+    BOOST_TEST(view.row(2).size() == 5U);
+    BOOST_TEST(!view.col(3).isContiguous());
+    BOOST_TEST(view.col(3).stride() == 5U);
+    BOOST_TEST(view.col(3)[2] == 5 + 2 * 5 + 3);
+    BOOST_TEST(view.col(3).size() == 4U);
+}
+
+BOOST_AUTO_TEST_CASE(layout_strides_every_order)
+{
+    const MDPAT::Trajectory::Dimensions lengths = {3, 4, 5};  // by position in the order
+    for (const auto& order : ORDERS)
+    {
+        const auto strides = MDPAT::Trajectory::layoutStrides(order, lengths);
+        BOOST_TEST(strides[static_cast<int>(order[2]) - 1] == 1U);
+        BOOST_TEST(strides[static_cast<int>(order[1]) - 1] == 5U);
+        BOOST_TEST(strides[static_cast<int>(order[0]) - 1] == 20U);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(views_every_order)
+{
+    const fs::path path = writeDump();
+    MDPAT::Trajectory traj;
+    traj.read(path);
+
+    for (const auto& order : ORDERS)
+    {
+        traj.permuteDims(order);
+        BOOST_TEST((traj.getAxisOrder() == order));
+
+        // Local lengths and global offsets of each axis; only the first is split
+        std::array<uint64_t, 3> lengths, firsts = {0, 0, 0};
+        for (int i = 0; i < 3; ++i)
+            lengths[static_cast<int>(order[i]) - 1] = traj.getAxisLengths()[i];
+        firsts[static_cast<int>(order[0]) - 1] = traj.getFirstIndex();
+        const auto [nf, na, nc] = lengths;
+        const auto [f0, a0, c0] = firsts;
+
+        const auto strides = traj.getStrides();
+        BOOST_TEST(strides[static_cast<int>(order[2]) - 1] == 1U);
+        BOOST_TEST(strides[static_cast<int>(order[1]) - 1] == traj.getAxisLengths()[2]);
+        BOOST_TEST(strides[static_cast<int>(order[0]) - 1] == traj.getAxisLengths()[1] * traj.getAxisLengths()[2]);
+
+        bool ok = true;
+        for (uint64_t c = 0; c < nc; ++c)
+        {
+            const std::string label = "c" + std::to_string(c0 + c);
+            const auto column = traj.column(label.c_str());
+            ok = ok && column.size(0) == nf && column.size(1) == na;
+            for (uint64_t f = 0; f < nf; ++f)
+                for (uint64_t a = 0; a < na; ++a)
+                    ok = ok && column(f, a) == value(f0 + f, a0 + a, c0 + c) && column.row(f)[a] == column(f, a);
+        }
+        for (uint64_t a = 0; a < na; ++a)
+        {
+            const auto atom = traj.atom(a);
+            ok = ok && atom.size(0) == nf && atom.size(1) == nc;
+            for (uint64_t f = 0; f < nf; ++f)
+                for (uint64_t c = 0; c < nc; ++c)
+                    ok = ok && atom(f, c) == value(f0 + f, a0 + a, c0 + c) && atom.col(c)[f] == atom(f, c);
+        }
+        for (uint64_t f = 0; f < nf; ++f)
+        {
+            const auto frame = traj.frame(f);
+            ok = ok && frame.size(0) == na && frame.size(1) == nc;
+            for (uint64_t a = 0; a < na; ++a)
+                for (uint64_t c = 0; c < nc; ++c)
+                    ok = ok && frame(a, c) == value(f0 + f, a0 + a, c0 + c);
+        }
+        BOOST_TEST(ok);
+    }
+    if (ME == 0)
+        fs::remove(path);
+}
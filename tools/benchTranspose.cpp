@@ -0,0 +1,256 @@
+#include "benchTranspose.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/layout.hpp"
+
+using std::string;
+using std::vector;
+using MDPAT::Trajectory;
+typedef Trajectory::Axis Axis;
+
+/*
+ * Times the axis permutations that analyses pay for before their kernels run,
+ * with the runtime index arithmetic the transposes used before the layout
+ * kernels of src/layout.hpp and with those kernels, and reports the peak memory
+ * of each. `msd` is the transpose forEachAtomBlock makes for msd (and every atom
+ * analysis): FRAMES x ATOMS x PROPS to ATOMS x PROPS x FRAMES. `local` keeps the
+ * first axis (FRAMES x ATOMS x PROPS to FRAMES x PROPS x ATOMS), as
+ * permuteDimsLocal does, and compares the old in-place cycle following, an
+ * out-of-place copy and the in-place slices of transposeSlices. Each run is a
+ * forked process, so that its peak resident set is its own.
+ */
+int main(int nargs, char *args[])
+{
+    uint64_t nFrames = 200UL, nAtoms = 20000UL, nCols = 6UL;
+    int reps = 3;
+    for (int i = 1; i < nargs; i += 2)
+    {
+        const string arg(args[i]);
+        if (arg == "-h" || arg == "--help" || i + 1 >= nargs)
+        {
+            showhelp();
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+        if (arg == "-f" || arg == "--frames")
+            nFrames = std::stoull(args[i + 1]);
+        else if (arg == "-n" || arg == "--atoms")
+            nAtoms = std::stoull(args[i + 1]);
+        else if (arg == "-c" || arg == "--columns")
+            nCols = std::stoull(args[i + 1]);
+        else if (arg == "-r" || arg == "--reps")
+            reps = std::stoi(args[i + 1]);
+        else
+        {
+            std::cerr << "Unrecognized option: " << arg << std::endl;
+            showhelp();
+            return 1;
+        }
+    }
+
+    const Trajectory::AxisOrder frames = {Axis::FRAMES, Axis::ATOMS, Axis::PROPS};
+    const Trajectory::AxisOrder atoms = {Axis::ATOMS, Axis::PROPS, Axis::FRAMES};
+    const Trajectory::AxisOrder soa = {Axis::FRAMES, Axis::PROPS, Axis::ATOMS};
+    const Trajectory::Dimensions lengths = {nFrames, nAtoms, nCols};
+    const double dataMiB = nFrames * nAtoms * nCols * sizeof(double) / 1048576.0;
+
+    struct Case
+    {
+        const char *name;
+        const char *method;
+        Permutation permutation;
+    };
+    auto bind = [](auto transpose, const Trajectory::AxisOrder &from, const Trajectory::AxisOrder &to) {
+        return [=](vector<double> &data, const Trajectory::Dimensions &lengths) { transpose(data, lengths, from, to); };
+    };
+    const vector<Case> cases = {
+        {"msd", "generic", bind(genericTranspose, frames, atoms)},
+        {"msd", "layout", bind(layoutTranspose, frames, atoms)},
+        {"local", "cycles", bind(cycleTranspose, frames, soa)},
+        {"local", "generic", bind(genericTranspose, frames, soa)},
+        {"local", "layout", bind(layoutTranspose, frames, soa)},
+        {"local", "slices", bind(sliceTranspose, frames, soa)},
+    };
+
+    printf("# %llu frames x %llu atoms x %llu columns: %.1f MiB of data, best of %d\n",
+           (unsigned long long)nFrames, (unsigned long long)nAtoms, (unsigned long long)nCols, dataMiB, reps);
+    printf("# case    method   seconds   peak MiB  peak/data\n");
+    for (const auto &c : cases)
+    {
+        const BenchResult result = runForked(lengths, c.permutation, reps);
+        printf("%-9s %-8s %8.4f %10.1f %10.2f\n",
+               c.name, c.method, result.seconds, result.peakKiB / 1024.0, result.peakKiB / 1024.0 / dataMiB);
+    }
+    return 0;
+}
+
+// Distinct values, so that a wrong permutation would not go unnoticed by the caller
+void fillTrajectory(vector<double> &data)
+{
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = i;
+}
+
+/*
+ Out-of-place copy that maps every element through the runtime axis orders,
+ as the transposes did before the layout kernels.
+*/
+void genericTranspose(vector<double> &data, const Trajectory::Dimensions &lengths,
+                      const Trajectory::AxisOrder &from, const Trajectory::AxisOrder &to)
+{
+    uint32_t old2new[3];
+    Trajectory::Dimensions newLengths;
+    for (int i = 0; i < 3; ++i)
+    {
+        old2new[i] = std::find(to.begin(), to.end(), from[i]) - to.begin();
+        newLengths[old2new[i]] = lengths[i];
+    }
+
+    vector<double> permuted(data.size());
+    uint64_t oldIdx[3], newIdx[3], linear = 0UL;
+    for (oldIdx[0] = 0; oldIdx[0] < lengths[0]; ++oldIdx[0])
+        for (oldIdx[1] = 0; oldIdx[1] < lengths[1]; ++oldIdx[1])
+            for (oldIdx[2] = 0; oldIdx[2] < lengths[2]; ++oldIdx[2])
+            {
+                for (int i = 0; i < 3; ++i)
+                    newIdx[old2new[i]] = oldIdx[i];
+                permuted[(newIdx[0] * newLengths[1] + newIdx[1]) * newLengths[2] + newIdx[2]] = data[linear++];
+            }
+    data.swap(permuted);
+}
+
+/*
+ In-place cycle following with a bit per element, as permuteDimsLocal did before
+ the layout kernels: every index is decomposed with two divisions.
+*/
+void cycleTranspose(vector<double> &data, const Trajectory::Dimensions &lengths,
+                    const Trajectory::AxisOrder &from, const Trajectory::AxisOrder &to)
+{
+    uint32_t old2new[3];
+    Trajectory::Dimensions newLengths;
+    for (int i = 0; i < 3; ++i)
+    {
+        old2new[i] = std::find(to.begin(), to.end(), from[i]) - to.begin();
+        newLengths[old2new[i]] = lengths[i];
+    }
+
+    vector<bool> completed(data.size());
+    uint64_t oldIdx[3], newIdx[3];
+    for (uint64_t start = 1; start + 1 < data.size(); ++start)
+    {
+        if (completed[start])
+            continue;
+        uint64_t linear = start;
+        while (true)
+        {
+            const auto div1 = std::lldiv(linear, lengths[2]);
+            const auto div2 = std::lldiv(div1.quot, lengths[1]);
+            oldIdx[0] = div2.quot;
+            oldIdx[1] = div2.rem;
+            oldIdx[2] = div1.rem;
+            for (int i = 0; i < 3; ++i)
+                newIdx[old2new[i]] = oldIdx[i];
+            linear = (newIdx[0] * newLengths[1] + newIdx[1]) * newLengths[2] + newIdx[2];
+            completed[linear] = true;
+            if (linear == start)
+                break;
+            std::swap(data[start], data[linear]);
+        }
+    }
+}
+
+void layoutTranspose(vector<double> &data, const Trajectory::Dimensions &lengths,
+                     const Trajectory::AxisOrder &from, const Trajectory::AxisOrder &to)
+{
+    vector<double> permuted(data.size());
+    MDPAT::withLayout(from, [&](auto fromTag) {
+        MDPAT::withLayout(to, [&](auto toTag) {
+            MDPAT::transposeBlock<typename decltype(fromTag)::type, typename decltype(toTag)::type>(data.data(), lengths, permuted.data());
+        });
+    });
+    data.swap(permuted);
+}
+
+void sliceTranspose(vector<double> &data, const Trajectory::Dimensions &lengths,
+                    const Trajectory::AxisOrder &from, const Trajectory::AxisOrder &to)
+{
+    MDPAT::withLayout(from, [&](auto fromTag) {
+        MDPAT::withLayout(to, [&](auto toTag) {
+            using From = typename decltype(fromTag)::type;
+            using To = typename decltype(toTag)::type;
+            if constexpr (From::axis[0] == To::axis[0])
+                MDPAT::transposeSlices<From, To>(data.data(), lengths);
+        });
+    });
+}
+
+/*
+ Runs the permutation `reps` times in a child process on freshly filled data and
+ returns its best time and the child's peak resident set.
+*/
+BenchResult runForked(const Trajectory::Dimensions &lengths, const Permutation &permutation, int reps)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        std::cerr << "Couldn't create a pipe" << std::endl;
+        exit(1);
+    }
+
+    BenchResult result;
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        vector<double> data(lengths[0] * lengths[1] * lengths[2]);
+        double best = 1e300;
+        for (int rep = 0; rep < reps; ++rep)
+        {
+            data.resize(lengths[0] * lengths[1] * lengths[2]);
+            fillTrajectory(data);
+            const auto start = std::chrono::steady_clock::now();
+            permutation(data, lengths);
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        const ssize_t written = write(fds[1], &best, sizeof(best));
+        close(fds[1]);
+        _exit(written == sizeof(best) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    if (read(fds[0], &result.seconds, sizeof(result.seconds)) != sizeof(result.seconds))
+        result.seconds = -1.0;
+    close(fds[0]);
+    int status = 0;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    result.peakKiB = usage.ru_maxrss;
+    return result;
+}
+
+void showhelp()
+{
+    std::cout << "Times the axis permutations MDPAT makes before its analysis kernels,"
+              << " with and without the layout kernels of src/layout.hpp, and their peak memory.\n\n";
+    std::cout << "-f <N>\n";
+    std::cout << "--frames <N>                  "
+              << "Number of frames (default 200)\n";
+    std::cout << "-n <N>\n";
+    std::cout << "--atoms <N>                   "
+              << "Number of atoms (default 20000)\n";
+    std::cout << "-c <N>\n";
+    std::cout << "--columns <N>                 "
+              << "Number of columns (default 6)\n";
+    std::cout << "-r <N>\n";
+    std::cout << "--reps <N>                    "
+              << "Repetitions, of which the best is reported (default 3)\n";
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../src/trajectory.hpp"
+
+struct BenchResult
+{
+    double seconds = 0.0;  // best of the repetitions
+    long peakKiB = 0L;     // peak resident set of the process that ran it
+};
+
+typedef std::function<void(std::vector<double>&, const MDPAT::Trajectory::Dimensions&)> Permutation;
+
+void fillTrajectory(std::vector<double> &data);
+void genericTranspose(std::vector<double> &data, const MDPAT::Trajectory::Dimensions &lengths,
+                      const MDPAT::Trajectory::AxisOrder &from, const MDPAT::Trajectory::AxisOrder &to);
+void cycleTranspose(std::vector<double> &data, const MDPAT::Trajectory::Dimensions &lengths,
+                    const MDPAT::Trajectory::AxisOrder &from, const MDPAT::Trajectory::AxisOrder &to);
+void layoutTranspose(std::vector<double> &data, const MDPAT::Trajectory::Dimensions &lengths,
+                     const MDPAT::Trajectory::AxisOrder &from, const MDPAT::Trajectory::AxisOrder &to);
+void sliceTranspose(std::vector<double> &data, const MDPAT::Trajectory::Dimensions &lengths,
+                    const MDPAT::Trajectory::AxisOrder &from, const MDPAT::Trajectory::AxisOrder &to);
+BenchResult runForked(const MDPAT::Trajectory::Dimensions &lengths, const Permutation &permutation, int reps);
+void showhelp();
@@ -0,0 +1,610 @@
+#include "generateTrajectory.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include "../src/splitValues.hpp"
+
+#ifdef HAVE_MDBIN
+#include "mdbin.h"
+#endif
+
+using std::string;
+using std::vector;
+
+/*
+ * Writes a synthetic trajectory of random-walk polymers undergoing Brownian
+ * motion, for weak- and strong-scaling studies of MDPAT. Frames are split among
+ * the ranks with splitValues, and each rank writes only its own frames:
+ *  - text/binary with a '%' in the output name: one file per frame
+ *  - text/binary without a '%': one shared file, each rank writing at its own
+ *    offset (text rows are fixed-width so the offsets can be computed)
+ *  - mdbin: one file, written in rank order (only when built with the
+ *    src/mdbin submodule, which defines HAVE_MDBIN)
+ * Each bead performs an independent random walk whose steps are drawn from a
+ * counter-based generator keyed on (seed, bead, component, frame), so every frame
+ * is the same whatever the number of ranks, and a rank reaches its first frame
+ * in O(log nFrames) draws per coordinate (see displacement).
+ */
+int main(int nargs, char *args[])
+{
+    MPI_Init(&nargs, &args);
+    int me = 0, nprocs = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &me);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    GeneratorOptions opts;
+    if (!parseArgs(nargs, args, opts))
+    {
+        if (me == 0)
+            showhelp();
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (opts.boxLength <= 0.0)
+        opts.boxLength = std::cbrt(opts.nAtoms / opts.density);
+
+    RankState state;
+    std::tie(state.firstFrame, state.numFrames) = MDPAT::splitValues(opts.nFrames, me, nprocs);
+    while ((1UL << state.levels) < opts.nFrames)
+        ++state.levels;
+
+    initialConformation(opts, state.initial);
+    state.unwrapped = state.initial;
+    state.velocity.resize(state.initial.size());
+
+    const uint32_t ncols = opts.columns.size();
+    const bool perFrameFiles = opts.output.find('%') != string::npos;
+    vector<double> values(opts.nAtoms * ncols);
+    vector<double> mdbinData;
+
+    MPI_File fh;
+    uint64_t offset = 0UL;
+    if (opts.format != DumpFormat::MDBIN && !perFrameFiles)
+    {
+        MPI_File_open(MPI_COMM_WORLD, opts.output.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+        MPI_File_set_size(fh, 0);
+        for (uint64_t frame = 0; frame < state.firstFrame; ++frame)
+        {
+            const uint64_t step = opts.initStep + frame * opts.dumpStep;
+            if (opts.format == DumpFormat::TEXT)
+                offset += textFrameSize(opts, step);
+            else
+                offset += 104UL + values.size() * sizeof(double);
+        }
+    }
+    else if (opts.format == DumpFormat::MDBIN)
+    {
+        mdbinData.reserve(state.numFrames * values.size());
+    }
+
+    for (uint64_t i = 0; i < state.numFrames; ++i)
+    {
+        moveToFrame(opts, state, state.firstFrame + i);
+
+        const uint64_t step = opts.initStep + (state.firstFrame + i) * opts.dumpStep;
+        fillFrameValues(opts, state, values);
+
+        if (opts.format == DumpFormat::MDBIN)
+        {
+            mdbinData.insert(mdbinData.end(), values.begin(), values.end());
+            continue;
+        }
+
+        const string buffer = (opts.format == DumpFormat::TEXT) ? textFrame(opts, step, values)
+                                                                : binaryFrame(opts, step, values);
+        if (perFrameFiles)
+        {
+            const string filename = framePath(opts.output, step);
+            std::ofstream out(filename, std::ios::binary);
+            if (!out.good())
+            {
+                std::cerr << "Couldn't open file for writing: " << filename << std::endl;
+                MPI_Abort(MPI_COMM_WORLD, 3);
+            }
+            out.write(buffer.data(), buffer.size());
+            out.close();
+        }
+        else
+        {
+            writeAt(fh, offset, buffer);
+            offset += buffer.size();
+        }
+    }
+
+#ifdef HAVE_MDBIN
+    if (opts.format == DumpFormat::MDBIN)
+    {
+        MDBIN::HeaderInfo info;
+        info.initStep = opts.initStep;
+        info.endStep = opts.initStep + (opts.nFrames - 1) * opts.dumpStep;
+        info.deltaStep = opts.dumpStep;
+        info.columnLabels = opts.columns;
+        info.numFrames = opts.nFrames;
+        info.numAtoms = opts.nAtoms;
+        info.numCols = ncols;
+        if (me == 0 && MDBIN::write(opts.output, info, mdbinData))
+        {
+            std::cerr << "Couldn't write to file " << opts.output << std::endl;
+            MPI_Abort(MPI_COMM_WORLD, 3);
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        for (int i = 1; i < nprocs; ++i)
+        {
+            if (me == i)
+                MDBIN::append(opts.output, mdbinData);
+            MPI_Barrier(MPI_COMM_WORLD);
+        }
+    }
+#endif
+    if (opts.format != DumpFormat::MDBIN && !perFrameFiles)
+    {
+        MPI_File_close(&fh);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
+
+bool parseArgs(int nargs, char *args[], GeneratorOptions &opts)
+{
+    int i = 1;
+    while (i < nargs)
+    {
+        const string arg(args[i]);
+        if (arg == "-h" || arg == "--help" || arg == "-?")
+            return false;
+        if (i + 1 >= nargs)
+        {
+            std::cerr << "Missing value for option: " << arg << std::endl;
+            return false;
+        }
+        const string value(args[i + 1]);
+
+        if (arg == "-n" || arg == "--atoms")
+            opts.nAtoms = std::stoull(value);
+        else if (arg == "-f" || arg == "--frames")
+            opts.nFrames = std::stoull(value);
+        else if (arg == "-t" || arg == "--types")
+            opts.nTypes = std::stoul(value);
+        else if (arg == "-N" || arg == "--chain-length")
+            opts.chainLength = std::stoul(value);
+        else if (arg == "-i" || arg == "--init-step")
+            opts.initStep = std::stoull(value);
+        else if (arg == "-s" || arg == "--dump-step")
+            opts.dumpStep = std::stoull(value);
+        else if (arg == "-L" || arg == "--box-length")
+            opts.boxLength = std::stod(value);
+        else if (arg == "-r" || arg == "--density")
+            opts.density = std::stod(value);
+        else if (arg == "-D" || arg == "--step-size")
+            opts.stepSize = std::stod(value);
+        else if (arg == "-S" || arg == "--seed")
+            opts.seed = std::stoull(value);
+        else if (arg == "-c" || arg == "--columns")
+            opts.columns = splitColumns(value);
+        else if (arg == "-o" || arg == "--output-file")
+            opts.output = value;
+        else if (arg == "-F" || arg == "--format")
+        {
+            if (value == "text")
+                opts.format = DumpFormat::TEXT;
+            else if (value == "binary")
+                opts.format = DumpFormat::BINARY;
+            else if (value == "mdbin")
+            {
+#ifdef HAVE_MDBIN
+                opts.format = DumpFormat::MDBIN;
+#else
+                std::cerr << "MDBIN output requires the src/mdbin submodule" << std::endl;
+                return false;
+#endif
+            }
+            else
+            {
+                std::cerr << "Unrecognized format: " << value << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            std::cerr << "Unrecognized option: " << arg << std::endl;
+            return false;
+        }
+        i += 2;
+    }
+
+    if (opts.nAtoms == 0 || opts.nFrames == 0 || opts.output.size() == 0)
+    {
+        std::cerr << "Unspecified values! Must specify number of atoms,"
+                  << " number of frames, and the output file." << std::endl;
+        return false;
+    }
+    if (opts.chainLength == 0 || opts.nAtoms % opts.chainLength != 0)
+    {
+        std::cerr << "Number of atoms must be a multiple of the chain length." << std::endl;
+        return false;
+    }
+    if (opts.nTypes == 0 || opts.dumpStep == 0)
+    {
+        std::cerr << "Number of types and dump step must be positive." << std::endl;
+        return false;
+    }
+    if (opts.format == DumpFormat::MDBIN && opts.output.find('%') != string::npos)
+    {
+        std::cerr << "MDBIN output must be a single file." << std::endl;
+        return false;
+    }
+    for (const auto &label : opts.columns)
+    {
+        if (!validColumn(label))
+        {
+            std::cerr << "Unrecognized column: " << label << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ Splits a comma-separated list of column labels, putting `id` first.
+*/
+vector<string> splitColumns(const string &columnString)
+{
+    vector<string> columns = {"id"};
+    std::istringstream iss(columnString);
+    string label;
+    while (std::getline(iss, label, ','))
+    {
+        if (label.size() != 0 && label != "id")
+            columns.push_back(label);
+    }
+    return columns;
+}
+
+bool validColumn(const string &label)
+{
+    static const vector<string> valid = {
+        "id", "mol", "type",
+        "x", "y", "z",
+        "xu", "yu", "zu",
+        "xs", "ys", "zs",
+        "ix", "iy", "iz",
+        "vx", "vy", "vz"};
+    return valid.end() != std::find(valid.begin(), valid.end(), label);
+}
+
+/*
+ Random-walk chains of NN beads with fixed bond length, each starting at a
+ uniformly random point in the box. Every rank draws the same conformation.
+*/
+void initialConformation(const GeneratorOptions &opts, vector<double> &positions)
+{
+    std::mt19937_64 rng(opts.seed);
+    std::uniform_real_distribution<double> uniform(0.0, opts.boxLength);
+    std::normal_distribution<double> normal(0.0, 1.0);
+
+    positions.resize(opts.nAtoms * 3);
+    for (uint64_t i = 0; i < opts.nAtoms; ++i)
+    {
+        if (i % opts.chainLength == 0)
+        {
+            for (int d = 0; d < 3; ++d)
+                positions[i * 3 + d] = uniform(rng);
+            continue;
+        }
+
+        double bond[3], norm2 = 0.0;
+        for (int d = 0; d < 3; ++d)
+        {
+            bond[d] = normal(rng);
+            norm2 += bond[d] * bond[d];
+        }
+        const double scale = opts.bondLength / std::sqrt(norm2);
+        for (int d = 0; d < 3; ++d)
+            positions[i * 3 + d] = positions[(i - 1) * 3 + d] + bond[d] * scale;
+    }
+}
+
+static uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15UL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9UL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBUL;
+    return x ^ (x >> 31);
+}
+
+/*
+ A standard normal variate that depends only on its key (Box-Muller on two
+ hashed uniforms), so any rank can draw it without a shared stream.
+*/
+static double gaussian(uint64_t seed, uint64_t dof, uint32_t level, uint64_t index)
+{
+    const uint64_t key = splitmix64(seed ^ splitmix64(dof ^ splitmix64((uint64_t(level) << 58) ^ index)));
+    const double u1 = ((splitmix64(key) >> 11) + 1) * 0x1.0p-53;  // (0, 1]
+    const double u2 = (splitmix64(key + 1) >> 11) * 0x1.0p-53;     // [0, 1)
+    return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+}
+
+/*
+ Sum of the first `frame` steps of coordinate dof. The 2^levels steps form a binary
+ tree: the root holds their sum and each node splits its sum S of 2m steps into
+ halves S/2 +- stepSize * sqrt(m/2) * Z (Levy construction), so the sum before
+ any frame is found by descending to its leaf, adding every left half passed.
+*/
+double displacement(const GeneratorOptions &opts, uint32_t levels, uint64_t dof, uint64_t frame)
+{
+    double sum = opts.stepSize * std::sqrt(std::ldexp(1.0, levels)) * gaussian(opts.seed, dof, levels + 1, 0);
+    double before = 0.0;
+    uint64_t index = 0UL;
+    for (uint32_t level = levels; level > 0; --level)
+    {
+        const double left = 0.5 * sum + opts.stepSize * std::sqrt(std::ldexp(0.5, level - 1)) * gaussian(opts.seed, dof, level, index);
+        index *= 2;
+        if ((frame >> (level - 1)) & 1UL)
+        {
+            before += left;
+            sum -= left;
+            ++index;
+        }
+        else
+        {
+            sum = left;
+        }
+    }
+    return before;
+}
+
+/*
+ Positions and velocities (the last step) at frame, from those at state.frame
+ when it is the frame before.
+*/
+void moveToFrame(const GeneratorOptions &opts, RankState &state, uint64_t frame)
+{
+    for (size_t i = 0; i < state.initial.size(); ++i)
+    {
+        const double position = state.initial[i] + displacement(opts, state.levels, i, frame);
+        if (frame == 0)
+            state.velocity[i] = opts.stepSize * gaussian(opts.seed, i, state.levels + 2, 0);
+        else if (frame == state.frame + 1)
+            state.velocity[i] = position - state.unwrapped[i];
+        else
+            state.velocity[i] = position - (state.initial[i] + displacement(opts, state.levels, i, frame - 1));
+        state.unwrapped[i] = position;
+    }
+    state.frame = frame;
+}
+
+/*
+ Fills values (natoms x ncols, row-major) with the requested columns.
+*/
+void fillFrameValues(const GeneratorOptions &opts, const RankState &state, vector<double> &values)
+{
+    const uint32_t ncols = opts.columns.size();
+    const double L = opts.boxLength;
+
+    for (uint32_t j = 0; j < ncols; ++j)
+    {
+        const string &label = opts.columns[j];
+        const int d = (label[0] == 'v') ? label[1] - 'x' : label[label[0] == 'i' ? 1 : 0] - 'x';
+
+        for (uint64_t i = 0; i < opts.nAtoms; ++i)
+        {
+            const double xu = (d >= 0 && d < 3) ? state.unwrapped[i * 3 + d] : 0.0;
+            const double image = std::floor(xu / L);
+            double value = 0.0;
+
+            if (label == "id")
+                value = i + 1;
+            else if (label == "mol")
+                value = i / opts.chainLength + 1;
+            else if (label == "type")
+                value = (i % opts.chainLength) * opts.nTypes / opts.chainLength + 1;
+            else if (label[0] == 'v')
+                value = state.velocity[i * 3 + d];
+            else if (label[0] == 'i')
+                value = image;
+            else if (label.size() == 1)
+                value = xu - image * L;
+            else if (label[1] == 'u')
+                value = xu;
+            else
+                value = xu / L - image;
+
+            values[i * ncols + j] = value;
+        }
+    }
+}
+
+string textHeader(const GeneratorOptions &opts, uint64_t step)
+{
+    std::ostringstream oss;
+    oss << "ITEM: TIMESTEP\n" << step << '\n';
+    oss << "ITEM: NUMBER OF ATOMS\n" << opts.nAtoms << '\n';
+    oss << "ITEM: BOX BOUNDS pp pp pp\n";
+    oss << std::scientific << std::setprecision(16);
+    for (int d = 0; d < 3; ++d)
+        oss << 0.0 << ' ' << opts.boxLength << '\n';
+    oss << "ITEM: ATOMS";
+    for (const auto &label : opts.columns)
+        oss << ' ' << label;
+    oss << '\n';
+    return oss.str();
+}
+
+static bool isIntegerColumn(const string &label)
+{
+    return label == "id" || label == "mol" || label == "type" || label[0] == 'i';
+}
+
+/*
+ Every row has the same width: integer columns are right-aligned to a fixed
+ width and floating-point columns use "% .8e" (15 characters).
+*/
+static uint64_t textRowSize(const GeneratorOptions &opts)
+{
+    uint64_t size = 0UL;
+    for (const auto &label : opts.columns)
+        size += (isIntegerColumn(label) ? 12 : 15) + 1;
+    return size;
+}
+
+uint64_t textFrameSize(const GeneratorOptions &opts, uint64_t step)
+{
+    return textHeader(opts, step).size() + opts.nAtoms * textRowSize(opts);
+}
+
+string textFrame(const GeneratorOptions &opts, uint64_t step, const vector<double> &values)
+{
+    const uint32_t ncols = opts.columns.size();
+    string buffer = textHeader(opts, step);
+    const size_t headerSize = buffer.size();
+    buffer.resize(headerSize + opts.nAtoms * textRowSize(opts));
+
+    char *pos = &buffer[headerSize];
+    char field[32];
+    for (uint64_t i = 0; i < opts.nAtoms; ++i)
+    {
+        for (uint32_t j = 0; j < ncols; ++j)
+        {
+            int n = 0;
+            if (isIntegerColumn(opts.columns[j]))
+                n = snprintf(field, sizeof(field), "%12lld", (long long)values[i * ncols + j]);
+            else
+                n = snprintf(field, sizeof(field), "% .8e", values[i * ncols + j]);
+            std::copy(field, field + n, pos);
+            pos += n;
+            *pos++ = (j + 1 < ncols) ? ' ' : '\n';
+        }
+    }
+    return buffer;
+}
+
+/*
+ One snapshot in the original LAMMPS binary dump layout (as read by `binary2txt`):
+ timestep, natoms, triclinic flag, boundary flags, box bounds, size_one, and the
+ atoms in chunks whose int counts fit in an int.
+*/
+string binaryFrame(const GeneratorOptions &opts, uint64_t step, const vector<double> &values)
+{
+    std::ostringstream oss(std::ios::binary);
+    const int64_t ntimestep = step;
+    const int64_t natoms = opts.nAtoms;
+    const int triclinic = 0;
+    const int boundary[6] = {0, 0, 0, 0, 0, 0};
+    const double box[6] = {0.0, opts.boxLength, 0.0, opts.boxLength, 0.0, opts.boxLength};
+    const int sizeOne = opts.columns.size();
+    const uint64_t atomsPerChunk = INT_MAX / sizeOne;
+    const int nchunk = std::max<uint64_t>(1UL, (opts.nAtoms + atomsPerChunk - 1) / atomsPerChunk);
+
+    oss.write(reinterpret_cast<const char *>(&ntimestep), sizeof(int64_t));
+    oss.write(reinterpret_cast<const char *>(&natoms), sizeof(int64_t));
+    oss.write(reinterpret_cast<const char *>(&triclinic), sizeof(int));
+    oss.write(reinterpret_cast<const char *>(boundary), 6 * sizeof(int));
+    oss.write(reinterpret_cast<const char *>(box), 6 * sizeof(double));
+    oss.write(reinterpret_cast<const char *>(&sizeOne), sizeof(int));
+    oss.write(reinterpret_cast<const char *>(&nchunk), sizeof(int));
+    for (uint64_t first = 0; first < values.size(); first += atomsPerChunk * sizeOne)
+    {
+        const int n = std::min<uint64_t>(atomsPerChunk * sizeOne, values.size() - first);
+        oss.write(reinterpret_cast<const char *>(&n), sizeof(int));
+        oss.write(reinterpret_cast<const char *>(values.data() + first), n * sizeof(double));
+    }
+    return oss.str();
+}
+
+/*
+ Substitutes step into a name such as `dump.%09d.txt`, following the same
+ syntax as the `traj` input command.
+*/
+string framePath(const string &pattern, uint64_t step)
+{
+    const auto subStartIdx = pattern.find('%');
+    const auto subEndIdx = pattern.find_first_of("DIdi", subStartIdx + 1);
+    const string fmt = pattern.substr(subStartIdx + 1, subEndIdx - subStartIdx - 1);
+
+    std::ostringstream oss;
+    oss << pattern.substr(0, subStartIdx);
+    if (fmt.size() != 0)
+    {
+        if (fmt[0] == '0')
+            oss.fill('0');
+        oss << std::setw(std::stoul(fmt));
+    }
+    oss << step << pattern.substr(subEndIdx + 1);
+    return oss.str();
+}
+
+/*
+ Independent write at a byte offset, split into pieces that fit in an int count.
+*/
+int writeAt(MPI_File fh, uint64_t offset, const string &buffer)
+{
+    const uint64_t maxChunk = INT_MAX;
+    uint64_t written = 0UL;
+    while (written < buffer.size())
+    {
+        const int count = std::min<uint64_t>(maxChunk, buffer.size() - written);
+        int err = MPI_File_write_at(fh, offset + written, buffer.data() + written, count, MPI_CHAR, MPI_STATUS_IGNORE);
+        if (err != MPI_SUCCESS)
+            return err;
+        written += count;
+    }
+    return 0;
+}
+
+void showhelp()
+{
+    std::cout << "A tool for generating synthetic LAMMPS text, LAMMPS binary, and MDBIN"
+              << " trajectories of Brownian random-walk polymers for scaling studies.\n"
+              << "Run with mpirun; each rank generates and writes its own frames.\n\n";
+    std::cout << "-n <N>\n";
+    std::cout << "--atoms <N>                   "
+              << "Total number of atoms (a multiple of the chain length)\n";
+    std::cout << "-f <N>\n";
+    std::cout << "--frames <N>                  "
+              << "Number of frames\n";
+    std::cout << "-N <N>\n";
+    std::cout << "--chain-length <N>            "
+              << "Atoms per chain, NN (default 1)\n";
+    std::cout << "-t <N>\n";
+    std::cout << "--types <N>                   "
+              << "Number of atom types, assigned in blocks along each chain (default 1)\n";
+    std::cout << "-c <list>\n";
+    std::cout << "--columns <list>              "
+              << "Comma-separated columns from id,mol,type,x,y,z,xu,yu,zu,xs,ys,zs,ix,iy,iz,vx,vy,vz"
+              << " (default id,mol,type,xu,yu,zu)\n";
+    std::cout << "-i <step>\n";
+    std::cout << "--init-step <step>            "
+              << "First timestep (default 0)\n";
+    std::cout << "-s <step>\n";
+    std::cout << "--dump-step <step>            "
+              << "Timesteps between frames (default 1000)\n";
+    std::cout << "-L <length>\n";
+    std::cout << "--box-length <length>         "
+              << "Cubic box length (default from density)\n";
+    std::cout << "-r <density>\n";
+    std::cout << "--density <density>           "
+              << "Number density used when no box length is given (default 0.85)\n";
+    std::cout << "-D <length>\n";
+    std::cout << "--step-size <length>          "
+              << "RMS displacement per component per frame (default 0.1)\n";
+    std::cout << "-S <seed>\n";
+    std::cout << "--seed <seed>                 "
+              << "Random seed (default 12345)\n";
+    std::cout << "-F <format>\n";
+    std::cout << "--format <format>             "
+              << "text, binary, or mdbin (default text)\n";
+    std::cout << "-o <filename>\n";
+    std::cout << "--output-file <filename>      "
+              << "Output file; a name such as dump.%09d.txt writes one file per frame\n";
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+enum class DumpFormat {TEXT, BINARY, MDBIN};
+
+struct GeneratorOptions
+{
+    uint64_t nAtoms = 0UL;
+    uint64_t nFrames = 0UL;
+    uint32_t nTypes = 1U;
+    uint32_t chainLength = 1U;  // NN
+    uint64_t initStep = 0UL;
+    uint64_t dumpStep = 1000UL;
+    double boxLength = 0.0;     // 0 => chosen from density
+    double density = 0.85;
+    double bondLength = 0.97;
+    double stepSize = 0.1;      // rms displacement per component per frame
+    uint64_t seed = 12345UL;
+    DumpFormat format = DumpFormat::TEXT;
+    std::vector<std::string> columns = {"id", "mol", "type", "xu", "yu", "zu"};
+    std::string output = "";
+};
+
+struct RankState
+{
+    uint64_t firstFrame = 0UL;
+    uint64_t numFrames = 0UL;
+    uint32_t levels = 0U;           // 2^levels >= nFrames steps in the tree of displacement
+    uint64_t frame = 0UL;           // frame of unwrapped
+    std::vector<double> initial;    // natoms x 3
+    std::vector<double> unwrapped;  // natoms x 3
+    std::vector<double> velocity;   // natoms x 3
+};
+
+bool parseArgs(int nargs, char *args[], GeneratorOptions &opts);
+std::vector<std::string> splitColumns(const std::string &columnString);
+bool validColumn(const std::string &label);
+void initialConformation(const GeneratorOptions &opts, std::vector<double> &positions);
+double displacement(const GeneratorOptions &opts, uint32_t levels, uint64_t dof, uint64_t frame);
+void moveToFrame(const GeneratorOptions &opts, RankState &state, uint64_t frame);
+void fillFrameValues(const GeneratorOptions &opts, const RankState &state, std::vector<double> &values);
+std::string textHeader(const GeneratorOptions &opts, uint64_t step);
+std::string textFrame(const GeneratorOptions &opts, uint64_t step, const std::vector<double> &values);
+std::string binaryFrame(const GeneratorOptions &opts, uint64_t step, const std::vector<double> &values);
+uint64_t textFrameSize(const GeneratorOptions &opts, uint64_t step);
+std::string framePath(const std::string &pattern, uint64_t step);
+int writeAt(MPI_File fh, uint64_t offset, const std::string &buffer);
+void showhelp();